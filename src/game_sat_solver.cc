@@ -32,16 +32,23 @@
 #include "src/game_sat_solver.h"
 
 #include <algorithm>
+#include <chrono>  // NOLINT [build/c++11]
 #include <fstream>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <mutex>  // NOLINT [build/c++11]
+#include <system_error>
 #include <unordered_set>
 
+#include "google/protobuf/text_format.h"
 #include "ortools/base/logging.h"
 #include "ortools/sat/cp_model.pb.h"
 #include "ortools/sat/cp_model_solver.h"
 #include "ortools/sat/model.h"
 #include "ortools/sat/sat_parameters.pb.h"
+#include "src/model_export.h"
+#include "src/setup_catalog.h"
 #include "src/util.h"
 
 namespace botc {
@@ -50,9 +57,86 @@ using operations_research::sat::CpSolverStatus;
 using operations_research::sat::LinearExpr;
 using operations_research::sat::NewFeasibleSolutionObserver;
 using operations_research::sat::SatParameters;
+using std::chrono::duration;
+using std::chrono::steady_clock;
 using std::ofstream;
 
-void GameSatSolver::CompileSatModel() {
+namespace {
+// Base models by template key, shared by all solvers of the process.
+struct BaseModelTemplates {
+  std::mutex mutex;
+  unordered_map<string, std::shared_ptr<const CompiledModel>> models;
+};
+
+BaseModelTemplates& GetBaseModelTemplates() {
+  static BaseModelTemplates* const kTemplates = new BaseModelTemplates();
+  return *kTemplates;
+}
+
+bool HasVariant(const ModelOptions& options,
+                ModelOptions::ModelVariant variant) {
+  return std::find(options.variants().begin(), options.variants().end(),
+                   variant) != options.variants().end();
+}
+}  // namespace
+
+GameSatSolver::GameSatSolver(const GameState& g, const ModelOptions& options)
+    : g_(g), script_(g.GetScript()), model_(options.named_model()),
+      preprocess_model_(options.preprocess_model()),
+      integer_roles_(options.role_encoding() == ModelOptions::INTEGER_ROLES),
+      skip_impossible_info_claims_(
+          HasVariant(options, ModelOptions::SKIP_IMPOSSIBLE_INFO_CLAIMS)),
+      setup_table_(options.setup_encoding() == ModelOptions::SETUP_TABLE),
+      skip_setup_catalog_(
+          HasVariant(options, ModelOptions::SKIP_SETUP_CATALOG)),
+      disabled_phases_(options.disabled_phases().begin(),
+                       options.disabled_phases().end()) {
+  switch (options.cardinality_encoding()) {
+    case ModelOptions::SEQUENTIAL_COUNTER:
+      model_.SetDefaultCardinalityEncoding(
+          CardinalityEncoding::kSequentialCounter);
+      break;
+    case ModelOptions::TOTALIZER:
+      model_.SetDefaultCardinalityEncoding(CardinalityEncoding::kTotalizer);
+      break;
+    case ModelOptions::CARDINALITY_NETWORK:
+      model_.SetDefaultCardinalityEncoding(
+          CardinalityEncoding::kCardinalityNetwork);
+      break;
+    default:
+      model_.SetDefaultCardinalityEncoding(CardinalityEncoding::kLinear);
+  }
+  model_.SetConstantFolding(!options.disable_constant_folding());
+  PreprocessGameState();
+  ComputeClaimableRoles();
+  NewVarFamilies();
+  if (options.use_base_model_templates() && !options.named_model() &&
+      !integer_roles_) {
+    base_model_key_ = BaseModelKey(options);
+  }
+  // The base model templates have a role variable for every player, role and
+  // time step.
+  dense_role_vars_ = options.dense_role_vars() || !base_model_key_.empty();
+  if (!dense_role_vars_) {
+    ComputeRoleVarTimes();
+  }
+  if (options.model_cache_dir().empty()) {
+    CompileSatModel();
+  } else {
+    const uint64_t fingerprint = ModelFingerprint(options);
+    const path filename = path(options.model_cache_dir()) /
+                          absl::StrFormat("model_%016x.binpb", fingerprint);
+    if (!LoadSatModel(filename, fingerprint)) {
+      CompileSatModel();
+      StoreSatModel(filename, fingerprint);
+    }
+  }
+  if (preprocess_model_) {
+    PreprocessSatModel();
+  }
+}
+
+void GameSatSolver::PreprocessGameState() {
   CHECK(g_.CurrentTime().is_day) << "Can only solve during the day";
   // Solver simplifying assumptions: the game state is fully claimed, and at
   // this point everyone is either telling the truth or is Evil.
@@ -74,14 +158,331 @@ void GameSatSolver::CompileSatModel() {
         claims.empty() ? ROLE_UNSPECIFIED : claims[0]);
   }
   role_action_claims_ = g_.GetRoleActionClaimsByNight();
+}
+
+void GameSatSolver::ComputeClaimableRoles() {
+  claimable_roles_.assign(g_.NumPlayers(), 0);
+  for (int i = 0; i < g_.NumPlayers(); ++i) {
+    // Good players never change roles in TB, and were shown their claim, so
+    // a good role is only possible if it was claimed from the start.
+    const Role claim = starting_role_claims_[i];
+    for (Role role : AllRoles(script_)) {
+      const bool claimed = role == DRUNK ? IsTownsfolkRole(claim)
+                                         : role == claim;
+      if (!IsGoodRole(role) || claimed) {
+        claimable_roles_[i] |= uint64_t{1} << role;
+      }
+    }
+  }
+}
+
+uint64_t GameSatSolver::RoleChanges(int player, const Time& time) const {
+  if (time >= g_.CurrentTime() || !g_.IsAlive(player, time)) {
+    return 0;  // In TB, dead don't change roles.
+  }
+  auto mask = [](absl::Span<const Role> roles) {
+    uint64_t result = 0;
+    for (Role role : roles) {
+      result |= uint64_t{1} << role;
+    }
+    return result;
+  };
+  // Mirrors the role propagation of AddScarletWomanProcConstraints and
+  // AddImpStarpassConstraints.
+  if (time.is_day) {
+    vector<int> demon_candidates;
+    unordered_set<int> sw_candidates;
+    ScarletWomanProcCandidates(time, &demon_candidates, &sw_candidates);
+    return sw_candidates.contains(player) ? mask({SCARLET_WOMAN, IMP}) : 0;
+  }
+  int dead_imp_candidate, known_catch;
+  unordered_set<int> catch_candidates;
+  StarpassCandidates(time, &dead_imp_candidate, &known_catch,
+                     &catch_candidates);
+  if (known_catch != kNoPlayer) {
+    return player == known_catch ? mask(AllRoles(script_)) : 0;
+  }
+  return catch_candidates.contains(player) ?
+      mask({IMP, POISONER, SPY, SCARLET_WOMAN, BARON, RECLUSE}) : 0;
+}
+
+void GameSatSolver::ComputeRoleVarTimes() {
+  const int num_times = g_.CurrentTime().Index() + 1;
+  role_var_times_.assign(
+      g_.NumPlayers(),
+      vector<vector<int>>(num_times, vector<int>(Role_ARRAYSIZE)));
+  for (int i = 0; i < g_.NumPlayers(); ++i) {
+    auto& times = role_var_times_[i];
+    for (Role role : AllRoles(script_)) {
+      times[0][role] = 0;
+    }
+    for (Time time = Time::Night(2); time <= g_.CurrentTime(); ++time) {
+      const Time prev = time - 1;
+      const uint64_t changes = RoleChanges(i, prev);
+      for (Role role : AllRoles(script_)) {
+        // A constant false role variable on either side is a new variable.
+        const bool same = !((changes >> role) & 1) &&
+                          HasRoleVar(i, role, prev) &&
+                          HasRoleVar(i, role, time);
+        times[time.Index()][role] =
+            same ? times[prev.Index()][role] : time.Index();
+      }
+    }
+  }
+}
+
+void GameSatSolver::CompileSatModel() {
+  // The base model is the same for all games with the same template key.
+  const bool base_model = !base_model_key_.empty();
+  if (base_model) {
+    CompilePhase("BaseModel", [this] { AddBaseModel(); });
+  }
+  CompilePhase("RoleSetup", [&] {
+    if (base_model) {
+      AddSetupCatalogFixings();
+    } else {
+      AddRoleSetupConstraints();
+    }
+    for (Time time = Time::Night(1); time <= g_.CurrentTime(); ++time) {
+      model_.SetConstraintTag({.source = "RoleSetup", .time = time.Index()});
+      AddStorytellerRoleConstraints(time);
+      if (!base_model) {
+        AddRoleSetupConstraints(time);
+      }
+      AddRolePropagationConstraints(time);
+    }
+    AddDemonInfoConstraints();
+    AddMinionInfoConstraints();
+  });
+  CompilePhase("ShownToken", [&] {
+    AddKnownShownTokenConstraints();
+    if (!base_model) {
+      AddShownTokenConstraints();
+    }
+  });
+  CompilePhase("RoleClaims", [this] { AddRoleClaimsConstraints(); });
+  for (Role role : AllRoles(script_)) {
+    CompilePhase(Role_Name(role),
+                 [this, role] { (this->*(kAddRoleConstraints[role]))(); });
+  }
+  CompilePhase("GameEnd", [this] { AddGameEndConstraints(); });
+  CompilePhase("Presolve", [this] { AddPresolveConstraints(); });
+  if (integer_roles_) {
+    CompilePhase("RoleDomains", [this] { AddRoleDomainConstraints(); });
+  }
+  // Not a phase, since it cannot be disabled.
+  model_.SetConstraintTag({.source = "RequestLiterals"});
+  AddRequestLiterals();
+}
+
+uint64_t GameSatSolver::ModelFingerprint(const ModelOptions& options) const {
+  ModelOptions compile_options = options;
+  compile_options.clear_model_cache_dir();
+  compile_options.clear_preprocess_model();
+  return Fingerprint(absl::StrCat(
+      kSolverVersion, "|", Script_Name(script_), "|",
+      SerializeDeterministically(compile_options), "|",
+      SerializeDeterministically(g_.ToProto())));
+}
+
+bool GameSatSolver::LoadSatModel(const path& filename, uint64_t fingerprint) {
+  CompiledModel compiled;
+  if (!ReadBinaryProtoFromFile(filename, &compiled) ||
+      compiled.fingerprint() != fingerprint) {
+    return false;
+  }
+  CompilePhase("LoadModelCache", [&] {
+    model_.FromProto(compiled);
+    LoadRequestLiterals(compiled);
+  });
+  return true;
+}
+
+void GameSatSolver::StoreSatModel(const path& filename,
+                                  uint64_t fingerprint) const {
+  CompiledModel compiled;
+  compiled.set_fingerprint(fingerprint);
+  model_.ToProto(&compiled);
+  StoreRequestLiterals(&compiled);
+  // The cache is an optimization, so failing to store the model is not fatal.
+  std::error_code error;
+  create_directories(filename.parent_path(), error);
+  if (error || !WriteBinaryProtoToFile(compiled, filename)) {
+    LOG(WARNING) << "Failed storing the compiled model to " << filename;
+  }
+}
+
+void GameSatSolver::TagConstraints(const string& source,
+                                   const internal::RoleAction& ra) {
+  model_.SetConstraintTag({.source = source, .role = ra.acting,
+                           .time = ra.time.Index(), .event = ra.event});
+}
+
+void GameSatSolver::NameConstraints(CpModelProto* model) const {
+  for (const ConstraintTagRange& range : model_.GetConstraintTags()) {
+    const ConstraintTag& tag = range.tag;
+    string name = tag.source;
+    if (tag.role >= 0) {
+      absl::StrAppend(&name, " ", Role_Name(static_cast<Role>(tag.role)));
+    }
+    if (tag.time >= 0) {
+      absl::StrAppend(&name, " ", string(Time::FromIndex(tag.time)));
+    }
+    if (tag.event >= 0) {
+      absl::StrAppend(&name, " event_", tag.event);
+    }
+    for (int i = range.begin; i < range.end && i < model->constraints_size();
+         ++i) {
+      if (model->constraints(i).name().empty()) {
+        model->mutable_constraints(i)->set_name(name);
+      }
+    }
+  }
+}
+
+void GameSatSolver::WriteModelToFile(const path& filename) const {
+  CpModelProto model_pb = model_.Model().Build();
+  model_.NameVariables(&model_pb);
+  NameConstraints(&model_pb);
+  WriteProtoToFile(model_pb, filename);
+}
+
+absl::Status GameSatSolver::ExportModel(const SolverRequest& request,
+                                        const string& prefix) {
+  CHECK(!integer_roles_)
+      << "Only models with the BOOLEAN_ROLES encoding can be exported";
+  CHECK(!setup_table_)
+      << "Only models with the ROLE_COUNTS encoding can be exported";
+  const auto assumption_literals =
+      CollectAssumptionLiterals(request.assumptions());
+  if (!assumption_literals.ok()) {
+    return assumption_literals.status();
+  }
+  vector<int> assumptions;
+  for (const BoolVar& v : *assumption_literals) {
+    assumptions.push_back(v.index());
+  }
+  vector<int> projection;
+  for (int i = 0; i < g_.NumPlayers(); ++i) {
+    for (Role role : AllRoles(script_)) {
+      if (HasRoleVar(i, role, g_.CurrentTime())) {
+        projection.push_back(FindRoleVar(i, role, g_.CurrentTime()).index());
+      }
+    }
+  }
+  const CpModelProto& model_pb = model_.Model().Build();
+  ofstream cnf(prefix + ".cnf");
+  WriteDimacs(model_pb, assumptions, projection, cnf);
+  ofstream opb(prefix + ".opb");
+  WriteOpb(model_pb, assumptions, opb);
+  ofstream vars(prefix + ".vars");
+  WriteVarMap(model_.VarKeys(), vars);
+  return absl::OkStatus();
+}
+
+string GameSatSolver::BaseModelKey(const ModelOptions& options) const {
+  ModelOptions compile_options;
+  compile_options.set_cardinality_encoding(options.cardinality_encoding());
+  compile_options.set_disable_constant_folding(
+      options.disable_constant_folding());
+  compile_options.set_setup_encoding(options.setup_encoding());
+  *compile_options.mutable_variants() = options.variants();
+  return absl::StrCat(
+      kSolverVersion, "|", Script_Name(script_), "|", g_.NumPlayers(), "|",
+      Perspective_Name(g_.GetPerspective()), "|", g_.CurrentTime().Index(),
+      "|", SerializeDeterministically(compile_options));
+}
+
+void GameSatSolver::AddBaseModel() {
+  BaseModelTemplates& templates = GetBaseModelTemplates();
+  std::shared_ptr<const CompiledModel> base;
+  {
+    std::lock_guard<std::mutex> lock(templates.mutex);
+    const auto it = templates.models.find(base_model_key_);
+    if (it != templates.models.end()) {
+      base = it->second;
+    }
+  }
+  if (base != nullptr) {
+    model_.FromProto(*base);
+    return;
+  }
   AddRoleSetupConstraints();
+  for (Time time = Time::Night(1); time <= g_.CurrentTime(); ++time) {
+    AddRoleSetupConstraints(time);
+  }
   AddShownTokenConstraints();
-  AddRoleClaimsConstraints();
-  for (Role role : AllRoles(script_)) {
-    (this->*(kAddRoleConstraints[role]))();
+  auto compiled = std::make_shared<CompiledModel>();
+  model_.ToProto(compiled.get());
+  std::lock_guard<std::mutex> lock(templates.mutex);
+  templates.models.emplace(base_model_key_, std::move(compiled));
+}
+
+void GameSatSolver::CompilePhase(const string& name,
+                                 const std::function<void()>& compile) {
+  if (disabled_phases_.contains(name)) {
+    return;
   }
-  AddGameEndConstraints();
-  AddPresolveConstraints();
+  const auto& model_pb = model_.Model().Build();
+  const int variables = model_pb.variables_size();
+  const int constraints = model_pb.constraints_size();
+  const steady_clock::time_point begin = steady_clock::now();
+  model_.SetConstraintTag({.source = name});
+  compile();
+  const steady_clock::time_point end = steady_clock::now();
+  model_stats_.phases.push_back({
+      .name = name,
+      .wall_time = duration<double>(end - begin).count(),
+      .variables = model_pb.variables_size() - variables,
+      .constraints = model_pb.constraints_size() - constraints,
+      .literals = model_.NumConstraintLiterals(constraints)});
+}
+
+ostream& operator<<(ostream& os, const ModelStats& stats) {
+  ModelStats::Phase total = {.name = "Total"};
+  os << absl::StrFormat("%-16s %12s %10s %12s %10s\n", "Phase", "Time[ms]",
+                        "Variables", "Constraints", "Literals");
+  auto print_phase = [&os](const ModelStats::Phase& p) {
+    os << absl::StrFormat("%-16s %12.3f %10d %12d %10d\n", p.name,
+                          p.wall_time * 1000, p.variables, p.constraints,
+                          p.literals);
+  };
+  for (const auto& p : stats.phases) {
+    print_phase(p);
+    total.wall_time += p.wall_time;
+    total.variables += p.variables;
+    total.constraints += p.constraints;
+    total.literals += p.literals;
+  }
+  print_phase(total);
+  return os;
+}
+
+void GameSatSolver::NewVarFamilies() {
+  const int num_players = g_.NumPlayers();
+  role_family_ = model_.NewVarFamily(
+      "role", {num_players, Role_ARRAYSIZE, g_.CurrentTime().Index() + 1},
+      [this](absl::Span<const int> key) {
+        return absl::StrFormat("role_%s_%s_%s", g_.PlayerName(key[0]),
+                               Role_Name(Role(key[1])), Time::FromIndex(key[2]));
+      });
+  shown_token_family_ = model_.NewVarFamily(
+      "shown_token", {num_players, Role_ARRAYSIZE},
+      [this](absl::Span<const int> key) {
+        return absl::StrFormat("shown_token_%s_%s", g_.PlayerName(key[0]),
+                               Role_Name(Role(key[1])));
+      });
+  poisoner_pick_family_ = model_.NewVarFamily(
+      "poisoner_pick", {num_players, g_.CurrentTime().count},
+      [this](absl::Span<const int> key) {
+        return absl::StrFormat("poisoner_pick_%s_night_%d",
+                               g_.PlayerName(key[0]), key[1] + 1);
+      });
+  red_herring_family_ = model_.NewVarFamily(
+      "red_herring", {num_players},
+      [this](absl::Span<const int> key) {
+        return absl::StrFormat("red_herring_%s", g_.PlayerName(key[0]));
+      });
 }
 
 void GameSatSolver::AddWasherwomanConstraints() {
@@ -103,6 +504,7 @@ void GameSatSolver::AddChefConstraints() {
   }
   for (const auto& actions : it->second) {
     for (const auto* ra : actions) {
+      TagConstraints("AddChefConstraints", *ra);
       AddChefConstraints(ra->player, ra->number);
     }
   }
@@ -110,11 +512,11 @@ void GameSatSolver::AddChefConstraints() {
 
 void GameSatSolver::AddChefConstraints(int chef, int chef_number) {
   const Time night1 = Time::Night(1);
-  /* Puzzle: why does adding this make the BaronPerspectiveThreeMinions test
-     15 times slower????
-  if (!IsRolePossible(chef, CHEF, night1)) {
+  // Puzzle: why does this make the BaronPerspectiveThreeMinions test 15 times
+  // slower? Kept as a model variant, to be measured by model_experiment.
+  if (skip_impossible_info_claims_ && !IsRolePossible(chef, CHEF, night1)) {
     return;  // We know it's a bluff.
-  }*/
+  }
   vector<BoolVar> registered_evil;  // How everyone registered to the Chef.
   for (int i = 0; i < g_.NumPlayers(); ++i) {
     BoolVar reg_evil_i = (i == chef ? model_.FalseVar() :  // Chef is good
@@ -128,8 +530,8 @@ void GameSatSolver::AddChefConstraints(int chef, int chef_number) {
         evil_options_i.push_back(
             model_.NewEquivalentVarAnd(
                 {RoleVar(i, RECLUSE, night1), Not(PoisonerPickVar(i, night1))},
-                absl::StrFormat("healthy_recluse_%s_%s", g_.PlayerName(i),
-                                night1)));
+                VarName("healthy_recluse_%s_%s", g_.PlayerName(i),
+                        night1)));
       }
       model_.AddImplicationOr(reg_evil_i, evil_options_i);
       // We assume a Spy cannot be poisoned.
@@ -144,11 +546,11 @@ void GameSatSolver::AddChefConstraints(int chef, int chef_number) {
     evil_pairs.push_back(
         model_.NewEquivalentVarAnd(
             {registered_evil[i], registered_evil[j]},
-            absl::StrFormat("chef_evil_pair_%s_%s", g_.PlayerName(i),
-                            g_.PlayerName(j))));
+            VarName("chef_evil_pair_%s_%s", g_.PlayerName(i),
+                    g_.PlayerName(j))));
   }
   BoolVar correct = model_.NewEquivalentVarSumEq(
-      evil_pairs, chef_number, absl::StrFormat(
+      evil_pairs, chef_number, VarName(
           "chef_%s_number_%d", g_.PlayerName(chef), chef_number));
   model_.AddOr(
     {Not(RoleVar(chef, CHEF, night1)), PoisonerPickVar(chef, night1), correct});
@@ -161,6 +563,7 @@ void GameSatSolver::AddEmpathConstraints() {
   }
   for (const auto& actions : it->second) {
     for (const auto* ra : actions) {
+      TagConstraints("AddEmpathConstraints", *ra);
       AddEmpathConstraints(ra->player, ra->number, ra->time);
     }
   }
@@ -168,38 +571,38 @@ void GameSatSolver::AddEmpathConstraints() {
 
 void GameSatSolver::AddEmpathConstraints(
     int player, int number, const Time& time) {
-  vector<int> alive_neighbors = g_.AliveNeighbors(player, time);  // Size 2.
+  const PlayerList alive_neighbors = g_.AliveNeighbors(player, time);
   const int ping1 = alive_neighbors[0], ping2 = alive_neighbors[1];
   // We assume a Spy will not be poisoned. But Empath goes after the Imp, so
   // need to check day role.
   BoolVar ping1_regs_good = model_.NewEquivalentVarOr(
       {Not(StartingEvilVar(ping1)), RoleVar(ping1, SPY, time + 1)},
-      absl::StrFormat("empath_%s_registers_%s_good_%s", g_.PlayerName(player),
-                      g_.PlayerName(ping1), time));
+      VarName("empath_%s_registers_%s_good_%s", g_.PlayerName(player),
+              g_.PlayerName(ping1), time));
   BoolVar ping2_regs_good = model_.NewEquivalentVarOr(
       {Not(StartingEvilVar(ping2)), RoleVar(ping2, SPY, time + 1)},
-      absl::StrFormat("empath_%s_registers_%s_good_%s", g_.PlayerName(player),
-                      g_.PlayerName(ping2), time));
+      VarName("empath_%s_registers_%s_good_%s", g_.PlayerName(player),
+              g_.PlayerName(ping2), time));
   vector<BoolVar> ping1_regs_evil_cases({StartingEvilVar(ping1)});
   if (IsRolePossible(ping1, RECLUSE, time)) {
     ping1_regs_evil_cases.push_back(model_.NewEquivalentVarAnd(
         {RoleVar(ping1, RECLUSE, time), Not(PoisonedVar(ping1, time))},
-        absl::StrFormat("healthy_recluse_%s_%s", g_.PlayerName(ping1), time)));
+        VarName("healthy_recluse_%s_%s", g_.PlayerName(ping1), time)));
   }
   BoolVar ping1_regs_evil = model_.NewEquivalentVarOr(
       ping1_regs_evil_cases,
-      absl::StrFormat("empath_%s_registers_%s_evil_%s", g_.PlayerName(player),
-                      g_.PlayerName(ping1), time));
+      VarName("empath_%s_registers_%s_evil_%s", g_.PlayerName(player),
+              g_.PlayerName(ping1), time));
   vector<BoolVar> ping2_regs_evil_cases({StartingEvilVar(ping2)});
   if (IsRolePossible(ping2, RECLUSE, time)) {
     ping2_regs_evil_cases.push_back(model_.NewEquivalentVarAnd(
         {RoleVar(ping2, RECLUSE, time), Not(PoisonedVar(ping2, time))},
-        absl::StrFormat("healthy_recluse_%s_%s", g_.PlayerName(ping2), time)));
+        VarName("healthy_recluse_%s_%s", g_.PlayerName(ping2), time)));
   }
   BoolVar ping2_regs_evil = model_.NewEquivalentVarOr(
       ping2_regs_evil_cases,
-      absl::StrFormat("empath_%s_registers_%s_evil_%s", g_.PlayerName(player),
-                      g_.PlayerName(ping2), time));
+      VarName("empath_%s_registers_%s_evil_%s", g_.PlayerName(player),
+              g_.PlayerName(ping2), time));
   // A healthy Recluse *may* register as evil.
   // A healthy alive Spy *may* register as good.
   vector<BoolVar> cases({
@@ -208,26 +611,26 @@ void GameSatSolver::AddEmpathConstraints(
     case 0:
       cases.push_back(model_.NewEquivalentVarAnd(
           {ping1_regs_good, ping2_regs_good},
-          absl::StrFormat(
+          VarName(
             "empath_0_%s_on_%s_and_%s_%s", g_.PlayerName(player),
             g_.PlayerName(ping1), g_.PlayerName(ping2), time)));
       break;
     case 1:
       cases.push_back(model_.NewEquivalentVarAnd(
           {ping1_regs_good, ping2_regs_evil},
-          absl::StrFormat(
+          VarName(
             "empath_1_%s_on_%s_and_%s_%s_case1", g_.PlayerName(player),
             g_.PlayerName(ping1), g_.PlayerName(ping2), time)));
       cases.push_back(model_.NewEquivalentVarAnd(
           {ping1_regs_evil, ping2_regs_good},
-          absl::StrFormat(
+          VarName(
             "empath_1_%s_on_%s_and_%s_%s_case2", g_.PlayerName(player),
             g_.PlayerName(ping1), g_.PlayerName(ping2), time)));
       break;
     case 2:
       cases.push_back(model_.NewEquivalentVarAnd(
           {ping1_regs_evil, ping2_regs_evil},
-          absl::StrFormat(
+          VarName(
             "empath_2_%s_on_%s_and_%s_%s", g_.PlayerName(player),
             g_.PlayerName(ping1), g_.PlayerName(ping2), time)));
       break;
@@ -245,6 +648,7 @@ void GameSatSolver::AddFortuneTellerConstraints() {
   }
   for (const auto& actions : it->second) {
     for (const auto* ra : actions) {
+      TagConstraints("AddFortuneTellerConstraints", *ra);
       AddFortuneTellerConstraints(
           ra->player, ra->players[0], ra->players[1], ra->yes, ra->time);
     }
@@ -263,14 +667,14 @@ void GameSatSolver::AddFortuneTellerConstraints(
       if (IsRolePossible(pick, RECLUSE, time)) {
         yes_options.push_back(model_.NewEquivalentVarAnd(
           {RoleVar(pick, RECLUSE, time), Not(PoisonedVar(pick, time))},
-          absl::StrFormat("healthy_recluse_%s_%s", g_.PlayerName(pick), time)));
+          VarName("healthy_recluse_%s_%s", g_.PlayerName(pick), time)));
       }
     }
   }
   vector<BoolVar> cases({
       Not(RoleVar(player, FORTUNE_TELLER, time)), PoisonedVar(player, time)});
   BoolVar is_yes = model_.NewEquivalentVarOr(
-      yes_options, absl::StrFormat("fortune_teller_yes_cases_%s", time));
+      yes_options, VarName("fortune_teller_yes_cases_%s", time));
   cases.push_back(yes ? is_yes : Not(is_yes));
   model_.AddOr(cases);
 }
@@ -294,6 +698,8 @@ void GameSatSolver::AddVirginConstraints() {
         role_claims_[n.nominee][n.time.count - 1] == VIRGIN);
     nominated[n.nominee] = true;
     if (possible_virgin_proc) {
+      model_.SetConstraintTag({.source = "AddVirginConstraints",
+                               .role = VIRGIN, .time = n.time.Index()});
       AddVirginConstraints(n.nominator, n.nominee, n.time, n.virgin_proc);
     }
   }
@@ -301,15 +707,15 @@ void GameSatSolver::AddVirginConstraints() {
 
 void GameSatSolver::AddVirginConstraints(
     int nominator, int nominee, const Time& time, bool virgin_proc) {
-  vector<BoolVar> townsfolk_cases = CollectRolesForPlayer(
+  Literals townsfolk_cases = CollectRolesForPlayer(
       time, nominator, TownsfolkRoles(script_), true);
   if (virgin_proc) {
     townsfolk_cases.push_back(RoleVar(nominator, SPY, time));
   }
   BoolVar proc_townsfolk = model_.NewEquivalentVarSum(
       townsfolk_cases,
-      absl::StrFormat("%s_registers_townsfolk_to_virgin_%s",
-                      g_.PlayerName(nominator), time));
+      VarName("%s_registers_townsfolk_to_virgin_%s",
+              g_.PlayerName(nominator), time));
   BoolVar virgin = RoleVar(nominee, VIRGIN, time);
   BoolVar poisoned = PoisonedVar(nominee, time);
   if (virgin_proc) {
@@ -321,6 +727,7 @@ void GameSatSolver::AddVirginConstraints(
 
 void GameSatSolver::AddSlayerConstraints() {
   for (const auto* ra : g_.GetRoleActions(SLAYER)) {
+    TagConstraints("AddSlayerConstraints", *ra);
     const int target = ra->players[0], slayer = ra->player;
     const Time& time = ra->time;
     if (ra->yes) {
@@ -329,12 +736,12 @@ void GameSatSolver::AddSlayerConstraints() {
       if (IsRolePossible(target, RECLUSE, time)) {
         BoolVar healthy_recluse = model_.NewEquivalentVarAnd(
             {RoleVar(target, RECLUSE, time), Not(PoisonedVar(target, time))},
-            absl::StrFormat("healthy_recluse_%s_%s", g_.PlayerName(target),
-                            time));
+            VarName("healthy_recluse_%s_%s", g_.PlayerName(target),
+                    time));
         cases.push_back(model_.NewEquivalentVarOr(
             {RoleVar(target, IMP, time), healthy_recluse},
-            absl::StrFormat("healthy_recluse_or_imp_%s_%s",
-                            g_.PlayerName(target), time)));
+            VarName("healthy_recluse_or_imp_%s_%s",
+                    g_.PlayerName(target), time)));
       } else {
         cases.push_back(RoleVar(target, IMP, time));
       }
@@ -352,6 +759,7 @@ void GameSatSolver::AddPoisonerConstraints() {
   // variables are created. This only takes care of the Poisoner or Storyteller
   // perspective.
   for (const auto* ra : g_.GetRoleActions(POISONER)) {
+    TagConstraints("AddPoisonerConstraints", *ra);
     const int target = ra->players[0];
     model_.AddEquality(PoisonerPickVar(target, ra->time), true);
     // If there are night deaths, the poisoned player cannot be an alive
@@ -369,6 +777,7 @@ void GameSatSolver::AddPoisonerConstraints() {
 
 void GameSatSolver::AddSpyConstraints() {
   for (const auto* ra : g_.GetRoleActions(SPY)) {
+    TagConstraints("AddSpyConstraints", *ra);
     for (const auto& pi : ra->grimoire_info.player_info()) {
       const auto& tokens = pi.tokens();
       const bool is_drunk = std::find(
@@ -404,27 +813,25 @@ void GameSatSolver::AddImpConstraints() {
 }
 
 BoolVar GameSatSolver::RoleInPlayVar(Role role) {
-  vector<BoolVar> player_is_role;
+  Literals player_is_role;
   for (int i = 0; i < g_.NumPlayers(); ++i) {
     player_is_role.push_back(RoleVar(i, role, Time::Night(1)));
   }
   return model_.NewEquivalentVarSum(
-      player_is_role, absl::StrFormat("in_play_%s", Role_Name(role)));
+      player_is_role, VarName("in_play_%s", Role_Name(role)));
 }
 
 BoolVar GameSatSolver::StartingEvilVar(int player) {
-  vector<BoolVar> evil_roles;
-  for (Role role : EvilRoles(script_)) {
-    evil_roles.push_back(RoleVar(player, role, Time::Night(1)));
-  }
+  const Literals evil_roles = CollectRolesForPlayer(
+      Time::Night(1), player, EvilRoles(script_), false);
   return model_.NewEquivalentVarSum(
-      evil_roles, absl::StrFormat("starting_evil_%s", g_.PlayerName(player)));
+      evil_roles, VarName("starting_evil_%s", g_.PlayerName(player)));
 }
 
 BoolVar GameSatSolver::AliveRoleVar(Role role, const Time& time) {
   return model_.NewEquivalentVarSum(
       CollectAliveRoles(time, {role}),
-      absl::StrFormat("alive_%s_%s", Role_Name(role), time));
+      VarName("alive_%s_%s", Role_Name(role), time));
 }
 
 BoolVar GameSatSolver::PoisonedVar(int player, const Time& time) {
@@ -437,46 +844,294 @@ BoolVar GameSatSolver::PoisonedVar(int player, const Time& time) {
   // At most one night death in TB:
   return model_.NewEquivalentVarAnd(
       {Not(RoleVar(night_deaths[0], POISONER, night)), picked},
-      absl::StrFormat("poisoned_%s_%s", g_.PlayerName(player), night));
+      VarName("poisoned_%s_%s", g_.PlayerName(player), night));
+}
+
+void GameSatSolver::AddRequestLiterals() {
+  false_literal_ = model_.FalseVar();
+  const Time night1 = Time::Night(1);
+  for (int i = 0; i < g_.NumPlayers(); ++i) {
+    for (Role role : AllRoles(script_)) {
+      RoleVar(i, role, night1);
+      RoleVar(i, role, g_.CurrentTime());
+    }
+  }
+  role_in_play_literals_.assign(Role_ARRAYSIZE, false_literal_);
+  for (Role role : AllRoles(script_)) {
+    role_in_play_literals_[role] = RoleInPlayVar(role);
+  }
+  starting_evil_literals_.clear();
+  for (int i = 0; i < g_.NumPlayers(); ++i) {
+    starting_evil_literals_.push_back(StartingEvilVar(i));
+  }
+  // Any player may be assumed poisoned on any night, see
+  // AddPresolvePoisonerConstraints.
+  poisoned_literals_.clear();
+  for (Time time = Time::Night(1); time <= g_.CurrentTime(); time += 2) {
+    vector<BoolVar> night_literals;
+    for (int i = 0; i < g_.NumPlayers(); ++i) {
+      night_literals.push_back(PoisonedVar(i, time));
+    }
+    poisoned_literals_.push_back(night_literals);
+  }
+}
+
+void GameSatSolver::StoreRequestLiterals(CompiledModel* compiled) const {
+  compiled->add_request_literals(false_literal_.index());
+  for (const BoolVar& v : role_in_play_literals_) {
+    compiled->add_request_literals(v.index());
+  }
+  for (const BoolVar& v : starting_evil_literals_) {
+    compiled->add_request_literals(v.index());
+  }
+  for (const vector<BoolVar>& night_literals : poisoned_literals_) {
+    for (const BoolVar& v : night_literals) {
+      compiled->add_request_literals(v.index());
+    }
+  }
+}
+
+void GameSatSolver::LoadRequestLiterals(const CompiledModel& compiled) {
+  const int num_players = g_.NumPlayers();
+  const int num_nights = g_.CurrentTime().count;
+  CHECK_EQ(compiled.request_literals_size(),
+           1 + Role_ARRAYSIZE + num_players * (1 + num_nights))
+      << "Request literals do not match the compiled model";
+  auto next = compiled.request_literals().begin();
+  false_literal_ = model_.Literal(*next++);
+  role_in_play_literals_.clear();
+  for (int role = 0; role < Role_ARRAYSIZE; ++role) {
+    role_in_play_literals_.push_back(model_.Literal(*next++));
+  }
+  starting_evil_literals_.clear();
+  for (int i = 0; i < num_players; ++i) {
+    starting_evil_literals_.push_back(model_.Literal(*next++));
+  }
+  poisoned_literals_.assign(num_nights, {});
+  for (vector<BoolVar>& night_literals : poisoned_literals_) {
+    for (int i = 0; i < num_players; ++i) {
+      night_literals.push_back(model_.Literal(*next++));
+    }
+  }
+}
+
+void GameSatSolver::PreprocessSatModel() {
+  // The solution is read from the current and starting role variables, and
+  // requests assume the request literals and branch on the poisoner picks.
+  vector<int> protected_vars;
+  auto protect = [&protected_vars](const BoolVar& v) {
+    protected_vars.push_back(v.index() >= 0 ? v.index() : -v.index() - 1);
+  };
+  for (int i = 0; i < g_.NumPlayers(); ++i) {
+    for (Role role : AllRoles(script_)) {
+      protect(FindRoleVar(i, role, g_.CurrentTime()));
+      protect(FindRoleVar(i, role, Time::Night(1)));
+    }
+  }
+  for (const BoolVar& v : role_in_play_literals_) {
+    protect(v);
+  }
+  for (const BoolVar& v : starting_evil_literals_) {
+    protect(v);
+  }
+  for (int night = 0; night < poisoned_literals_.size(); ++night) {
+    for (int i = 0; i < g_.NumPlayers(); ++i) {
+      protect(poisoned_literals_[night][i]);
+      const BoolVar* pick = model_.FindFamilyVar(poisoner_pick_family_,
+                                                 {i, night});
+      if (pick != nullptr) {
+        protect(*pick);
+      }
+    }
+  }
+  auto preprocessed = std::make_unique<CpModelProto>(model_.Model().Build());
+  preprocessor_stats_ = PreprocessModel(protected_vars, preprocessed.get());
+  preprocessed_model_ = std::move(preprocessed);
 }
 
 void GameSatSolver::AddRoleSetupConstraints() {
-  vector<BoolVar> demons = CollectRoles(Time::Night(1), DemonRoles(script_));
+  if (skip_setup_catalog_ && !setup_table_) {
+    AddRoleCountConstraints();
+    return;
+  }
+  // The base model templates are shared by the games of a setup, so they only
+  // have the legal setups of all the roles (see AddSetupCatalogFixings).
+  RoleSet possible = MakeRoleSet(AllRoles(script_)), required = 0;
+  if (base_model_key_.empty()) {
+    PossibleStartingRoles(&possible, &required);
+  }
+  vector<Role> undecided_roles;
+  const vector<RoleSet> setups =
+      FixSetupCatalogRoles(possible, required, &undecided_roles);
+  if (setups.empty()) {
+    return;
+  }
+  if (setup_table_) {
+    Literals undecided;
+    for (Role role : undecided_roles) {
+      undecided.push_back(RoleInPlayVar(role));
+    }
+    // Replaces the Minion, Outsider and Townsfolk counts.
+    model_.AddEqualitySum(CollectRoles(Time::Night(1), DemonRoles(script_)), 1);
+    vector<vector<int64_t>> tuples;
+    for (RoleSet setup : setups) {
+      vector<int64_t>& tuple = tuples.emplace_back();
+      for (Role role : undecided_roles) {
+        tuple.push_back(HasRole(setup, role));
+      }
+    }
+    model_.AddAllowedAssignments(undecided, tuples);
+    return;
+  }
+  AddRoleCountConstraints();
+}
+
+void GameSatSolver::AddSetupCatalogFixings() {
+  if (skip_setup_catalog_ && !setup_table_) {
+    return;
+  }
+  RoleSet possible, required;
+  PossibleStartingRoles(&possible, &required);
+  vector<Role> undecided_roles;
+  FixSetupCatalogRoles(possible, required, &undecided_roles);
+}
+
+void GameSatSolver::PossibleStartingRoles(RoleSet* possible,
+                                          RoleSet* required) const {
+  *possible = 0;
+  *required = 0;
+  for (int i = 0; i < g_.NumPlayers(); ++i) {
+    const RoleSet player_roles =
+        claimable_roles_[i] & g_.PossibleRoles(i, Time::Night(1));
+    *possible |= player_roles;
+    if (NumRoles(player_roles) == 1) {
+      *required |= player_roles;
+    }
+  }
+}
+
+vector<RoleSet> GameSatSolver::FixSetupCatalogRoles(
+    RoleSet possible, RoleSet required, vector<Role>* undecided_roles) {
+  // The legal setups that only have roles some player may have, and that have
+  // the roles some player must have.
+  const vector<RoleSet> setups = SetupCatalog::Get(script_).FilterSetups(
+      g_.NumPlayers(), required, ~possible);
+  if (setups.empty()) {
+    model_.AddContradiction("no legal setup of the possible roles");
+    return setups;
+  }
+  RoleSet in_all = ~RoleSet{0}, in_any = 0;
+  for (RoleSet setup : setups) {
+    in_all &= setup;
+    in_any |= setup;
+  }
+  // The roles in play or not in play in all the legal setups are fixed. The
+  // Demon is in every setup, and is counted separately.
+  for (Role role : AllRoles(script_)) {
+    if (!HasRole(possible, role) || IsDemonRole(role)) {
+      continue;
+    }
+    if (!HasRole(in_any, role)) {
+      model_.FixVariable(RoleInPlayVar(role), false);
+    } else if (HasRole(in_all, role)) {
+      model_.FixVariable(RoleInPlayVar(role), true);
+    } else {
+      undecided_roles->push_back(role);
+    }
+  }
+  return setups;
+}
+
+void GameSatSolver::AddRoleCountConstraints() {
+  Literals demons = CollectRoles(Time::Night(1), DemonRoles(script_));
   model_.AddEqualitySum(demons, 1);
-  vector<BoolVar> minions = CollectRoles(Time::Night(1), MinionRoles(script_));
+  Literals minions = CollectRoles(Time::Night(1), MinionRoles(script_));
   model_.AddEqualitySum(minions, g_.NumMinions());
   const BoolVar& baron_in_play = RoleInPlayVar(BARON);
-  vector<BoolVar> outsiders = CollectRoles(
+  Literals outsiders = CollectRoles(
       Time::Night(1), OutsiderRoles(script_));
-  vector<BoolVar> townsfolk = CollectRoles(
+  Literals townsfolk = CollectRoles(
       Time::Night(1), TownsfolkRoles(script_));
   model_.AddImplicationSum(Not(baron_in_play), outsiders, g_.NumOutsiders());
   model_.AddImplicationSum(baron_in_play, outsiders, g_.NumOutsiders() + 2);
   model_.AddImplicationSum(Not(baron_in_play), townsfolk, g_.NumTownsfolk());
   model_.AddImplicationSum(baron_in_play, townsfolk, g_.NumTownsfolk() - 2);
-  for (Time time = Time::Night(1); time <= g_.CurrentTime(); ++time) {
+}
+
+void GameSatSolver::AddRoleSetupConstraints(const Time& time) {
+  for (Role role : AllRoles(script_)) {
+    // Each role other than IMP assigned to at most one player at a time:
+    if (role != IMP) {
+      model_.AddAtMostOne(CollectRoles(time, {role}));
+    }
+  }
+  if (integer_roles_) {
+    return;  // See AddRoleDomainConstraints.
+  }
+  for (int i = 0; i < g_.NumPlayers(); ++i) {
+    // Each player assigned exactly one role at a time:
+    model_.AddEqualitySum(
+        CollectRolesForPlayer(time, i, AllRoles(script_), false), 1);
+  }
+}
+
+void GameSatSolver::AddRoleDomainConstraints() {
+  for (int i = 0; i < g_.NumPlayers(); ++i) {
+    // The solutions are read from the starting and the current roles, so
+    // their role variables must be channeled as well.
     for (Role role : AllRoles(script_)) {
-      // Each role other than IMP assigned to at most one player at a time:
-      if (role != IMP) {
-        model_.AddAtMostOne(CollectRoles(time, {role}));
+      for (const Time& time : {Time::Night(1), g_.CurrentTime()}) {
+        if (HasRoleVar(i, role, time)) {
+          RoleVar(i, role, time);
+        }
       }
     }
-    for (int i = 0; i < g_.NumPlayers(); ++i) {
-      if (g_.GetPerspective() == STORYTELLER) {
-        // Fix all the roles to the actual roles.
-        for (Role role : AllRoles(script_)) {
-          model_.AddEquality(
-              RoleVar(i, role, time), role == g_.GetRole(i, time));
+    // A new integer variable is only needed when a role variable changes.
+    vector<int> prev_var_times;
+    for (Time time = Time::Night(1); time <= g_.CurrentTime(); ++time) {
+      vector<int64_t> roles;
+      vector<int> var_times;
+      for (Role role : AllRoles(script_)) {
+        const bool possible = HasRoleVar(i, role, time);
+        if (possible) {
+          roles.push_back(role);
+        }
+        var_times.push_back(possible ? RoleVarTime(i, role, time) : -1);
+      }
+      if (var_times == prev_var_times) {
+        continue;
+      }
+      prev_var_times = var_times;
+      if (roles.empty()) {
+        model_.AddContradiction(absl::StrFormat(
+            "%s has no possible role on %s", g_.PlayerName(i), time));
+        continue;
+      }
+      const IntVar x = model_.NewIntVar(
+          roles, absl::StrFormat("roles_%s_%s", g_.PlayerName(i), time));
+      for (int64_t role : roles) {
+        // Only the role variables referenced by the constraints exist.
+        const BoolVar* v = model_.FindFamilyVar(
+            role_family_, {i, static_cast<int>(role),
+                           RoleVarTime(i, Role(role), time)});
+        if (v != nullptr) {
+          model_.AddEquivalenceIntEq(*v, x, role);
         }
       }
-      // Each player assigned exactly one role at a time:
-      model_.AddEqualitySum(
-          CollectRolesForPlayer(time, i, AllRoles(script_), false), 1);
     }
-    AddRolePropagationConstraints(time);
   }
-  AddDemonInfoConstraints();
-  AddMinionInfoConstraints();
+}
+
+void GameSatSolver::AddStorytellerRoleConstraints(const Time& time) {
+  if (g_.GetPerspective() != STORYTELLER) {
+    return;
+  }
+  // Fix all the roles to the actual roles.
+  for (int i = 0; i < g_.NumPlayers(); ++i) {
+    for (Role role : AllRoles(script_)) {
+      model_.AddEquality(RoleVar(i, role, time), role == g_.GetRole(i, time));
+    }
+  }
 }
 
 void GameSatSolver::AddRolePropagationConstraints(const Time& time) {
@@ -534,7 +1189,8 @@ void GameSatSolver::AddPresolveRedHerringConstraints() {
     if (g_.GetPerspective() == STORYTELLER) {
       model_.AddEquality(RedHerringVar(i), g_.RedHerring() == i);
     }
-    const BoolVar* red_herring_i = model_.FindVar(RedHerringVarName(i));
+    const BoolVar* red_herring_i = model_.FindFamilyVar(red_herring_family_,
+                                                        {i});
     if (red_herring_i == nullptr) {
       remaining_good.push_back(Not(StartingEvilVar(i)));
       continue;
@@ -554,7 +1210,7 @@ void GameSatSolver::AddPresolveRedHerringConstraints() {
   } else if (g_.NumPlayers() - red_herring.size() <= 1 + g_.NumMinions()) {
     // If FT is in play and no red herring among the existing variables, one of
     // the remaining ones must be the red herring and therefore be Good.
-    vector<BoolVar> other(Not(red_herring));
+    Literals other = Not(red_herring);
     other.push_back(ft_in_play);
     BoolVar v = model_.NewEquivalentVarAnd(other, "red_herring_other");
     model_.AddImplicationOr(v, remaining_good);
@@ -563,15 +1219,11 @@ void GameSatSolver::AddPresolveRedHerringConstraints() {
 
 void GameSatSolver::AddPresolvePoisonerConstraints() {
   for (Time time = Time::Night(1); time <= g_.CurrentTime(); time += 2) {
+    // Requests may assume that any player was poisoned on any night, so the
+    // picks of all players are created here, to be constrained as well.
     vector<BoolVar> poisoner_picks;
     for (int i = 0; i < g_.NumPlayers(); ++i) {
-      const BoolVar* pick = model_.FindVar(PoisonerPickVarName(i, time));
-      if (pick != nullptr) {
-        poisoner_picks.push_back(*pick);
-      }
-    }
-    if (poisoner_picks.empty()) {
-      continue;
+      poisoner_picks.push_back(PoisonerPickVar(i, time));
     }
     model_.AddAtMostOne(poisoner_picks);
     model_.AddImplicationAnd(
@@ -596,13 +1248,13 @@ void GameSatSolver::AddNoVictoryConstraints(const Time& time) {
     for (int mayor : AliveRolePossibilities(MAYOR, time)) {
       cases.push_back(model_.NewEquivalentVarOr(
           {Not(RoleVar(mayor, MAYOR, time)), PoisonedVar(mayor, time)},
-          absl::StrFormat("not_healthy_mayor_%s_%s", g_.PlayerName(mayor),
-                          time)));
+          VarName("not_healthy_mayor_%s_%s", g_.PlayerName(mayor),
+                  time)));
     }
   }
   BoolVar sw_alive = model_.NewEquivalentVarOr(
       CollectAliveRoles(time, {SCARLET_WOMAN}),
-      absl::StrFormat("sw_alive_%s", time));
+      VarName("sw_alive_%s", time));
   for (int death : g_.Deaths(time)) {
     --num_alive;
     // Did not kill the demon, or a possible Scarlet Woman proc.
@@ -611,8 +1263,8 @@ void GameSatSolver::AddNoVictoryConstraints(const Time& time) {
       demon_kill_cases.push_back(sw_alive);
     }
     cases.push_back(model_.NewEquivalentVarOr(
-        demon_kill_cases, absl::StrFormat("not_imp_%s_killed_no_sw_save_%s",
-                                          g_.PlayerName(death), time)));
+        demon_kill_cases, VarName("not_imp_%s_killed_no_sw_save_%s",
+                                  g_.PlayerName(death), time)));
   }
   model_.AddAnd(cases);
   // Did not execute a healthy Saint.
@@ -632,18 +1284,18 @@ void GameSatSolver::AddGoodWonConstraints() {
     for (int mayor : AliveRolePossibilities(MAYOR, time)) {
       cases.push_back(model_.NewEquivalentVarAnd(
           {RoleVar(mayor, MAYOR, time), Not(PoisonedVar(mayor, time))},
-          absl::StrFormat("healthy_mayor_%s_%s", g_.PlayerName(mayor), time)));
+          VarName("healthy_mayor_%s_%s", g_.PlayerName(mayor), time)));
     }
   }
   // Imp commited suicide and no starpass catch.
   cases.push_back(
       model_.NewEquivalentVarAnd(
           Not(CollectRoles(time, {IMP}, true)),
-          absl::StrFormat("imp_suicide_evil_lose_%s", time)));
+          VarName("imp_suicide_evil_lose_%s", time)));
   int num_alive = g_.NumAlive(time);
   BoolVar sw_alive = model_.NewEquivalentVarOr(
       CollectAliveRoles(time, {SCARLET_WOMAN}),
-      absl::StrFormat("sw_alive_%s", time));
+      VarName("sw_alive_%s", time));
   for (int death : g_.Deaths(time)) {
     // Killed the demon and no possible Scarlet Woman proc.
     vector<BoolVar> demon_kill_cases({RoleVar(death, IMP, time)});
@@ -651,7 +1303,7 @@ void GameSatSolver::AddGoodWonConstraints() {
       demon_kill_cases.push_back(Not(sw_alive));
     }
     cases.push_back(model_.NewEquivalentVarAnd(
-        demon_kill_cases, absl::StrFormat(
+        demon_kill_cases, VarName(
             "imp_%s_killed_on_%d_no_sw_save_%s",
             g_.PlayerName(death), num_alive, time)));
     --num_alive;
@@ -753,6 +1405,7 @@ void GameSatSolver::AddLearningRoleInfoConstraints(Role role) {
   }
   for (const auto& actions : it->second) {
     for (const auto* ra : actions) {
+      TagConstraints("AddLearningRoleInfoConstraints", *ra);
       AddLearningRoleInfoConstraints(*ra);
     }
   }
@@ -763,10 +1416,11 @@ void GameSatSolver::AddLearningRoleInfoConstraints(
   // Supports all info roles that learn that one of k players is one of
   // n roles (in TB, they are: Washerwoman, Librarian, Investigator, Undertaker,
   // and Ravenkeeper).
-  /* TODO(olaola): add this back when I figure out why is it so much worse!!
-  if (!IsRolePossible(ra.player, ra.acting, ra.time)) {
+  // Much slower on some games, see AddChefConstraints.
+  if (skip_impossible_info_claims_ &&
+      !IsRolePossible(ra.player, ra.acting, ra.time)) {
     return;  // We know it's a bluff.
-  }*/
+  }
   vector<BoolVar> cases;
   cases.push_back(Not(RoleVar(ra.player, ra.acting, ra.time)));
   cases.push_back(PoisonedVar(ra.player, ra.time));
@@ -777,8 +1431,8 @@ void GameSatSolver::AddLearningRoleInfoConstraints(
       outsiders.push_back(Not(RoleInPlayVar(role)));
     }
     cases.push_back(model_.NewEquivalentVarAnd(
-        outsiders, absl::StrFormat("%s_LIBRARIAN_no_outsiders",
-                                   g_.PlayerName(ra.player))));
+        outsiders, VarName("%s_LIBRARIAN_no_outsiders",
+                           g_.PlayerName(ra.player))));
   } else {
     for (Role role : ra.roles) {
       const Role false_trigger = IsGoodRole(role) ? SPY : RECLUSE;
@@ -792,34 +1446,43 @@ void GameSatSolver::AddLearningRoleInfoConstraints(
             ping_false :
             model_.NewEquivalentVarAnd(
                 {ping_false, Not(PoisonedVar(ping, ra.time))},
-                absl::StrFormat("%s_ping_%s_healthy_%s", Role_Name(ra.acting),
-                                g_.PlayerName(ping),
-                                Role_Name(false_trigger))));
+                VarName("%s_ping_%s_healthy_%s", Role_Name(ra.acting),
+                        g_.PlayerName(ping),
+                        Role_Name(false_trigger))));
       }
     }
   }
   model_.AddOr(cases);
 }
 
+void GameSatSolver::AddKnownShownTokenConstraints() {
+  // Register the roles that were shown night 1.
+  for (int i = 0; i < g_.NumPlayers(); ++i) {
+    const Role shown = g_.ShownToken(i, Time::Night(1));
+    if (shown != ROLE_UNSPECIFIED) {
+      model_.AddEquality(ShownTokenVar(i, shown), true);
+    }
+  }
+}
+
 void GameSatSolver::AddShownTokenConstraints() {
+  const auto non_drunk_roles = FilterRoles(
+      script_, [](Role r) { return r != DRUNK; });
+  const auto non_townsfolk_roles = FilterRoles(
+      script_, [](Role r) { return r != DRUNK && !IsTownsfolkRole(r); });
   for (int i = 0; i < g_.NumPlayers(); ++i) {
-    vector<BoolVar> shown_token;
-    for (Role role : FilterRoles(script_, [](Role r) { return r != DRUNK; })) {
+    Literals shown_token;
+    for (Role role : non_drunk_roles) {
       shown_token.push_back(ShownTokenVar(i, role));
     }
     // Every player was shown exactly one non-DRUNK token:
     model_.AddEqualitySum(shown_token, 1);
     // Nobody can be shown the Drunk token:
     model_.AddEquality(ShownTokenVar(i, DRUNK), false);
-    // Register the roles that were shown night 1.
-    Role shown = g_.ShownToken(i, Time::Night(1));
-    if (shown != ROLE_UNSPECIFIED) {
-      model_.AddEquality(ShownTokenVar(i, shown), true);
-    }
   }
   // All shown tokens are unique:
   for (Role role : AllRoles(script_)) {
-    vector<BoolVar> shown_role;
+    Literals shown_role;
     for (int i = 0; i < g_.NumPlayers(); ++i) {
       shown_role.push_back(ShownTokenVar(i, role));
     }
@@ -838,8 +1501,6 @@ void GameSatSolver::AddShownTokenConstraints() {
                     Not(RoleInPlayVar(role))});
     }
     // Being shown any other role means you are that role.
-    const auto non_townsfolk_roles = FilterRoles(
-        script_, [](Role r) { return r != DRUNK && !IsTownsfolkRole(r); });
     for (Role role : non_townsfolk_roles) {
       model_.AddEquality(
           ShownTokenVar(i, role), RoleVar(i, role, Time::Night(1)));
@@ -847,33 +1508,40 @@ void GameSatSolver::AddShownTokenConstraints() {
   }
 }
 
-void GameSatSolver::AddScarletWomanProcConstraints(const Time& time) {
+void GameSatSolver::ScarletWomanProcCandidates(
+    const Time& time, vector<int>* demon_candidates,
+    unordered_set<int>* sw_candidates) const {
   // The Scarlet Woman becoming Imp triggers if and only if, on time:
   // * SW is alive (we assume that the SW is never poisoned)
   // * The Demon died during the day (otherwise it's a starpass)
   // * There are >=4 alive players remaining (not counting the Demon)
-  vector<int> deaths = g_.Deaths(time);  // Chronological day deaths.
+  const PlayerList deaths = g_.Deaths(time);  // Chronological day deaths.
   // How many out of day deaths could cause an SW proc:
   const int num_candidates = g_.NumAlive(time) - 4;
-  vector<int> demon_candidates;  // Dead demon possibilities.
   for (int i = 0; i < num_candidates && i < deaths.size(); ++i) {
     const int c = deaths[i];
     if (g_.IsRolePossible(c, IMP, time)) {
-      demon_candidates.push_back(c);
+      demon_candidates->push_back(c);
     }
   }
-  if (demon_candidates.empty()) {
-    // Scarlet Woman cannot trigger, so no role changes.
-    PropagateAliveRoles(time, time + 1, AllRoles(script_));
+  if (demon_candidates->empty()) {
     return;
   }
-  unordered_set<int> sw_candidates;  // Alive SW possibilities.
   for (int i = 0; i < g_.NumPlayers(); ++i) {
     if (g_.IsAlive(i, time + 1) && g_.IsRolePossible(i, SCARLET_WOMAN, time)) {
-      sw_candidates.insert(i);
+      sw_candidates->insert(i);
     }
   }
-  if (sw_candidates.empty()) {
+  if (sw_candidates->empty()) {
+    demon_candidates->clear();
+  }
+}
+
+void GameSatSolver::AddScarletWomanProcConstraints(const Time& time) {
+  vector<int> demon_candidates;  // Dead demon possibilities.
+  unordered_set<int> sw_candidates;  // Alive SW possibilities.
+  ScarletWomanProcCandidates(time, &demon_candidates, &sw_candidates);
+  if (demon_candidates.empty()) {
     // Scarlet Woman cannot trigger, so no role changes.
     PropagateAliveRoles(time, time + 1, AllRoles(script_));
     return;
@@ -888,7 +1556,7 @@ void GameSatSolver::AddScarletWomanProcConstraints(const Time& time) {
     dead_demon_cases.push_back(RoleVar(i, IMP, time));
   }
   BoolVar imp_died = model_.NewEquivalentVarOr(
-      dead_demon_cases, absl::StrFormat("demon_died_%s", time));
+      dead_demon_cases, VarName("demon_died_%s", time));
   for (int i = 0; i < g_.NumPlayers(); ++i) {
     if (!g_.IsAlive(i, time)) {
       continue;
@@ -910,35 +1578,52 @@ void GameSatSolver::AddScarletWomanProcConstraints(const Time& time) {
   }
 }
 
-void GameSatSolver::AddImpStarpassConstraints(const Time& time) {
-  int dead_imp_candidate = kNoPlayer;
+void GameSatSolver::StarpassCandidates(
+    const Time& time, int* dead_imp_candidate, int* known_catch,
+    unordered_set<int>* catch_candidates) const {
+  *dead_imp_candidate = kNoPlayer;
+  *known_catch = kNoPlayer;
   for (int i : g_.Deaths(time)) {
     if (g_.IsRolePossible(i, IMP, time)) {
-      dead_imp_candidate = i;  // At most one night death in TB.
+      *dead_imp_candidate = i;  // At most one night death in TB.
     }
   }
-  if (dead_imp_candidate == kNoPlayer) {
-    // No possible starpass, all roles propagate.
-    PropagateAliveRoles(time, time + 1, AllRoles(script_));
+  if (*dead_imp_candidate == kNoPlayer) {
     return;
   }
-  unordered_set<int> starpass_catch_candidates;
   for (int i = 0; i < g_.NumPlayers(); ++i) {
     if (g_.ShownToken(i, time) == IMP && g_.ShownToken(i, time - 1) != IMP) {
       // We know there was a starpass, and we found who caught it.
-      for (int j = 0; j < g_.NumPlayers(); ++j) {
-        if (j != i && g_.IsAlive(j, time)) {
-          PropagateRolesForPlayer(j, time, time + 1, AllRoles(script_));
-        }
-      }
-      model_.AddEquality(RoleVar(dead_imp_candidate, IMP, time), true);
-      model_.AddEquality(RoleVar(i, IMP, time + 1), true);
+      *known_catch = i;
+      catch_candidates->clear();
       return;
     }
     if (g_.IsAlive(i, time + 1) && g_.IsRolePossible(i, IMP, time + 1)) {
-      starpass_catch_candidates.insert(i);
+      catch_candidates->insert(i);
     }
   }
+}
+
+void GameSatSolver::AddImpStarpassConstraints(const Time& time) {
+  int dead_imp_candidate, known_catch;
+  unordered_set<int> starpass_catch_candidates;
+  StarpassCandidates(time, &dead_imp_candidate, &known_catch,
+                     &starpass_catch_candidates);
+  if (dead_imp_candidate == kNoPlayer) {
+    // No possible starpass, all roles propagate.
+    PropagateAliveRoles(time, time + 1, AllRoles(script_));
+    return;
+  }
+  if (known_catch != kNoPlayer) {
+    for (int j = 0; j < g_.NumPlayers(); ++j) {
+      if (j != known_catch && g_.IsAlive(j, time)) {
+        PropagateRolesForPlayer(j, time, time + 1, AllRoles(script_));
+      }
+    }
+    model_.AddEquality(RoleVar(dead_imp_candidate, IMP, time), true);
+    model_.AddEquality(RoleVar(known_catch, IMP, time + 1), true);
+    return;
+  }
   if (starpass_catch_candidates.empty()) {
     // No possible starpass, all roles propagate.
     PropagateAliveRoles(time, time + 1, AllRoles(script_));
@@ -958,7 +1643,7 @@ void GameSatSolver::AddImpStarpassConstraints(const Time& time) {
     model_.AddImplication(night_imp_i, day_imp_i);
     BoolVar catch_i = model_.NewEquivalentVarAnd(
         {Not(night_imp_i), day_imp_i},
-        absl::StrFormat("%s_catches_starpass_%s", g_.PlayerName(i), time));
+        VarName("%s_catches_starpass_%s", g_.PlayerName(i), time));
     catch_cases.push_back(catch_i);
     if (g_.ShownToken(i, time) == IMP && g_.ShownToken(i, time - 1) != IMP) {
       model_.AddEquality(catch_i, true);
@@ -972,7 +1657,7 @@ void GameSatSolver::AddImpStarpassConstraints(const Time& time) {
     BoolVar healthy_recluse_i = role_claim == IMP ?
         model_.NewEquivalentVarAnd(
             {RoleVar(i, RECLUSE, time), Not(PoisonerPickVar(i, time))},
-            absl::StrFormat("healthy_recluse_%s_%s", g_.PlayerName(i), time)) :
+            VarName("healthy_recluse_%s_%s", g_.PlayerName(i), time)) :
         model_.FalseVar();
     for (Role role : {POISONER, SPY, SCARLET_WOMAN, BARON, RECLUSE}) {
       const BoolVar& night_role_i = RoleVar(i, role, time);
@@ -993,7 +1678,7 @@ void GameSatSolver::AddImpStarpassConstraints(const Time& time) {
   // starpass -> exactly one catches OR nobody was eligible:
   catch_cases.push_back(model_.NewEquivalentVarAnd(
       Not(eligible),
-      absl::StrFormat("nobody_eligible_for_starpass_catch_%s", time)));
+      VarName("nobody_eligible_for_starpass_catch_%s", time)));
   model_.AddImplicationSum(starpass, catch_cases, 1);
 }
 
@@ -1035,15 +1720,15 @@ void GameSatSolver::AddImpActionConstraints(const internal::RoleAction& ra) {
       cases.push_back(model_.NewEquivalentVarAnd(
           {RoleVar(target, SOLDIER, time),
            Not(PoisonerPickVar(target, time))},
-          absl::StrFormat("healthy_SOLDIER_%s_%s", g_.PlayerName(target),
-                          time)));
+          VarName("healthy_SOLDIER_%s_%s", g_.PlayerName(target),
+                  time)));
     }
     // Target was healthy Monk protected
     for (int monk : PossibleMonkProtecting(target, time)) {
       cases.push_back(model_.NewEquivalentVarAnd(
           {RoleVar(monk, MONK, time),
             Not(PoisonerPickVar(monk, time))},
-          absl::StrFormat("healthy_MONK_%s_%s", g_.PlayerName(monk), time)));
+          VarName("healthy_MONK_%s_%s", g_.PlayerName(monk), time)));
     }
     // Target was a healthy Mayor, not healthy Monk protected, and bounced to no
     // kill.
@@ -1053,8 +1738,8 @@ void GameSatSolver::AddImpActionConstraints(const internal::RoleAction& ra) {
       for (int monk : PossibleMonkProtecting(target, time)) {
         mayor_bounce_no_kill.push_back(model_.NewEquivalentVarOr(
             {Not(RoleVar(monk, MONK, time)), PoisonerPickVar(monk, time)},
-            absl::StrFormat("not_healthy_MONK_%s_%s", g_.PlayerName(monk),
-                            time)));
+            VarName("not_healthy_MONK_%s_%s", g_.PlayerName(monk),
+                    time)));
       }
       if (g_.NumAlive(time) == g_.NumPlayers()) {
         // No possible bounce to a dead player for no kill.
@@ -1064,23 +1749,23 @@ void GameSatSolver::AddImpActionConstraints(const internal::RoleAction& ra) {
           if (IsRolePossible(i, SOLDIER, time)) {
             no_kill_cases.push_back(model_.NewEquivalentVarAnd(
                 {RoleVar(i, SOLDIER, time), Not(PoisonerPickVar(i, time))},
-                absl::StrFormat("healthy_SOLDIER_%s_%s", g_.PlayerName(i),
-                                time)));
+                VarName("healthy_SOLDIER_%s_%s", g_.PlayerName(i),
+                        time)));
           }
           for (int monk : PossibleMonkProtecting(i, time)) {
             no_kill_cases.push_back(model_.NewEquivalentVarAnd(
                 {RoleVar(monk, MONK, time), Not(PoisonerPickVar(monk, time))},
-                absl::StrFormat("healthy_MONK_%s_%s", g_.PlayerName(monk),
-                                time)));
+                VarName("healthy_MONK_%s_%s", g_.PlayerName(monk),
+                        time)));
           }
         }
         mayor_bounce_no_kill.push_back(model_.NewEquivalentVarOr(
-            no_kill_cases, absl::StrFormat("mayor_%s_bounce_no_kill_cases_%s",
-                                           g_.PlayerName(target), time)));
+            no_kill_cases, VarName("mayor_%s_bounce_no_kill_cases_%s",
+                                   g_.PlayerName(target), time)));
       }
       cases.push_back(model_.NewEquivalentVarAnd(
-          mayor_bounce_no_kill, absl::StrFormat("mayor_%s_bounce_no_kill_%s",
-                                                g_.PlayerName(target), time)));
+          mayor_bounce_no_kill, VarName("mayor_%s_bounce_no_kill_%s",
+                                        g_.PlayerName(target), time)));
     }
     model_.AddOr(cases);
     return;
@@ -1111,15 +1796,19 @@ void GameSatSolver::AddImpConstraints(
     vector<const internal::RoleAction*> imp_action_claims) {
   // An Imp action overrides any claims.
   if (imp_action != nullptr) {
+    TagConstraints("AddImpActionConstraints", *imp_action);
     AddImpActionConstraints(*imp_action);
     return;
   }
   if (!imp_action_claims.empty()) {
     for (const auto* claim : imp_action_claims) {
+      TagConstraints("AddImpActionClaimConstraints", *claim);
       AddImpActionClaimConstraints(*claim);
     }
   }
-  vector<int> deaths = g_.Deaths(time);
+  model_.SetConstraintTag(
+      {.source = "AddImpConstraints", .role = IMP, .time = time.Index()});
+  const PlayerList deaths = g_.Deaths(time);
   if (!deaths.empty()) {
     const int imp_kill = deaths[0];
     // Target was not a healthy Soldier
@@ -1148,8 +1837,8 @@ void GameSatSolver::AddImpConstraints(
       cases.push_back(model_.NewEquivalentVarAnd(
           {RoleVar(i, role, time),
             Not(PoisonerPickVar(i, time))},
-          absl::StrFormat("healthy_%s_%s_%s", Role_Name(role),
-                          g_.PlayerName(i), time)));
+          VarName("healthy_%s_%s_%s", Role_Name(role),
+                  g_.PlayerName(i), time)));
     }
   }
   model_.AddOr(cases);
@@ -1182,26 +1871,32 @@ vector<int> GameSatSolver::PossibleMonkProtecting(
   return result;
 }
 
-vector<BoolVar> GameSatSolver::CollectRolesForPlayer(
-    const Time& time, int player,
-    absl::Span<const Role> roles, bool only_alive) {
-  vector<BoolVar> result;
+void GameSatSolver::AppendRolesForPlayer(const Time& time, int player,
+                                         absl::Span<const Role> roles,
+                                         bool only_alive, Literals* result) {
   if (!only_alive || g_.IsAlive(player, time)) {
     for (Role role : roles) {
-      result.push_back(RoleVar(player, role, time));
+      if (HasRoleVar(player, role, time)) {
+        result->push_back(RoleVar(player, role, time));
+      }
     }
   }
+}
+
+Literals GameSatSolver::CollectRolesForPlayer(const Time& time, int player,
+                                              absl::Span<const Role> roles,
+                                              bool only_alive) {
+  Literals result;
+  AppendRolesForPlayer(time, player, roles, only_alive, &result);
   return result;
 }
 
-vector<BoolVar> GameSatSolver::CollectRoles(const Time& time,
-                                            absl::Span<const Role> roles,
-                                            bool only_alive) {
-  vector<BoolVar> result;
+Literals GameSatSolver::CollectRoles(const Time& time,
+                                     absl::Span<const Role> roles,
+                                     bool only_alive) {
+  Literals result;
   for (int i = 0; i < g_.NumPlayers(); ++i) {
-    for (const auto& v : CollectRolesForPlayer(time, i, roles, only_alive)) {
-      result.push_back(v);
-    }
+    AppendRolesForPlayer(time, i, roles, only_alive, &result);
   }
   return result;
 }
@@ -1229,8 +1924,11 @@ void GameSatSolver::PropagateRolesForPlayer(int player,
                                             const Time& to,
                                             absl::Span<const Role> roles) {
   for (Role role : roles) {
-    model_.AddEquality(RoleVar(player, role, from),
-                       RoleVar(player, role, to));
+    const BoolVar from_var = RoleVar(player, role, from);
+    const BoolVar to_var = RoleVar(player, role, to);
+    if (from_var.index() != to_var.index()) {  // Otherwise, the same variable.
+      model_.AddEquality(from_var, to_var);
+    }
   }
 }
 
@@ -1308,50 +2006,143 @@ SolverRequestBuilder& SolverRequestBuilder::AddEvil(
   return *this;
 }
 
-vector<BoolVar> GameSatSolver::CollectAssumptionLiterals(
-    const SolverRequest::Assumptions& assumptions) {
+BoolVar GameSatSolver::FindRoleVar(int player, Role role,
+                                   const Time& time) const {
+  if (!HasRoleVar(player, role, time)) {
+    return false_literal_;
+  }
+  const BoolVar* v = model_.FindFamilyVar(
+      role_family_, {player, role, RoleVarTime(player, role, time)});
+  CHECK(v != nullptr) << "Role variable not read by requests";
+  return *v;
+}
+
+absl::StatusOr<vector<BoolVar>> GameSatSolver::CollectAssumptionLiterals(
+    const SolverRequest::Assumptions& assumptions) const {
   vector<BoolVar> assumption_literals;
   for (const auto& pr : assumptions.current_roles()) {
-    const auto& v = RoleVar(
+    const auto& v = FindRoleVar(
         g_.PlayerIndex(pr.player()), pr.role(), g_.CurrentTime());
     assumption_literals.push_back(pr.is_not() ? Not(v) : v);
   }
   for (const auto& pr : assumptions.starting_roles()) {
-    const auto& v = RoleVar(
+    const auto& v = FindRoleVar(
         g_.PlayerIndex(pr.player()), pr.role(), Time::Night(1));
     assumption_literals.push_back(pr.is_not() ? Not(v) : v);
   }
   for (int role : assumptions.roles_in_play()) {
-    assumption_literals.push_back(RoleInPlayVar(Role(role)));
+    assumption_literals.push_back(role_in_play_literals_[role]);
   }
   for (int role : assumptions.roles_not_in_play()) {
-    assumption_literals.push_back(Not(RoleInPlayVar(Role(role))));
+    assumption_literals.push_back(Not(role_in_play_literals_[role]));
   }
   for (const string& player : assumptions.is_evil()) {
-    assumption_literals.push_back(StartingEvilVar(g_.PlayerIndex(player)));
+    assumption_literals.push_back(
+        starting_evil_literals_[g_.PlayerIndex(player)]);
   }
   for (const string& player : assumptions.is_good()) {
-    assumption_literals.push_back(Not(StartingEvilVar(g_.PlayerIndex(player))));
+    assumption_literals.push_back(
+        Not(starting_evil_literals_[g_.PlayerIndex(player)]));
   }
   for (const auto& p : assumptions.poisoned_players()) {
     const int i = g_.PlayerIndex(p.player());
-    const Time time = Time::Night(p.night());
-    if (model_.FindVar(PoisonerPickVarName(i, time)) == nullptr && p.is_not()) {
-      continue;  // This assumption does not change anything.
+    const int night = p.night() - 1;
+    if (night < 0 || night >= poisoned_literals_.size()) {
+      return absl::InvalidArgumentError(absl::StrFormat(
+          "%s is assumed poisoned on night %d, but the game is on %s",
+          p.player(), p.night(), g_.CurrentTime()));
     }
-    BoolVar v = PoisonedVar(i, time);
+    const BoolVar& v = poisoned_literals_[night][i];
     assumption_literals.push_back(p.is_not() ? Not(v) : v);
   }
   return assumption_literals;
 }
 
-int GameSatSolver::SolutionAliveDemon(const CpSolverResponse& response) {
+vector<vector<BoolVar>> GameSatSolver::CollectDecisionStrategy(
+    const SolverRequest& request) const {
+  vector<vector<BoolVar>> stages;
+  if (request.default_search()) {
+    return stages;
+  }
+  vector<int> decision_strategy(request.decision_strategy().begin(),
+                                request.decision_strategy().end());
+  if (decision_strategy.empty()) {
+    decision_strategy = {SolverRequest::STARTING_DEMON,
+                         SolverRequest::STARTING_MINIONS};
+  }
+  const Time night1 = Time::Night(1);
+  auto starting_roles = [&](absl::Span<const Role> roles) {
+    vector<BoolVar> stage;
+    for (int i = 0; i < g_.NumPlayers(); ++i) {
+      for (Role role : roles) {
+        if (HasRoleVar(i, role, night1)) {
+          stage.push_back(FindRoleVar(i, role, night1));
+        }
+      }
+    }
+    return stage;
+  };
+  for (int decision_stage : decision_strategy) {
+    switch (decision_stage) {
+      case SolverRequest::STARTING_DEMON:
+        stages.push_back(starting_roles(DemonRoles(script_)));
+        break;
+      case SolverRequest::STARTING_MINIONS:
+        stages.push_back(starting_roles(MinionRoles(script_)));
+        break;
+      case SolverRequest::STARTING_MISREGISTERING_ROLES:
+        stages.push_back(starting_roles({DRUNK, RECLUSE, SPY}));
+        break;
+      case SolverRequest::POISONER_PICKS: {
+        vector<BoolVar> stage;
+        for (int night = 0; night < g_.CurrentTime().count; ++night) {
+          for (int i = 0; i < g_.NumPlayers(); ++i) {
+            const BoolVar* v =
+                model_.FindFamilyVar(poisoner_pick_family_, {i, night});
+            if (v != nullptr) {
+              stage.push_back(*v);
+            }
+          }
+        }
+        stages.push_back(stage);
+        break;
+      }
+      case SolverRequest::STARTING_ROLES:
+        stages.push_back(starting_roles(AllRoles(script_)));
+        break;
+      default:
+        break;
+    }
+  }
+  return stages;
+}
+
+absl::StatusOr<CpModelProto*> GameSatSolver::RequestModel(
+    const SolverRequest& request, bool preprocessed,
+    google::protobuf::Arena* arena) const {
+  const auto assumptions = CollectAssumptionLiterals(request.assumptions());
+  if (!assumptions.ok()) {
+    return assumptions.status();
+  }
+  CpModelProto* cp_model =
+      google::protobuf::Arena::CreateMessage<CpModelProto>(arena);
+  *cp_model = preprocessed && preprocessed_model_ != nullptr
+                  ? *preprocessed_model_ : model_.Model().Build();
+  ModelWrapper::SetAssumptions(*assumptions, cp_model);
+  ModelWrapper::SetDecisionStrategy(CollectDecisionStrategy(request),
+                                    cp_model);
+  return cp_model;
+}
+
+int GameSatSolver::SolutionAliveDemon(
+    const CpSolverResponse& response) const {
   for (int i = 0; i < g_.NumPlayers(); ++i) {
     if (!g_.IsAlive(i)) {
       continue;
     }
     for (Role role : DemonRoles(script_)) {
-      if (SolutionBooleanValue(response, RoleVar(i, role, g_.CurrentTime()))) {
+      if (SolutionBooleanValue(response,
+                               FindRoleVar(i, role, g_.CurrentTime()))) {
         return i;
       }
     }
@@ -1360,13 +2151,13 @@ int GameSatSolver::SolutionAliveDemon(const CpSolverResponse& response) {
 }
 
 void GameSatSolver::FillWorldFromSolverResponse(
-    const CpSolverResponse& response, SolverResponse::World* world) {
+    const CpSolverResponse& response, SolverResponse::World* world) const {
   auto* current_roles = world->mutable_current_roles();
   auto* starting_roles = world->mutable_starting_roles();
   const Time night1 = Time::Night(1), cur_time = g_.CurrentTime();
   for (int i = 0; i < g_.NumPlayers(); ++i) {
     for (Role role : AllRoles(script_)) {
-      if (SolutionBooleanValue(response, RoleVar(i, role, cur_time))) {
+      if (SolutionBooleanValue(response, FindRoleVar(i, role, cur_time))) {
         const string player = g_.PlayerName(i);
         const auto it = current_roles->find(player);
         CHECK(it == current_roles->end())
@@ -1374,7 +2165,8 @@ void GameSatSolver::FillWorldFromSolverResponse(
                                "found both %s and %s", player,
                               Role_Name(it->second), Role_Name(role));
         (*current_roles)[player] = role;
-      } else if (SolutionBooleanValue(response, RoleVar(i, role, night1))) {
+      } else if (SolutionBooleanValue(response,
+                                      FindRoleVar(i, role, night1))) {
         const string player = g_.PlayerName(i);
         CHECK(starting_roles->find(player) == starting_roles->end())
             << "Double starting role assignment for player " << player;
@@ -1388,17 +2180,45 @@ void GameSatSolver::FillWorldFromSolverResponse(
 
 SolverResponse GameSatSolver::Solve(const SolverRequest& request) {
   SolverResponse result;
-  // Making a copy to add assumptions.
-  const auto assumptions = CollectAssumptionLiterals(request.assumptions());
-  CpModelBuilder cp_model(model_.Model());
-  cp_model.AddBoolAnd(assumptions);
+  const absl::Status st = SolveInto(request, &result);
+  CHECK(st.ok()) << st;
+  return result;
+}
+
+absl::StatusOr<SolverResponse*> GameSatSolver::Solve(
+    const SolverRequest& request, google::protobuf::Arena* arena) {
+  SolverResponse* result =
+      google::protobuf::Arena::CreateMessage<SolverResponse>(arena);
+  const absl::Status st = SolveInto(request, result);
+  if (!st.ok()) {
+    return st;
+  }
+  return result;
+}
+
+absl::Status GameSatSolver::SolveInto(const SolverRequest& request,
+                                      SolverResponse* result) {
+  // The copy of the model made for this request lives on the arena.
+  google::protobuf::Arena arena;
   path tmp_dir = "./tmp";
   path solution_dir = tmp_dir / "solutions";
   const bool debug_mode = request.debug_mode();
+  // The request assumptions are passed as CP-SAT assumption literals, so that
+  // the model is not constrained by any request, and is preprocessed once.
+  const auto request_model = RequestModel(request, !debug_mode, &arena);
+  if (!request_model.ok()) {
+    return request_model.status();
+  }
+  CpModelProto* cp_model = *request_model;
   if (debug_mode) {
     // Create the ./tmp/solutions directory, if not present.
     create_directories(solution_dir);
-    WriteProtoToFile(cp_model.Build(), tmp_dir / "model.pbtxt");
+    CpModelProto* model_pb =
+        google::protobuf::Arena::CreateMessage<CpModelProto>(&arena);
+    *model_pb = *cp_model;
+    model_.NameVariables(model_pb);
+    NameConstraints(model_pb);
+    WriteProtoToFile(*model_pb, tmp_dir / "model.pbtxt");
   }
   CpSolverResponse response;
   map<string, int> num_worlds_per_demon;
@@ -1407,11 +2227,19 @@ SolverResponse GameSatSolver::Solve(const SolverRequest& request) {
   SatParameters parameters;
   parameters.set_enumerate_all_solutions(!request.stop_after_first_solution());
   parameters.set_symmetry_level(0);  // Empirically, this is faster.
+  if (!request.sat_parameters().empty()) {
+    SatParameters overrides;
+    CHECK(google::protobuf::TextFormat::ParseFromString(
+        request.sat_parameters(), &overrides))
+        << "Invalid SAT parameters: " << request.sat_parameters();
+    parameters.MergeFrom(overrides);
+  }
   // We only care about current (and starting?) role assignments, so add them
   // as key variables:
   for (int i = 0; i < g_.NumPlayers(); ++i) {
     for (Role role : AllRoles(script_)) {
-      parameters.add_key_variables(RoleVar(i, role, g_.CurrentTime()).index());
+      parameters.add_key_variables(
+          FindRoleVar(i, role, g_.CurrentTime()).index());
     }
   }
   model.Add(NewSatParameters(parameters));
@@ -1431,10 +2259,9 @@ SolverResponse GameSatSolver::Solve(const SolverRequest& request) {
       const path resp_filename = absl::StrFormat("resp_%d.pbtxt", solutions);
       WriteProtoToFile(r, solution_dir / resp_filename);
     }
-    SolverResponse::World cur_world;
-    FillWorldFromSolverResponse(r, &cur_world);
+    SolverResponse::World* cur_world = result->add_worlds();
+    FillWorldFromSolverResponse(r, cur_world);
     const int demon = SolutionAliveDemon(r);
-    *(result.add_worlds()) = cur_world;
     const string demon_name =
         demon == kNoPlayer ? "<Dead player>" : g_.PlayerName(demon);
     num_worlds_per_demon[demon_name]++;
@@ -1443,17 +2270,25 @@ SolverResponse GameSatSolver::Solve(const SolverRequest& request) {
       const path sat_filename = absl::StrFormat("sat_solution_%d", solutions);
       model_.WriteSatSolutionToFile(r, solution_dir / sat_filename);
       const path world_filename = absl::StrFormat("world_%d.pbtxt", solutions);
-      WriteProtoToFile(cur_world, solution_dir / world_filename);
+      WriteProtoToFile(*cur_world, solution_dir / world_filename);
     }
   }));
-  SolveCpModel(cp_model.Build(), &model);
+  SolveCpModel(*cp_model, &model);
   log_progress(true);
   for (const auto& it : num_worlds_per_demon) {
-    auto* ado = result.add_alive_demon_options();
+    auto* ado = result->add_alive_demon_options();
     ado->set_name(it.first);
     ado->set_count(it.second);
   }
-  return result;
+  return absl::OkStatus();
+}
+
+ModelOptions ModelOptionsForRequest(const SolverRequest& request) {
+  ModelOptions options = request.model_options();
+  if (request.debug_mode()) {
+    options.set_named_model(true);
+  }
+  return options;
 }
 
 // Solves the game and returns all valid worlds.
@@ -1461,7 +2296,7 @@ SolverResponse Solve(const GameState& g) {
   return GameSatSolver(g).Solve();
 }
 SolverResponse Solve(const GameState& g, const SolverRequest& request) {
-  return GameSatSolver(g).Solve(request);
+  return GameSatSolver(g, ModelOptionsForRequest(request)).Solve(request);
 }
 // Returns whether a valid world exists.
 bool IsValidWorld(const GameState& g) {
@@ -1469,7 +2304,8 @@ bool IsValidWorld(const GameState& g) {
 }
 // Returns whether a valid world exists given all assumptions in the request.
 bool IsValidWorld(const GameState& g, const SolverRequest& request) {
-  return GameSatSolver(g).IsValidWorld(request);
+  return GameSatSolver(g, ModelOptionsForRequest(request))
+      .IsValidWorld(request);
 }
 
 }  // namespace botc
@@ -15,17 +15,25 @@
 #define SRC_GAME_SAT_SOLVER_H_
 
 #include <algorithm>
+#include <cstdint>
 #include <filesystem>
+#include <functional>
 #include <iostream>
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
 #include "absl/strings/str_format.h"
+#include "google/protobuf/arena.h"
 #include "src/game_log.pb.h"
 #include "src/game_state.h"
+#include "src/model_preprocessor.h"
 #include "src/model_wrapper.h"
+#include "src/setup_catalog.h"
 #include "src/solver.pb.h"
 #include "ortools/sat/cp_model.h"
 
@@ -36,6 +44,7 @@ using operations_research::sat::CpModelBuilder;
 using operations_research::sat::BoolVar;
 using std::cout;
 using std::endl;
+using std::ostream;
 using std::filesystem::path;
 using std::string;
 using std::vector;
@@ -43,30 +52,79 @@ using std::map;
 using std::pair;
 using std::unordered_map;
 
-// Compiles a GameState into a SAT model and solves it.
+// Version of the SAT model compilation. Update on every change to the compiled
+// models, to invalidate the model caches.
+constexpr char kSolverVersion[] = "13";
+
+// Statistics of compiling a game into a SAT model, per compile phase (a part
+// of the model, or the constraints of a role).
+struct ModelStats {
+  struct Phase {
+    string name;
+    double wall_time = 0;  // In seconds.
+    // Added by the phase:
+    int variables = 0;
+    int constraints = 0;
+    int literals = 0;
+  };
+  vector<Phase> phases;
+};
+ostream& operator<<(ostream& os, const ModelStats& stats);
+
+// Compiles a GameState into a SAT model and solves it. The model is compiled
+// once, so reuse the solver to solve multiple requests on the same GameState:
+// request assumptions are passed to the SAT solver as assumption literals on a
+// copy of the model. Solving does not change the compiled model, so requests
+// may be solved concurrently.
 class GameSatSolver {
  public:
-  explicit GameSatSolver(const GameState& g) : g_(g), script_(g.GetScript()) {
-    CompileSatModel();
-  }
+  explicit GameSatSolver(const GameState& g)
+      : GameSatSolver(g, ModelOptions()) {}
+  GameSatSolver(const GameState& g, const ModelOptions& options);
   // Solves the game and returns all valid worlds.
   SolverResponse Solve() { return Solve(SolverRequest()); }
-  // Solves the game using options from the request.
+  // Solves the game using options from the request. Dies on an invalid
+  // request.
   SolverResponse Solve(const SolverRequest& request);
+  // Same, but the response and its worlds are allocated on the arena, and
+  // freed with it. Returns an error if the request assumptions are invalid.
+  absl::StatusOr<SolverResponse*> Solve(const SolverRequest& request,
+                                        google::protobuf::Arena* arena);
   // Returns whether a valid world exists.
   bool IsValidWorld() { return IsValidWorld(SolverRequest()); }
   // Returns whether a valid world exists given all assumptions in the request.
   bool IsValidWorld(const SolverRequest& request) {
     SolverRequest r = request;
     r.set_stop_after_first_solution(true);
-    return Solve(r).worlds_size() > 0;
-  }
-  void WriteModelToFile(const path& filename) const {
-    model_.WriteToFile(filename);
+    google::protobuf::Arena arena;
+    const auto response = Solve(r, &arena);
+    CHECK(response.ok()) << response.status();
+    return (*response)->worlds_size() > 0;
   }
+  // Writes the model with all variables named, and the constraints named by
+  // their tags.
+  void WriteModelToFile(const path& filename) const;
   void WriteModelVariablesToFile(const path& filename) const {
     model_.WriteVariablesToFile(filename);
   }
+  // Exports the model with the request assumptions, projected on the current
+  // roles, to <prefix>.cnf (DIMACS CNF), <prefix>.opb (OPB) and <prefix>.vars
+  // (the variable map), see model_export.h.
+  absl::Status ExportModel(const SolverRequest& request, const string& prefix);
+  const ModelWrapper& GetModel() const { return model_; }
+  const ModelStats& GetModelStats() const { return model_stats_; }
+  // The provenance of the model constraints: the compile phase, and the role,
+  // time and game log event of the claim or action that added them.
+  vector<ConstraintTagRange> GetConstraintTags() const {
+    return model_.GetConstraintTags();
+  }
+  CacheStats GetCacheStats(bool arity_histogram) const {
+    return model_.GetCacheStats(arity_histogram);
+  }
+  // Statistics of preprocessing the model, if enabled.
+  const PreprocessorStats& GetPreprocessorStats() const {
+    return preprocessor_stats_;
+  }
 
  private:
   typedef void (GameSatSolver::*AddRoleConstraints)();
@@ -98,7 +156,46 @@ class GameSatSolver {
     &GameSatSolver::AddImpConstraints,  // IMP
   };
 
+  void PreprocessGameState();
+  // Computes the roles every player may have given the claims (good players
+  // claim their starting role, or a townsfolk role if they are the Drunk).
+  void ComputeClaimableRoles();
+  // Computes the time steps of the role variables: a role variable is only
+  // created at the time steps where the role may change (see RoleChanges),
+  // and is reused until the next one.
+  void ComputeRoleVarTimes();
+  // Returns the bit mask of the roles of the player which may change from
+  // time to time + 1 (a Scarlet Woman proc or an Imp starpass).
+  uint64_t RoleChanges(int player, const Time& time) const;
   void CompileSatModel();
+  // Model cache key of the game, see ModelOptions.model_cache_dir.
+  uint64_t ModelFingerprint(const ModelOptions& options) const;
+  // Returns whether the model was loaded from the cache.
+  bool LoadSatModel(const path& filename, uint64_t fingerprint);
+  void StoreSatModel(const path& filename, uint64_t fingerprint) const;
+  // Adds the literals of the request assumptions that are not role variables
+  // to the model, so that solving a request only reads the model.
+  void AddRequestLiterals();
+  // Saves the request literals to the compiled model, or restores them.
+  void StoreRequestLiterals(CompiledModel* compiled) const;
+  void LoadRequestLiterals(const CompiledModel& compiled);
+  // Preprocesses the compiled model once for all requests, keeping the
+  // variables that requests read.
+  void PreprocessSatModel();
+  // Template cache key of the game, see
+  // ModelOptions.use_base_model_templates.
+  string BaseModelKey(const ModelOptions& options) const;
+  // Copies the base model of the game into the model_ from the template cache,
+  // compiling and storing it on a cache miss.
+  void AddBaseModel();
+  // Runs a part of the compilation, recording its ModelStats.
+  void CompilePhase(const string& name, const std::function<void()>& compile);
+  // Tags the constraints added from now on with the source and the role
+  // action.
+  void TagConstraints(const string& source, const internal::RoleAction& ra);
+  // Names the unnamed constraints of a copy of the model by their tags.
+  void NameConstraints(CpModelProto* model) const;
+  void NewVarFamilies();
 
   // Compiling role constraints.
   void Noop() {}  // Already covered by other methods.
@@ -119,7 +216,28 @@ class GameSatSolver {
 
   // Helper functions.
   void AddRoleSetupConstraints();
+  // With the base model templates, fixes the roles in play (or not in play)
+  // in all the legal setups of the roles the players of this game may have.
+  void AddSetupCatalogFixings();
+  // The roles some player may start with, and the roles some player must
+  // start with, given the game state and the claims.
+  void PossibleStartingRoles(RoleSet* possible, RoleSet* required) const;
+  // Returns the legal setups of the setup catalog that only have possible
+  // roles and have all the required roles, and fixes the roles in play (or
+  // not in play) in all of them. The other possible roles, except the Demon,
+  // are undecided.
+  vector<RoleSet> FixSetupCatalogRoles(RoleSet possible, RoleSet required,
+                                       vector<Role>* undecided_roles);
+  // The Demon, Minion, Outsider and Townsfolk counts of the ROLE_COUNTS
+  // encoding.
+  void AddRoleCountConstraints();
+  void AddRoleSetupConstraints(const Time& time);
+  // With the integer role encoding, channels the role variables of every
+  // player and time step to an integer variable over the possible roles.
+  void AddRoleDomainConstraints();
+  void AddStorytellerRoleConstraints(const Time& time);
   void AddShownTokenConstraints();
+  void AddKnownShownTokenConstraints();
   void AddRoleClaimsConstraints();
   void AddChefConstraints(int chef, int chef_number);
   void AddEmpathConstraints(int player, int number, const Time& time);
@@ -130,6 +248,18 @@ class GameSatSolver {
   void AddRolePropagationConstraints(const Time& time);
   void AddScarletWomanProcConstraints(const Time& time);
   void AddImpStarpassConstraints(const Time& time);
+  // The possible Scarlet Woman procs on a day: the day deaths that may have
+  // been the Imp, and the alive players that may have been the Scarlet Woman.
+  // Both are empty if the Scarlet Woman cannot proc.
+  void ScarletWomanProcCandidates(const Time& time,
+                                  vector<int>* demon_candidates,
+                                  unordered_set<int>* sw_candidates) const;
+  // The possible Imp starpass on a night: the night death that may have been
+  // the Imp (or kNoPlayer), and the player who was shown the Imp token if
+  // known, otherwise the alive players who may catch the starpass.
+  void StarpassCandidates(const Time& time, int* dead_imp_candidate,
+                          int* known_catch,
+                          unordered_set<int>* catch_candidates) const;
   void AddImpConstraints(const Time& time,
                          const internal::RoleAction* imp_action,
                          vector<const internal::RoleAction*> imp_action_claims);
@@ -158,20 +288,21 @@ class GameSatSolver {
     return !AliveRolePossibilities(role, Time::Night(1)).empty();
   }
   vector<int> PossibleMonkProtecting(int target, const Time& time) const;
-  vector<BoolVar> CollectRolesForPlayer(
-      const Time& time, int player,
-      absl::Span<const Role> roles, bool only_alive);
-  vector<BoolVar> CollectRoles(const Time& time,
-                               absl::Span<const Role> roles,
-                               bool only_alive);
-  vector<BoolVar> CollectRoles(const Time& time,
-                               absl::Span<const Role> roles) {
+  Literals CollectRolesForPlayer(const Time& time, int player,
+                                 absl::Span<const Role> roles,
+                                 bool only_alive);
+  Literals CollectRoles(const Time& time, absl::Span<const Role> roles,
+                        bool only_alive);
+  Literals CollectRoles(const Time& time, absl::Span<const Role> roles) {
     return CollectRoles(time, roles, false);
   }
-  vector<BoolVar> CollectAliveRoles(const Time& time,
-                                    absl::Span<const Role> roles) {
+  Literals CollectAliveRoles(const Time& time, absl::Span<const Role> roles) {
     return CollectRoles(time, roles, true);
   }
+  // Appends the role variables of the player to the result.
+  void AppendRolesForPlayer(const Time& time, int player,
+                            absl::Span<const Role> roles, bool only_alive,
+                            Literals* result);
   void PropagateAliveRoles(const Time& from, const Time& to,
                            absl::Span<const Role> roles);
   void PropagateDeadRoles(const Time& from, const Time& to);
@@ -179,37 +310,65 @@ class GameSatSolver {
                                absl::Span<const Role> roles);
   // SAT variable accessors (cached by the model_).
   BoolVar AliveRoleVar(Role role, const Time& from);
-  string RedHerringVarName(int player) const {
-    return absl::StrFormat("red_herring_%s", g_.PlayerName(player));
-  }
   BoolVar RedHerringVar(int player) {
-    return model_.NewVar(RedHerringVarName(player));
+    return model_.FamilyVar(red_herring_family_, {player});
+  }
+  // False iff the role variable is the constant false, because the player
+  // cannot have the role at that time (see ComputeClaimableRoles and
+  // GameState::PossibleRoles).
+  bool HasRoleVar(int player, Role role, const Time& time) const {
+    return dense_role_vars_ ||
+           ((claimable_roles_[player] & g_.PossibleRoles(player, time)) >>
+            role) & 1;
+  }
+  // The time index of the role variable (see ComputeRoleVarTimes).
+  int RoleVarTime(int player, Role role, const Time& time) const {
+    return role_var_times_.empty() ?
+        time.Index() : role_var_times_[player][time.Index()][role];
   }
   BoolVar RoleVar(int player, Role role, const Time& time) {
-    return model_.NewVar(absl::StrFormat("role_%s_%s_%s", g_.PlayerName(player),
-                                         Role_Name(role), time));
+    if (!HasRoleVar(player, role, time)) {
+      return model_.FalseVar();
+    }
+    return model_.FamilyVar(role_family_,
+                            {player, role, RoleVarTime(player, role, time)});
   }
   BoolVar RoleInPlayVar(Role role);
   BoolVar StartingEvilVar(int player);
   BoolVar ShownTokenVar(int player, Role role) {  // Night 1 only.
-    return model_.NewVar(absl::StrFormat(
-      "shown_token_%s_%s", g_.PlayerName(player), Role_Name(role)));
-  }
-  string PoisonerPickVarName(int player, const Time& time) const {
-    return absl::StrFormat(
-        "poisoner_pick_%s_night_%d", g_.PlayerName(player), time.count);
+    return model_.FamilyVar(shown_token_family_, {player, role});
   }
   BoolVar PoisonerPickVar(int player, const Time& time) {
-    return model_.NewVar(PoisonerPickVarName(player, time));
+    return model_.FamilyVar(poisoner_pick_family_, {player, time.count - 1});
   }
   // Poisoner picked and the poisoner is alive.
   BoolVar PoisonedVar(int player, const Time& time);
 
-  vector<BoolVar> CollectAssumptionLiterals(
-      const SolverRequest::Assumptions& assumptions);
+  // Formats the name of a derived variable. Names are only used by named
+  // models, so they are not formatted otherwise.
+  template <typename... Args>
+  string VarName(const absl::FormatSpec<Args...>& format,
+                 const Args&... args) const {
+    return model_.Named() ? absl::StrFormat(format, args...) : string();
+  }
+
+  absl::Status SolveInto(const SolverRequest& request, SolverResponse* result);
+  // The role variable read by a request, or the constant false. Unlike
+  // RoleVar, it does not change the model_.
+  BoolVar FindRoleVar(int player, Role role, const Time& time) const;
+  absl::StatusOr<vector<BoolVar>> CollectAssumptionLiterals(
+      const SolverRequest::Assumptions& assumptions) const;
+  // Returns the variables of every stage of the request decision strategy.
+  vector<vector<BoolVar>> CollectDecisionStrategy(
+      const SolverRequest& request) const;
+  // Returns a copy of the model to solve the request on, with the request
+  // assumptions and decision strategy.
+  absl::StatusOr<CpModelProto*> RequestModel(
+      const SolverRequest& request, bool preprocessed,
+      google::protobuf::Arena* arena) const;
   void FillWorldFromSolverResponse(const CpSolverResponse& response,
-                                   SolverResponse::World* world);
-  int SolutionAliveDemon(const CpSolverResponse& response);
+                                   SolverResponse::World* world) const;
+  int SolutionAliveDemon(const CpSolverResponse& response) const;
 
   const GameState& g_;  // Current game state.
   const Script script_;  // Part of g_, replicated for convenience.
@@ -218,7 +377,36 @@ class GameSatSolver {
   unordered_map<Role, vector<vector<const internal::RoleAction*>>>
       role_action_claims_;
   vector<Role> starting_role_claims_;
+  // Bit masks of the roles the claims allow, x player.
+  vector<uint64_t> claimable_roles_;
+  // Whether a role variable is created for every player, role and time step.
+  bool dense_role_vars_;
+  // The time index of the role variable, x player, time index, role. Empty if
+  // a role variable is created for every player, role and time step.
+  vector<vector<vector<int>>> role_var_times_;
   ModelWrapper model_;  // SAT model (caches all SAT variables).
+  // Variable families of the model_, see ModelWrapper::NewVarFamily.
+  int role_family_;  // x player, role, time index
+  int shown_token_family_;  // x player, role
+  int poisoner_pick_family_;  // x player, night
+  int red_herring_family_;  // x player
+  ModelStats model_stats_;
+  bool preprocess_model_;
+  bool integer_roles_;  // The INTEGER_ROLES encoding.
+  bool skip_impossible_info_claims_;  // SKIP_IMPOSSIBLE_INFO_CLAIMS variant.
+  bool setup_table_;  // The SETUP_TABLE encoding.
+  bool skip_setup_catalog_;  // The SKIP_SETUP_CATALOG variant.
+  unordered_set<string> disabled_phases_;
+  // Empty if base model templates are not used.
+  string base_model_key_;
+  // The literals of the request assumptions, see AddRequestLiterals.
+  BoolVar false_literal_;
+  vector<BoolVar> role_in_play_literals_;  // x role
+  vector<BoolVar> starting_evil_literals_;  // x player
+  vector<vector<BoolVar>> poisoned_literals_;  // x night - 1, player
+  // Null if the model is not preprocessed.
+  std::unique_ptr<const CpModelProto> preprocessed_model_;
+  PreprocessorStats preprocessor_stats_;
 };
 
 // Syntactic sugar for simplifying creating SolverRequests.
@@ -289,6 +477,8 @@ class SolverRequestBuilder {
   SolverRequest request_;
 };
 
+// Returns the options for compiling the game for the request.
+ModelOptions ModelOptionsForRequest(const SolverRequest& request);
 // Solves the game and returns all valid worlds.
 SolverResponse Solve(const GameState& g);
 // Solves the game using options from the request.
@@ -12,7 +12,9 @@
 // limitations under the License.
 
 #include <filesystem>
+#include <fstream>
 #include <map>
+#include <sstream>
 
 #include "src/game_sat_solver.h"
 #include "src/game_state.h"
@@ -52,6 +54,83 @@ vector<unordered_map<string, Role>> CopyWorlds(const SolverResponse& r) {
 #define EXPECT_WORLDS_EQ(r, w) \
     EXPECT_THAT(CopyWorlds(r), testing::UnorderedElementsAreArray(w))
 
+map<string, int> AliveDemonCounts(const SolverResponse& r) {
+  map<string, int> counts;
+  for (const auto& ado : r.alive_demon_options()) {
+    counts[ado.name()] = ado.count();
+  }
+  return counts;
+}
+
+GameState ReadExample(const string& game) {
+  string error;
+  std::unique_ptr<Runfiles> runfiles(Runfiles::CreateForTest(&error));
+  const string p = "src/examples/" + game;
+  return GameState::ReadFromFile(
+      runfiles == nullptr ? p : runfiles->Rlocation("botc/" + p));
+}
+
+// Expects the options and request to solve the same worlds as the default
+// solver.
+void ExpectSameWorlds(const GameState& g, const ModelOptions& options,
+                      const SolverRequest& request) {
+  const SolverResponse expected = Solve(g);
+  const SolverResponse r = GameSatSolver(g, options).Solve(request);
+  EXPECT_WORLDS_EQ(r, CopyWorlds(expected));
+  EXPECT_EQ(AliveDemonCounts(r), AliveDemonCounts(expected));
+}
+
+void ExpectSameWorldsOnExamples(const ModelOptions& options,
+                                const SolverRequest& request) {
+  for (const string game : {"tb/baron_three_minions.pbtxt", "tb/monk.pbtxt",
+                            "tb/teensy_observer.pbtxt", "tb/virgin.pbtxt"}) {
+    SCOPED_TRACE(game);
+    ExpectSameWorlds(ReadExample(game), options, request);
+  }
+}
+
+// P1 claims the Chef and learns a 0.
+GameState ChefGame() {
+  GameState g(PLAYER, TROUBLE_BREWING, MakePlayers(5));
+  g.AddNight(1);
+  g.AddShownToken("P1", CHEF);
+  g.AddRoleAction("P1", g.NewChefInfo(0));
+  g.AddDay(1);
+  g.AddRoleClaims({CHEF, MAYOR, VIRGIN, SLAYER, RECLUSE}, "P1");
+  g.AddClaimRoleAction("P1", g.NewChefInfo(0));
+  return g;
+}
+
+// P1 claims the Empath and learns a 1.
+GameState EmpathGame() {
+  GameState g(PLAYER, TROUBLE_BREWING, MakePlayers(5));
+  g.AddNight(1);
+  g.AddShownToken("P1", EMPATH);
+  g.AddRoleAction("P1", g.NewEmpathInfo(1));
+  g.AddDay(1);
+  g.AddRoleClaims({EMPATH, MAYOR, VIRGIN, SLAYER, RECLUSE}, "P1");
+  g.AddClaimRoleAction("P1", g.NewEmpathInfo(1));
+  return g;
+}
+
+// All players claim good roles. P3 is executed, so the Scarlet Woman might
+// proc, and P5 dies at night, which might be an Imp starpass.
+GameState ObserverUndertakerGame() {
+  GameState g(OBSERVER, TROUBLE_BREWING, MakePlayers(7));
+  g.AddNight(1);
+  g.AddDay(1);
+  g.AddRoleClaims(
+      {SLAYER, MAYOR, RAVENKEEPER, VIRGIN, SAINT, SOLDIER, UNDERTAKER}, "P1");
+  g.AddNomination("P3", "P4");
+  g.AddExecution("P3");
+  g.AddDeath("P3");
+  g.AddNight(2);
+  g.AddDay(2);
+  g.AddNightDeath("P5");
+  g.AddClaimRoleAction("P7", g.NewUndertakerInfo(RAVENKEEPER));
+  return g;
+}
+
 TEST(ValidateSTRoleSetup, Valid5PlayersNoBaron) {
   GameState g(STORYTELLER, TROUBLE_BREWING, MakePlayers(5));
   g.SetRoles({IMP, MONK, SPY, MAYOR, VIRGIN});
@@ -330,13 +409,7 @@ TEST(WorldEnumeration, InvalidDemonPerspective7Players) {
 }
 
 TEST(Chef, LearnsNumber_0) {
-  GameState g(PLAYER, TROUBLE_BREWING, MakePlayers(5));
-  g.AddNight(1);
-  g.AddShownToken("P1", CHEF);
-  g.AddRoleAction("P1", g.NewChefInfo(0));
-  g.AddDay(1);
-  g.AddRoleClaims({CHEF, MAYOR, VIRGIN, SLAYER, RECLUSE}, "P1");
-  g.AddClaimRoleAction("P1", g.NewChefInfo(0));
+  const GameState g = ChefGame();
   GameSatSolver s(g);
   unordered_map<string, Role> roles({
       {"P1", CHEF}, {"P2", IMP}, {"P3", DRUNK}, {"P4", BARON},
@@ -364,6 +437,76 @@ TEST(Chef, LearnsNumber_0) {
   EXPECT_FALSE(s.IsValidWorld(SolverRequestBuilder::FromCurrentRoles(roles)));
 }
 
+TEST(Solve, AssumptionsDoNotPersistAcrossRequests) {
+  const GameState g = ChefGame();
+  GameSatSolver s(g);
+  const int num_worlds = s.Solve().worlds_size();
+  unordered_map<string, Role> roles({
+      {"P1", CHEF}, {"P2", MAYOR}, {"P3", VIRGIN}, {"P4", SCARLET_WOMAN},
+      {"P5", IMP}});
+  EXPECT_FALSE(s.IsValidWorld(SolverRequestBuilder::FromCurrentRoles(roles)));
+  EXPECT_TRUE(s.IsValidWorld());
+  roles["P4"] = SPY;
+  EXPECT_WORLDS_EQ(
+      s.Solve(SolverRequestBuilder::FromCurrentRoles(roles)), {roles});
+  EXPECT_EQ(s.Solve().worlds_size(), num_worlds);
+}
+
+TEST(Solve, DoesNotChangeModel) {
+  GameState g(PLAYER, TROUBLE_BREWING, MakePlayers(7));
+  g.AddNight(1);
+  g.AddShownToken("P1", IMP);
+  g.AddDemonInfo("P1", {"P2"}, {EMPATH, RECLUSE, MONK});
+  g.AddDay(1);
+  g.AddRoleClaims({MAYOR, SAINT, UNDERTAKER, RAVENKEEPER, SOLDIER, SLAYER,
+                  VIRGIN}, "P1");
+  g.AddNight(2);
+  g.AddRoleAction("P1", g.NewImpAction("P5"));
+  g.AddDay(2);
+  g.AddNightDeath("P5");
+  GameSatSolver s(g);
+  const string model = s.GetModel().Model().Build().SerializeAsString();
+  SolverRequest request = SolverRequestBuilder()
+      .AddPoisoned("P5", 2).AddHealthy("P3", 1).AddRolesNotInPlay({BARON})
+      .AddGood({"P3"}).Build();
+  request.add_decision_strategy(SolverRequest::POISONER_PICKS);
+  EXPECT_EQ(s.Solve(request).worlds_size(), 1);
+  EXPECT_EQ(s.GetModel().Model().Build().SerializeAsString(), model);
+  EXPECT_EQ(s.Solve().worlds_size(), 1);
+}
+
+TEST(Solve, AssumesPoisonedPlayerNobodyPoisons) {
+  GameState g(PLAYER, TROUBLE_BREWING, MakePlayers(7));
+  g.AddNight(1);
+  g.AddShownToken("P1", IMP);
+  g.AddDemonInfo("P1", {"P2"}, {EMPATH, RECLUSE, MONK});
+  g.AddDay(1);
+  g.AddRoleClaims({MAYOR, SAINT, UNDERTAKER, RAVENKEEPER, SOLDIER, SLAYER,
+                  VIRGIN}, "P1");
+  GameSatSolver s(g);
+  EXPECT_TRUE(s.IsValidWorld(SolverRequestBuilder()
+      .AddPoisoned("P3", 1).AddRolesInPlay({POISONER}).Build()));
+  // Nothing in the game needs the Undertaker to be poisoned, yet only an
+  // alive Poisoner can poison it.
+  EXPECT_FALSE(s.IsValidWorld(SolverRequestBuilder()
+      .AddPoisoned("P3", 1).AddRolesNotInPlay({POISONER}).Build()));
+}
+
+TEST(Solve, RejectsPoisonedAssumptionOnFutureNight) {
+  GameState g(PLAYER, TROUBLE_BREWING, MakePlayers(7));
+  g.AddNight(1);
+  g.AddShownToken("P1", IMP);
+  g.AddDemonInfo("P1", {"P2"}, {EMPATH, RECLUSE, MONK});
+  g.AddDay(1);
+  g.AddRoleClaims({MAYOR, SAINT, UNDERTAKER, RAVENKEEPER, SOLDIER, SLAYER,
+                  VIRGIN}, "P1");
+  GameSatSolver s(g);
+  google::protobuf::Arena arena;
+  const auto response = s.Solve(
+      SolverRequestBuilder().AddPoisoned("P3", 2).Build(), &arena);
+  EXPECT_EQ(response.status().code(), absl::StatusCode::kInvalidArgument);
+}
+
 TEST(Chef, LearnsNumber_1) {
   GameState g(PLAYER, TROUBLE_BREWING, MakePlayers(5));
   g.AddNight(1);
@@ -1300,21 +1443,358 @@ TEST(Spy, SpyPerspective) {
   EXPECT_WORLDS_EQ(Solve(g), expected_worlds);
 }
 
+TEST(ModelStats, RecordsCompilePhases) {
+  GameState g(STORYTELLER, TROUBLE_BREWING, MakePlayers(5));
+  g.SetRoles({IMP, MONK, SPY, MAYOR, VIRGIN});
+  g.AddNight(1);
+  g.AddAllShownTokens({IMP, MONK, SPY, MAYOR, VIRGIN});
+  g.AddDay(1);
+  g.AddRoleClaims({SLAYER, MONK, RAVENKEEPER, MAYOR, VIRGIN}, "P1");
+  // Otherwise, all the Storyteller role variables are constants.
+  ModelOptions options;
+  options.set_dense_role_vars(true);
+  GameSatSolver s(g, options);
+  const auto& phases = s.GetModelStats().phases;
+  ASSERT_EQ(phases.size(), 5 + AllRoles(TROUBLE_BREWING).size());
+  EXPECT_EQ(phases.front().name, "RoleSetup");
+  EXPECT_GT(phases.front().variables, 0);
+  EXPECT_GT(phases.front().constraints, 0);
+  EXPECT_GT(phases.front().literals, phases.front().constraints);
+  EXPECT_EQ(phases[3].name, "WASHERWOMAN");
+  EXPECT_EQ(phases.back().name, "Presolve");
+  std::ostringstream os;
+  os << s.GetModelStats();
+  EXPECT_THAT(os.str(), testing::HasSubstr("Total"));
+}
+
+TEST(ModelCache, LoadsCompiledModel) {
+  const GameState g = ChefGame();
+  ModelOptions options;
+  options.set_model_cache_dir(
+      (path(testing::TempDir()) / "model_cache").string());
+  std::filesystem::remove_all(options.model_cache_dir());
+  GameSatSolver compiled(g, options);
+  GameSatSolver loaded(g, options);
+  // No temporary files are left behind.
+  EXPECT_EQ(std::distance(std::filesystem::directory_iterator(
+                              options.model_cache_dir()),
+                          std::filesystem::directory_iterator()), 1);
+  EXPECT_NE(compiled.GetModelStats().phases.front().name, "LoadModelCache");
+  ASSERT_EQ(loaded.GetModelStats().phases.size(), 1);
+  EXPECT_EQ(loaded.GetModelStats().phases.front().name, "LoadModelCache");
+  EXPECT_EQ(loaded.Solve().worlds_size(), compiled.Solve().worlds_size());
+  SolverRequest request = SolverRequestBuilder()
+      .AddEvil({"P2"}).AddRolesInPlay({BARON}).Build();
+  EXPECT_EQ(loaded.Solve(request).worlds_size(),
+            compiled.Solve(request).worlds_size());
+  options.set_named_model(true);  // Different options are not loaded.
+  GameSatSolver other(g, options);
+  EXPECT_NE(other.GetModelStats().phases.front().name, "LoadModelCache");
+}
+
+TEST(ModelCache, IgnoresUnwritableCache) {
+  const GameState g = ChefGame();
+  // The cache directory cannot be created under a file.
+  const path file = path(testing::TempDir()) / "model_cache_file";
+  std::ofstream(file) << "not a directory";
+  ModelOptions options;
+  options.set_model_cache_dir((file / "model_cache").string());
+  GameSatSolver compiled(g, options);
+  EXPECT_EQ(compiled.Solve().worlds_size(),
+            GameSatSolver(g).Solve().worlds_size());
+  GameSatSolver recompiled(g, options);
+  EXPECT_NE(recompiled.GetModelStats().phases.front().name, "LoadModelCache");
+}
+
+TEST(Preprocessor, PreservesWorlds) {
+  const GameState g = EmpathGame();
+  ModelOptions options;
+  options.set_preprocess_model(true);
+  GameSatSolver plain(g), preprocessed(g, options);
+  EXPECT_EQ(preprocessed.Solve().worlds_size(), plain.Solve().worlds_size());
+  EXPECT_EQ(preprocessed.GetPreprocessorStats().passes.size(), 4);
+  EXPECT_TRUE(plain.GetPreprocessorStats().passes.empty());
+  SolverRequest request = SolverRequestBuilder()
+      .AddEvil({"P2"}).AddRolesInPlay({BARON}).Build();
+  EXPECT_EQ(preprocessed.Solve(request).worlds_size(),
+            plain.Solve(request).worlds_size());
+}
+
+TEST(BaseModelTemplates, SolvesSameWorlds) {
+  ModelOptions options;
+  options.set_use_base_model_templates(true);
+  // Two games with the same template key, the second reuses the base model.
+  int base_constraints = -1;
+  for (Role undertaker_info : {RAVENKEEPER, SOLDIER}) {
+    GameState g(PLAYER, TROUBLE_BREWING, MakePlayers(7));
+    g.AddNight(1);
+    g.AddShownToken("P1", BARON);
+    g.AddMinionInfo("P1", "P2", {});  // P1 Baron, P2 Imp
+    g.AddDay(1);
+    g.AddRoleClaims(
+        {SLAYER, MAYOR, RAVENKEEPER, VIRGIN, SAINT, SOLDIER, UNDERTAKER},
+        "P1");
+    g.AddNomination("P3", "P4");
+    g.AddExecution("P3");
+    g.AddDeath("P3");
+    g.AddNight(2);
+    g.AddDay(2);
+    g.AddClaimRoleAction("P7", g.NewUndertakerInfo(undertaker_info));
+    GameSatSolver s(g, options);
+    const auto& phases = s.GetModelStats().phases;
+    ASSERT_EQ(phases[0].name, "BaseModel");
+    if (base_constraints < 0) {
+      base_constraints = phases[0].constraints;
+    }
+    EXPECT_EQ(phases[0].constraints, base_constraints);
+    EXPECT_EQ(s.Solve().worlds_size(), GameSatSolver(g).Solve().worlds_size());
+  }
+}
+
+TEST(BaseModelTemplates, FixesRolesInPlayFromSetupCatalog) {
+  // P1 is the only Minion and P7 is the Saint, so the Baron is in play, and no
+  // other Minion is.
+  GameState g(PLAYER, TROUBLE_BREWING, MakePlayers(7));
+  g.AddNight(1);
+  g.AddShownToken("P1", BARON);
+  g.AddMinionInfo("P1", "P2", {});
+  g.AddDay(1);
+  g.AddRoleClaims({SLAYER, MAYOR, RAVENKEEPER, VIRGIN, SOLDIER, UNDERTAKER,
+                   SAINT}, "P1");
+  ModelOptions options;
+  options.set_use_base_model_templates(true);
+  ModelOptions skip_catalog = options;
+  skip_catalog.add_variants(ModelOptions::SKIP_SETUP_CATALOG);
+  GameSatSolver s(g, options), counts(g, skip_catalog);
+  EXPECT_GT(s.GetCacheStats(false).fixed_literals,
+            counts.GetCacheStats(false).fixed_literals);
+  EXPECT_EQ(s.Solve().worlds_size(), counts.Solve().worlds_size());
+}
+
+TEST(BaseModelTemplates, AddsStorytellerRoles) {
+  ModelOptions options;
+  options.set_use_base_model_templates(true);
+  const vector<pair<vector<Role>, vector<Role>>> games = {
+      {{IMP, MONK, SPY, MAYOR, VIRGIN}, {SLAYER, MONK, RAVENKEEPER, MAYOR,
+                                         VIRGIN}},
+      {{MONK, IMP, MAYOR, SPY, VIRGIN}, {MONK, SLAYER, MAYOR, RAVENKEEPER,
+                                         VIRGIN}}};
+  for (const auto& [roles, claims] : games) {
+    GameState g(STORYTELLER, TROUBLE_BREWING, MakePlayers(5));
+    g.SetRoles(roles);
+    g.AddNight(1);
+    g.AddAllShownTokens(roles);
+    g.AddDay(1);
+    g.AddRoleClaims(claims, "P1");
+    const SolverResponse r = GameSatSolver(g, options).Solve();
+    ASSERT_EQ(r.worlds_size(), 1);
+    EXPECT_EQ(r.worlds(0).current_roles().at("P1"), roles[0]);
+    EXPECT_EQ(r.worlds(0).current_roles().at("P2"), roles[1]);
+  }
+}
+
+TEST(SparseRoleVars, SolvesSameWorlds) {
+  const GameState g = ObserverUndertakerGame();
+  ModelOptions options;
+  options.set_dense_role_vars(true);
+  GameSatSolver dense(g, options), sparse(g);
+  EXPECT_LT(sparse.GetModel().Model().Build().variables_size(),
+            dense.GetModel().Model().Build().variables_size());
+  const SolverResponse r = dense.Solve();
+  EXPECT_GT(r.worlds_size(), 0);
+  EXPECT_WORLDS_EQ(sparse.Solve(), CopyWorlds(r));
+}
+
+TEST(SparseRoleVars, AliasesRolesThatCannotChange) {
+  const GameState g = ObserverUndertakerGame();
+  ModelOptions options;
+  options.set_dense_role_vars(true);
+  GameSatSolver dense(g, options), sparse(g);
+  unordered_set<string> names;
+  for (const VarKey& key : sparse.GetModel().VarKeys()) {
+    names.insert(key.name);
+  }
+  // Townsfolk never change roles in TB.
+  EXPECT_TRUE(names.contains("role_P1_SLAYER_night_1"));
+  EXPECT_FALSE(names.contains("role_P1_SLAYER_day_2"));
+  // The Scarlet Woman proc and the starpass might change the evil roles.
+  EXPECT_TRUE(names.contains("role_P2_IMP_night_2"));
+  EXPECT_TRUE(names.contains("role_P2_IMP_day_2"));
+  const SolverResponse r = dense.Solve();
+  EXPECT_GT(r.worlds_size(), 0);
+  EXPECT_WORLDS_EQ(sparse.Solve(), CopyWorlds(r));
+}
+
+TEST(ConstraintTags, TagsRoleActionClaims) {
+  const GameState g = EmpathGame();
+  const int claim_event = g.ToProto().events_size() - 1;
+  GameSatSolver s(g);
+  bool found = false;
+  for (const ConstraintTagRange& range : s.GetConstraintTags()) {
+    if (range.tag.source == "AddEmpathConstraints") {
+      EXPECT_EQ(range.tag.role, EMPATH);
+      EXPECT_EQ(range.tag.time, Time::Night(1).Index());
+      EXPECT_EQ(range.tag.event, claim_event);
+      EXPECT_LT(range.begin, range.end);
+      found = true;
+    }
+  }
+  EXPECT_TRUE(found);
+}
+
+TEST(Solve, AllocatesResponseOnArena) {
+  const GameState g = EmpathGame();
+  GameSatSolver s(g);
+  const SolverResponse expected = s.Solve();
+  google::protobuf::Arena arena;
+  const auto result = s.Solve(SolverRequest(), &arena);
+  ASSERT_TRUE(result.ok()) << result.status();
+  const SolverResponse* response = *result;
+  EXPECT_EQ(response->GetArena(), &arena);
+  EXPECT_EQ(response->worlds_size(), expected.worlds_size());
+  EXPECT_EQ(response->alive_demon_options_size(),
+            expected.alive_demon_options_size());
+}
+
 TEST(Examples, ExamplesWork) {
-  string error;
-  std::unique_ptr<Runfiles> runfiles(Runfiles::CreateForTest(&error));
-  map<path, int> world_counts_by_game({
+  map<string, int> world_counts_by_game({
+    {"tb/baron_three_minions.pbtxt", 1},
     {"tb/monk.pbtxt", 3},
     {"tb/teensy_observer.pbtxt", 3},
     {"tb/virgin.pbtxt", 8},
   });
-  string dir = "src/examples/";
-  for (const auto& it : world_counts_by_game) {
-    string p = (runfiles == nullptr ? dir + it.first.string() :
-        runfiles->Rlocation("botc/" + dir + it.first.string()));
-    GameState g = GameState::ReadFromFile(p);
-    SolverResponse r = Solve(g);
-    EXPECT_EQ(r.worlds_size(), it.second);
+  for (const auto& [game, worlds] : world_counts_by_game) {
+    EXPECT_EQ(Solve(ReadExample(game)).worlds_size(), worlds) << game;
+  }
+}
+
+TEST(DecisionStrategy, SolvesSameWorlds) {
+  GameState g(PLAYER, TROUBLE_BREWING, MakePlayers(6));
+  g.AddNight(1);
+  g.AddShownToken("P1", EMPATH);
+  g.AddRoleAction("P1", g.NewEmpathInfo(1));
+  g.AddDay(1);
+  g.AddRoleClaims({EMPATH, MAYOR, VIRGIN, SLAYER, RECLUSE, MONK}, "P1");
+  g.AddClaimRoleAction("P1", g.NewEmpathInfo(1));
+  g.AddNight(2);
+  g.AddRoleAction("P1", g.NewEmpathInfo(0));
+  g.AddDay(2);
+  g.AddNightDeath("P4");
+  g.AddClaimRoleAction("P1", g.NewEmpathInfo(0));
+  g.AddClaimRoleAction("P6", g.NewMonkAction("P2"));
+  GameSatSolver s(g);
+  const SolverResponse expected = s.Solve();
+  EXPECT_GT(expected.worlds_size(), 0);
+  SolverRequest request;
+  request.set_default_search(true);
+  EXPECT_WORLDS_EQ(s.Solve(request), CopyWorlds(expected));
+  request.set_default_search(false);
+  for (auto stage : {SolverRequest::POISONER_PICKS,
+                     SolverRequest::STARTING_MISREGISTERING_ROLES,
+                     SolverRequest::STARTING_DEMON,
+                     SolverRequest::STARTING_MINIONS,
+                     SolverRequest::STARTING_ROLES}) {
+    request.add_decision_strategy(stage);
+  }
+  EXPECT_WORLDS_EQ(s.Solve(request), CopyWorlds(expected));
+}
+
+TEST(IntegerRoles, SolvesSameWorlds) {
+  for (bool dense : {false, true}) {
+    ModelOptions options;
+    options.set_role_encoding(ModelOptions::INTEGER_ROLES);
+    options.set_dense_role_vars(dense);
+    ExpectSameWorldsOnExamples(options, SolverRequest());
+  }
+}
+
+TEST(IntegerRoles, SolvesWithAssumptions) {
+  const GameState g = ObserverUndertakerGame();
+  ModelOptions options;
+  options.set_role_encoding(ModelOptions::INTEGER_ROLES);
+  GameSatSolver s(g, options);
+  const SolverRequest request = SolverRequestBuilder()
+      .AddStartingRoles("P2", SCARLET_WOMAN)
+      .AddCurrentRolesNot("P2", SCARLET_WOMAN)
+      .Build();
+  const SolverResponse r = s.Solve(request);
+  EXPECT_GT(r.worlds_size(), 0);
+  EXPECT_WORLDS_EQ(r, CopyWorlds(GameSatSolver(g).Solve(request)));
+  for (const auto& w : r.worlds()) {
+    EXPECT_EQ(w.current_roles().at("P2"), IMP);
+  }
+}
+
+TEST(SetupTable, SolvesSameWorlds) {
+  for (bool dense : {false, true}) {
+    ModelOptions options;
+    options.set_setup_encoding(ModelOptions::SETUP_TABLE);
+    options.set_dense_role_vars(dense);
+    ExpectSameWorldsOnExamples(options, SolverRequest());
+  }
+}
+
+TEST(SetupTable, SolvesWithAssumptions) {
+  // A Saint in a 5 player game requires the Baron, who brings a second
+  // Outsider.
+  GameState g(OBSERVER, TROUBLE_BREWING, MakePlayers(5));
+  g.AddNight(1);
+  g.AddDay(1);
+  g.AddRoleClaims({SAINT, MAYOR, SOLDIER, VIRGIN, SLAYER}, "P1");
+  ModelOptions options;
+  options.set_setup_encoding(ModelOptions::SETUP_TABLE);
+  GameSatSolver s(g, options);
+  GameSatSolver baseline(g);
+  for (const SolverRequest& request : {
+           SolverRequestBuilder().AddStartingRoles("P1", SAINT).Build(),
+           SolverRequestBuilder().AddRolesInPlay({DRUNK}).Build(),
+           SolverRequestBuilder().AddRolesNotInPlay({BARON}).Build()}) {
+    const SolverResponse r = s.Solve(request);
+    EXPECT_WORLDS_EQ(r, CopyWorlds(baseline.Solve(request)));
+    EXPECT_GT(r.worlds_size(), 0);
+  }
+  const SolverResponse saint = s.Solve(
+      SolverRequestBuilder().AddStartingRoles("P1", SAINT).Build());
+  for (const auto& w : saint.worlds()) {
+    int barons = 0, drunks = 0;
+    for (const auto& [player, role] : w.current_roles()) {
+      barons += role == BARON;
+      drunks += role == DRUNK;
+    }
+    EXPECT_EQ(barons, 1);
+    EXPECT_EQ(drunks, 1);
+  }
+}
+
+TEST(SetupCatalog, FixedRolesInPlayKeepWorlds) {
+  ModelOptions options;
+  options.add_variants(ModelOptions::SKIP_SETUP_CATALOG);
+  ExpectSameWorldsOnExamples(options, SolverRequest());
+  ExpectSameWorlds(ChefGame(), options, SolverRequest());
+  ExpectSameWorlds(EmpathGame(), options, SolverRequest());
+  ExpectSameWorlds(ObserverUndertakerGame(), options, SolverRequest());
+  // P1 is shown the roles without night 1 info, and the Saint claim might need
+  // a Baron.
+  for (int num_players : {5, 7}) {
+    for (Role role : {SLAYER, MAYOR, SOLDIER, VIRGIN, MONK, SAINT, RECLUSE,
+                      POISONER, SPY, SCARLET_WOMAN, BARON, IMP}) {
+      SCOPED_TRACE(absl::StrFormat("%d players, P1 is shown %s", num_players,
+                                   Role_Name(role)));
+      GameState g(PLAYER, TROUBLE_BREWING, MakePlayers(num_players));
+      g.AddNight(1);
+      g.AddShownToken("P1", role);
+      if (num_players >= 7 && IsMinionRole(role)) {
+        g.AddMinionInfo("P1", "P2", {});
+      } else if (num_players >= 7 && IsDemonRole(role)) {
+        g.AddDemonInfo("P1", {"P2"}, {EMPATH, CHEF, RAVENKEEPER});
+      }
+      g.AddDay(1);
+      vector<Role> claims = {IsGoodRole(role) ? role : SLAYER, SAINT, MAYOR,
+                             VIRGIN, SOLDIER, UNDERTAKER, MONK};
+      claims.resize(num_players);
+      g.AddRoleClaims(claims, "P1");
+      ExpectSameWorlds(g, options, SolverRequest());
+    }
   }
 }
 }  // namespace
@@ -14,7 +14,6 @@
 #include "src/game_state.h"
 
 #include <algorithm>
-#include <set>
 #include <string>
 #include <vector>
 #include <unordered_map>
@@ -83,7 +82,6 @@ bool IsFirstNightOnlyRole(Role role) {
   return m.first_night > 0 && m.other_night == 0;
 }
 
-// TODO(olaola): here and below, initialize statically and cache.
 const absl::Span<const Role> AllRoles(Script s) {
   switch (s) {
     case TROUBLE_BREWING:
@@ -101,28 +99,50 @@ const vector<Role> FilterRoles(Script s, RoleFilter f) {
   return r;
 }
 
-const vector<Role> GoodRoles(Script s) {
-  return FilterRoles(s, IsGoodRole);
+namespace {
+// The role lists of a script, computed once, so that the per-player and
+// per-time loops of the solver do not copy them.
+struct ScriptRoles {
+  explicit ScriptRoles(Script s)
+      : good(FilterRoles(s, IsGoodRole)), evil(FilterRoles(s, IsEvilRole)),
+        townsfolk(FilterRoles(s, IsTownsfolkRole)),
+        outsiders(FilterRoles(s, IsOutsiderRole)),
+        minions(FilterRoles(s, IsMinionRole)),
+        demons(FilterRoles(s, IsDemonRole)) {}
+
+  const vector<Role> good, evil, townsfolk, outsiders, minions, demons;
+};
+
+const ScriptRoles& GetScriptRoles(Script s) {
+  static const ScriptRoles* const kTroubleBrewing =
+      new ScriptRoles(TROUBLE_BREWING);
+  CHECK_EQ(s, TROUBLE_BREWING) << "Unsupported script: " << Script_Name(s);
+  return *kTroubleBrewing;
 }
+}  // namespace
 
-const vector<Role> EvilRoles(Script s) {
-  return FilterRoles(s, IsEvilRole);
+const absl::Span<const Role> GoodRoles(Script s) {
+  return GetScriptRoles(s).good;
 }
 
-const vector<Role> TownsfolkRoles(Script s) {
-  return FilterRoles(s, IsTownsfolkRole);
+const absl::Span<const Role> EvilRoles(Script s) {
+  return GetScriptRoles(s).evil;
 }
 
-const vector<Role> OutsiderRoles(Script s) {
-  return FilterRoles(s, IsOutsiderRole);
+const absl::Span<const Role> TownsfolkRoles(Script s) {
+  return GetScriptRoles(s).townsfolk;
 }
 
-const vector<Role> MinionRoles(Script s) {
-  return FilterRoles(s, IsMinionRole);
+const absl::Span<const Role> OutsiderRoles(Script s) {
+  return GetScriptRoles(s).outsiders;
 }
 
-const vector<Role> DemonRoles(Script s) {
-  return FilterRoles(s, IsDemonRole);
+const absl::Span<const Role> MinionRoles(Script s) {
+  return GetScriptRoles(s).minions;
+}
+
+const absl::Span<const Role> DemonRoles(Script s) {
+  return GetScriptRoles(s).demons;
 }
 
 ostream& operator<<(ostream& os, const Time& t) {
@@ -336,6 +356,7 @@ GameState& GameState::AddNight(int count) {
     << cur_time_ << " needs to be followed by " << cur_time_ + 1;
   log_.add_events()->set_night(count);
   ++cur_time_;
+  InvalidateRolePossibilities();
   if (perspective_ == STORYTELLER) {
     if (st_night_roles_.size() < count) {
       st_night_roles_.push_back(st_day_roles_.back());
@@ -363,6 +384,7 @@ GameState& GameState::AddDay(int count) {
     << cur_time_ << " needs to be followed by " << cur_time_ + 1;
   log_.add_events()->set_day(count);
   ++cur_time_;
+  InvalidateRolePossibilities();
   on_the_block_ = kNoPlayer;
   executions_.push_back(kNoPlayer);
   execution_deaths_.push_back(kNoPlayer);
@@ -556,6 +578,7 @@ GameState& GameState::AddNightDeath(const string& name) {
       << "No two night deaths in Trouble Brewing";
   night_death = i;
   is_alive_day_.back()[i] = false;
+  InvalidateRolePossibilities();
   --(num_alive_day_.back());
   return *this;
 }
@@ -594,6 +617,7 @@ GameState& GameState::AddDeath(const string& name) {
   }
   is_alive_night_.back()[i] = false;
   --(num_alive_night_.back());
+  InvalidateRolePossibilities();
   return *this;
 }
 
@@ -614,11 +638,15 @@ GameState& GameState::AddClaim(const internal::Claim& claim) {
   }
   claims_.push_back(claim);
   auto& c = claims_.back();
+  if (c.claim_case == Claim::kRole) {
+    InvalidateRolePossibilities();
+  }
   CHECK(cur_time_.is_day) << absl::StrFormat(
       "Claims only occur during the day, got %s claiming on %s.",
       PlayerName(c.player), cur_time_);
   c.claim_time = cur_time_;
   auto& ra = c.role_action;
+  ra.event = log_.events_size() - 1;
   const bool day_role = IsDayActionRole(ra.acting);
   switch (claim.claim_case) {
     case Claim::kRole:
@@ -662,10 +690,10 @@ GameState& GameState::AddClaim(const internal::Claim& claim) {
   return *this;
 }
 
-vector<int> GameState::AliveNeighbors(int player, const Time& time) const {
+PlayerList GameState::AliveNeighbors(int player, const Time& time) const {
   CHECK_GE(NumAlive(time), 3)
       << "Less than 3 alive players, game didn't end";
-  vector<int> result;
+  PlayerList result;
   int i = (player + 1) % num_players_;
   while (!IsAlive(i, time)) {
     i = (i + 1) % num_players_;
@@ -706,8 +734,8 @@ GameState& GameState::AddAllShownTokens(absl::Span<const Role> roles) {
 }
 
 // Returns the deaths chronilogically. Execution is always the last death.
-vector<int> GameState::Deaths(const Time& time) const {
-  vector<int> result;
+PlayerList GameState::Deaths(const Time& time) const {
+  PlayerList result;
   if (time.is_day) {
     const auto slayer_shots = GetRoleActions(SLAYER);
     for (const auto* shot : slayer_shots) {
@@ -820,6 +848,7 @@ GameState& GameState::AddShownToken(const string& player, Role role) {
     // TODO(olaola): validate role change.
     perspective_player_shown_token_.back() = role;
   }
+  InvalidateRolePossibilities();
   return *this;
 }
 
@@ -851,6 +880,7 @@ GameState& GameState::AddMinionInfo(const string& player, const string& demon,
   }
   minion_info_ = {.player = PlayerIndex(player), .demon = PlayerIndex(demon),
                   .minions = ms};
+  InvalidateRolePossibilities();
   // In the Storyteller perspective we don't keep the minion info, because we
   // can just re-create it.
   return *this;
@@ -895,6 +925,7 @@ GameState& GameState::AddDemonInfo(const string& player,
   for (Role bluff : bluffs) {
     demon_info_.bluffs.push_back(bluff);
   }
+  InvalidateRolePossibilities();
   return *this;
 }
 
@@ -914,6 +945,7 @@ GameState& GameState::AddRoleAction(const string& player,
   role_actions_.push_back(role_action);
   auto& ra = role_actions_.back();
   ra.player = PlayerIndex(player);
+  ra.event = log_.events_size() - 1;
   if (!ra.time.Initialized()) {
     ra.time = cur_time_;
   }
@@ -1456,32 +1488,21 @@ bool GameState::IsKnownDemonBluff(Role role) const {
 }
 
 bool GameState::IsKnownStartingDemon(int player) const {
-  set<int> known_demons;
-  if (minion_info_.demon != kNoPlayer) {
-    known_demons.insert(minion_info_.demon);
-  }
-  if (perspective_ == PLAYER) {
-    Role player_role = ShownToken(perspective_player_, Time::Night(1));
-    if (IsDemonRole(player_role)) {
-      known_demons.insert(perspective_player_);
-    }
+  if (player == minion_info_.demon) {
+    return true;
   }
-  return known_demons.find(player) != known_demons.end();
+  return (perspective_ == PLAYER && player == perspective_player_ &&
+          IsDemonRole(ShownToken(perspective_player_, Time::Night(1))));
 }
 
 bool GameState::IsKnownStartingMinion(int player) const {
-  set<int> known_minions;
-  known_minions.insert(minion_info_.minions.begin(),
-                       minion_info_.minions.end());
-  known_minions.insert(demon_info_.minions.begin(),
-                       demon_info_.minions.end());
-  if (perspective_ == PLAYER) {
-    Role player_role = ShownToken(perspective_player_, Time::Night(1));
-    if (IsMinionRole(player_role)) {
-      known_minions.insert(perspective_player_);
+  for (const auto* minions : {&minion_info_.minions, &demon_info_.minions}) {
+    if (std::find(minions->begin(), minions->end(), player) != minions->end()) {
+      return true;
     }
   }
-  return known_minions.find(player) != known_minions.end();
+  return (perspective_ == PLAYER && player == perspective_player_ &&
+          IsMinionRole(ShownToken(perspective_player_, Time::Night(1))));
 }
 
 bool GameState::IsKnownEvil(int player) const {
@@ -1492,17 +1513,29 @@ bool GameState::IsKnownEvil(int player) const {
 // The purpose of this function is optimization only! It must only be correct
 // when returning false. It relies on the game being fully claimed. The main
 // purpose is to filter out options using known Evil info.
-bool GameState::IsRolePossible(int player, Role role, const Time& time) const {
+bool GameState::ComputeIsRolePossible(
+    int player, Role role, const Time& time,
+    const vector<vector<uint64_t>>& earlier) const {
   if (perspective_ == OBSERVER) {
     return true;  // Observer makes no inferences for now.
   }
   Role player_role = ShownToken(player, time);
   if (player_role != ROLE_UNSPECIFIED) {
-    return (player_role == role ||
-            (role == DRUNK && IsTownsfolkRole(player_role)));
+    // A token shown at night (starpass) only becomes the role the next day.
+    const Role previous_role = time.is_day || time == Time::Night(1) ?
+        player_role : ShownToken(player, time - 1);
+    for (Role shown : {player_role, previous_role}) {
+      if (shown == role || (role == DRUNK && IsTownsfolkRole(shown))) {
+        return true;
+      }
+    }
+    return false;
   }
   // From now on, this is player perspective.
   Role my_role = ShownToken(perspective_player_, time);
+  if (my_role == ROLE_UNSPECIFIED) {
+    return true;  // No inferences without knowing my role.
+  }
   if (IsGoodRole(role)) {
     if (IsEvilRole(my_role)) {
       // We can rule out known Evil players and demon bluff roles.
@@ -1517,6 +1550,10 @@ bool GameState::IsRolePossible(int player, Role role, const Time& time) const {
     return true;  // no inferences.
   }
   // From now on, both mine and role are Evil roles.
+  if (IsMinionRole(ShownToken(perspective_player_, Time::Night(1))) ?
+      minion_info_.demon == kNoPlayer : demon_info_.player == kNoPlayer) {
+    return true;  // No inferences without the evil info (e.g. 5-6 players).
+  }
   if (IsMinionRole(role)) {
     return role != my_role && IsKnownStartingMinion(player);
   }
@@ -1524,7 +1561,7 @@ bool GameState::IsRolePossible(int player, Role role, const Time& time) const {
   if (time == Time::Night(1)) {
     return role != my_role && IsKnownStartingDemon(player);
   }
-  const auto claims = GetRoleClaimsByNight()[player];
+  const auto claims = GetRoleClaimsByNight(player);
   const bool claim_recluse_starpass =
       claims.front() == RECLUSE && claims.back() == IMP;
   const bool known_minion = IsKnownStartingMinion(player);
@@ -1538,7 +1575,7 @@ bool GameState::IsRolePossible(int player, Role role, const Time& time) const {
     }
     const Time tod = TimeOfDeath(minion_info_.demon);
     const bool sw_valid = tod.Initialized() && tod < time && NumAlive(tod) >= 5;
-    return ((sw_valid && IsRolePossible(player, SCARLET_WOMAN, tod)) ||
+    return ((sw_valid && (earlier[tod.Index()][player] >> SCARLET_WOMAN) & 1) ||
             (DiedAtNight(minion_info_.demon, time) && possible_starpass));
   }
   // They were a demon (at some point) and died, and I caught a starpass (or SW
@@ -1549,6 +1586,24 @@ bool GameState::IsRolePossible(int player, Role role, const Time& time) const {
   const bool sw_valid = tod.Initialized() && tod < time && NumAlive(tod) >= 5;
   return ((DiedAtNight(perspective_player_, time) && possible_starpass) ||
           (sw_valid && starting_sw) ||
-          (DiedAtNight(player, time) && IsRolePossible(player, IMP, time - 1)));
+          (DiedAtNight(player, time) &&
+           (earlier[(time - 1).Index()][player] >> IMP) & 1));
+}
+
+vector<vector<uint64_t>> GameState::ComputeRolePossibilities() const {
+  static_assert(Role_ARRAYSIZE <= 64, "Roles do not fit a 64 bit mask");
+  vector<vector<uint64_t>> masks;
+  for (Time time = Time::Night(1); time <= cur_time_; ++time) {
+    vector<uint64_t> possible(num_players_);
+    for (int i = 0; i < num_players_; ++i) {
+      for (Role role : AllRoles(script_)) {
+        if (ComputeIsRolePossible(i, role, time, masks)) {
+          possible[i] |= uint64_t{1} << role;
+        }
+      }
+    }
+    masks.push_back(std::move(possible));
+  }
+  return masks;
 }
 }  // namespace botc
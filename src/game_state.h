@@ -15,15 +15,19 @@
 #define SRC_GAME_STATE_H_
 
 #include <algorithm>
+#include <cstdint>
 #include <string>
 #include <iostream>
 #include <memory>
+#include <mutex>  // NOLINT [build/c++11]
 #include <vector>
 #include <unordered_map>
 #include <utility>
 
+#include "absl/container/inlined_vector.h"
 #include "absl/status/status.h"
 #include "absl/strings/str_format.h"
+#include "google/protobuf/arena.h"
 #include "ortools/base/logging.h"
 #include "src/game_log.pb.h"
 #include "src/util.h"
@@ -42,6 +46,8 @@ using Audience = botc::Claim::Audience;
 using SoftRole = botc::Claim::SoftRole;
 
 const int kNoPlayer =  - 1;  // Used in place of player index.
+// Short lists of player indices (deaths, neighbors), stored inline.
+typedef absl::InlinedVector<int, 2> PlayerList;
 
 const int kNumTownsfolk[] = {3, 3, 5, 5, 5, 7, 7, 7, 9, 9, 9};
 const int kNumOutsiders[] = {0, 1, 0, 1, 2, 0, 1, 2, 0, 1, 2};
@@ -133,12 +139,12 @@ const absl::Span<const Role> AllRoles(Script s);
 typedef bool (*RoleFilter)(Role);
 
 const vector<Role> FilterRoles(Script s, RoleFilter f);
-const vector<Role> GoodRoles(Script s);
-const vector<Role> EvilRoles(Script s);
-const vector<Role> TownsfolkRoles(Script s);
-const vector<Role> OutsiderRoles(Script s);
-const vector<Role> MinionRoles(Script s);
-const vector<Role> DemonRoles(Script s);
+const absl::Span<const Role> GoodRoles(Script s);
+const absl::Span<const Role> EvilRoles(Script s);
+const absl::Span<const Role> TownsfolkRoles(Script s);
+const absl::Span<const Role> OutsiderRoles(Script s);
+const absl::Span<const Role> MinionRoles(Script s);
+const absl::Span<const Role> DemonRoles(Script s);
 
 // In-game current time. The game starts with Night 1, after which Day x follows
 // Night x, and is followed by Night x + 1, etc.
@@ -187,6 +193,11 @@ struct Time {
   Time& operator--() { return (*this -= 1); }
   static Time Day(int day) { return {.is_day = true, .count = day}; }
   static Time Night(int night) { return {.is_day = false, .count = night}; }
+  // Position on the game timeline: Night 1 is 0, Day 1 is 1, Night 2 is 2, etc.
+  int Index() const { return 2 * (count - 1) + (is_day ? 1 : 0); }
+  static Time FromIndex(int index) {
+    return index % 2 == 0 ? Night(index / 2 + 1) : Day(index / 2 + 1);
+  }
 };
 
 ostream& operator<<(ostream& os, const Time& t);
@@ -234,6 +245,7 @@ struct RoleAction {
   bool yes;  // e.g. Fortune Teller, Seamstress, Artist, etc.
   Team team;  // e.g. Goon team changes, or weak role action claims.
   GrimoireInfo grimoire_info;  // Spy/Widow are special.
+  int event = -1;  // Index of the GameLog event that added the action.
 
   bool IsWellDefined() const;
 };
@@ -269,6 +281,35 @@ SoftRole NewSoftRole(absl::Span<const Role> roles);
 SoftRole NewSoftRoleNot(absl::Span<const Role> roles);
 SoftRole NewSoftRole(RoleType rt);
 SoftRole NewSoftRoleNot(RoleType rt);
+
+// The memoized role possibility bit masks of a game state, x time index,
+// player. They are computed on first use, which may happen concurrently on a
+// shared const game state, and cleared by the events that can change them.
+class RolePossibilities {
+ public:
+  RolePossibilities() : once_(std::make_unique<std::once_flag>()) {}
+  // Copies recompute the masks on first use.
+  RolePossibilities(const RolePossibilities&) : RolePossibilities() {}
+  RolePossibilities& operator=(const RolePossibilities&) {
+    Clear();
+    return *this;
+  }
+  // Returns the masks, computing them on the first call since the last Clear.
+  template <typename F>
+  const vector<vector<uint64_t>>& Get(F compute) const {
+    std::call_once(*once_, [&] { masks_ = compute(); });
+    return masks_;
+  }
+  // Like all game state changes, must not run concurrently with Get.
+  void Clear() {
+    once_ = std::make_unique<std::once_flag>();
+    masks_.clear();
+  }
+
+ private:
+  std::unique_ptr<std::once_flag> once_;
+  mutable vector<vector<uint64_t>> masks_;
+};
 }  // namespace internal
 
 // This contains an instance of a BOTC game on a particular time.
@@ -280,9 +321,12 @@ class GameState {
   GameState& SetRoles(const unordered_map<string, Role>& roles);
   GameState& SetRoles(absl::Span<const Role> roles);  // In order of players.
   static GameState ReadFromFile(const path& filename) {
-    GameLog log;
-    ReadProtoFromFile(filename, &log);
-    return FromProto(log);
+    // The parsed log is only needed while replaying it, so it is allocated
+    // (and freed) in one piece.
+    google::protobuf::Arena arena;
+    GameLog* log = google::protobuf::Arena::CreateMessage<GameLog>(&arena);
+    ReadProtoFromFile(filename, log);
+    return FromProto(*log);
   }
 
   void WriteToFile(const path& filename) const {
@@ -543,8 +587,8 @@ class GameState {
   const vector<internal::Nomination>& Nominations() const {
     return nominations_;
   }
-  vector<int> Deaths() const { return Deaths(cur_time_); }
-  vector<int> Deaths(const Time& time) const;
+  PlayerList Deaths() const { return Deaths(cur_time_); }
+  PlayerList Deaths(const Time& time) const;
   vector<string> DeathsNames(const Time& time) const;
   vector<string> DeathsNames() const { return DeathsNames(cur_time_); }
 
@@ -563,8 +607,8 @@ class GameState {
     return it->second;
   }
 
-  vector<int> AliveNeighbors(int player, const Time& time) const;
-  vector<int> AliveNeighbors(int player) const {
+  PlayerList AliveNeighbors(int player, const Time& time) const;
+  PlayerList AliveNeighbors(int player) const {
     return AliveNeighbors(player, cur_time_);
   }
   Script GetScript() const { return script_; }
@@ -611,7 +655,18 @@ class GameState {
     return ROLE_UNSPECIFIED;
   }
 
-  bool IsRolePossible(int player, Role role, const Time& time) const;
+  // The roles of the script the player may have at a time so far, as a bit
+  // mask. Memoized for every player and time until the next event that can
+  // change it (a new time, a shown token, evil info, a death or a role claim).
+  uint64_t PossibleRoles(int player, const Time& time) const {
+    const auto& masks = role_possibilities_.Get(
+        [this] { return ComputeRolePossibilities(); });
+    DCHECK_LT(time.Index(), masks.size()) << "Time " << time << " not reached";
+    return masks[time.Index()][player];
+  }
+  bool IsRolePossible(int player, Role role, const Time& time) const {
+    return (PossibleRoles(player, time) >> role) & 1;
+  }
   bool IsRolePossible(const string& player, Role role, const Time& time) const {
     return IsRolePossible(PlayerIndex(player), role, time);
   }
@@ -653,6 +708,12 @@ class GameState {
   bool IsKnownStartingMinion(int player) const;
   bool IsKnownEvil(int player) const;
   bool IsKnownDemonBluff(Role role) const;
+  // The possible roles of every player, time step by time step: the
+  // possibilities at a time depend on the earlier ones.
+  vector<vector<uint64_t>> ComputeRolePossibilities() const;
+  bool ComputeIsRolePossible(int player, Role role, const Time& time,
+                             const vector<vector<uint64_t>>& earlier) const;
+  void InvalidateRolePossibilities() { role_possibilities_.Clear(); }
   bool DiedAtNight(int player, const Time& time) const {
     Time death = TimeOfDeath(player);
     return death.Initialized() && death <= time && !death.is_day;
@@ -689,6 +750,7 @@ class GameState {
   vector<vector<Role>> st_day_roles_;  // Player roles, x day.
   vector<vector<Role>> st_shown_tokens_;  // Player shown tokens, x night.
   int st_red_herring_;
+  internal::RolePossibilities role_possibilities_;  // See PossibleRoles.
 };
 }  // namespace botc
 
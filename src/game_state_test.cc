@@ -13,6 +13,8 @@
 
 #include "src/game_state.h"
 
+#include <thread>  // NOLINT [build/c++11]
+
 #include "absl/types/span.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -421,6 +423,95 @@ TEST(IsRolePossible, MinionPerspectiveCatchStarpassNoInfo) {
   EXPECT_TRUE(g.IsRolePossible("P4", IMP, Time::Night(2)));
 }
 
+TEST(IsRolePossible, MinionPerspectiveNoInfo) {
+  GameState g(PLAYER, TROUBLE_BREWING, MakePlayers(5));
+  g.AddNight(1);
+  g.AddShownToken("P1", POISONER);
+  g.AddDay(1);
+  g.AddRoleClaims({MAYOR, SLAYER, MONK, VIRGIN, SOLDIER}, "P1");
+  // Without minion info, any other player may be the Imp.
+  for (auto& p : {"P2", "P3", "P4", "P5"}) {
+    EXPECT_TRUE(g.IsRolePossible(p, IMP, Time::Night(1))) << p;
+  }
+  EXPECT_FALSE(g.IsRolePossible("P1", IMP, Time::Night(1)));
+}
+
+TEST(IsRolePossible, StarpassTokenShownAtNight) {
+  GameState g(PLAYER, TROUBLE_BREWING, MakePlayers(7));
+  g.AddNight(1);
+  g.AddShownToken("P5", POISONER);
+  g.AddMinionInfo("P5", "P1", {});  // P5 Poisoner, P1 Imp
+  g.AddDay(1);
+  g.AddRoleClaims(
+      {SOLDIER, MAYOR, RAVENKEEPER, VIRGIN, UNDERTAKER, SLAYER, MONK}, "P1");
+  g.AddNight(2);
+  g.AddShownToken("P5", IMP);
+  g.AddDay(2);
+  g.AddNightDeath("P1");
+  // The starpass only takes effect the next day.
+  EXPECT_TRUE(g.IsRolePossible("P5", POISONER, Time::Night(2)));
+  EXPECT_TRUE(g.IsRolePossible("P5", IMP, Time::Night(2)));
+  EXPECT_FALSE(g.IsRolePossible("P5", POISONER, Time::Day(2)));
+}
+
+TEST(IsRolePossible, MemoizedUntilNextEvent) {
+  GameState g(PLAYER, TROUBLE_BREWING, MakePlayers(10));
+  g.AddNight(1);
+  g.AddShownToken("P1", SCARLET_WOMAN);
+  g.AddMinionInfo("P1", "P2", {"P3"});
+  g.AddDay(1);
+  g.AddClaimRole("P4", RECLUSE);
+  EXPECT_TRUE(g.IsRolePossible("P2", IMP, Time::Day(1)));
+  EXPECT_FALSE(g.IsRolePossible("P3", IMP, Time::Day(1)));
+  EXPECT_TRUE(g.IsRolePossible("P3", POISONER, Time::Day(1)));
+  EXPECT_FALSE(g.IsRolePossible("P4", POISONER, Time::Day(1)));
+  g.AddNight(2);
+  g.AddShownToken("P1", IMP);
+  g.AddDay(2);
+  EXPECT_FALSE(g.IsRolePossible("P1", IMP, Time::Day(1)));
+  EXPECT_TRUE(g.IsRolePossible("P1", IMP, Time::Day(2)));
+  EXPECT_FALSE(g.IsRolePossible("P2", IMP, Time::Day(2)));
+  const GameState copy = g;
+  g.AddNightDeath("P2");  // Clears the memoized possibilities.
+  EXPECT_TRUE(g.IsRolePossible("P2", IMP, Time::Day(2)));
+  EXPECT_FALSE(g.IsRolePossible("P3", IMP, Time::Day(2)));
+  EXPECT_FALSE(copy.IsRolePossible("P2", IMP, Time::Day(2)));
+}
+
+TEST(IsRolePossible, SharedBetweenThreads) {
+  GameState g(PLAYER, TROUBLE_BREWING, MakePlayers(10));
+  g.AddNight(1);
+  g.AddShownToken("P1", SCARLET_WOMAN);
+  g.AddMinionInfo("P1", "P2", {"P3"});
+  g.AddDay(1);
+  g.AddNight(2);
+  g.AddShownToken("P1", IMP);
+  g.AddDay(2);
+  const GameState expected = g;
+  vector<vector<uint64_t>> masks(4);
+  vector<std::thread> threads;
+  for (int t = 0; t < masks.size(); ++t) {
+    threads.emplace_back([&g, &masks, t] {
+      for (Time time = Time::Night(1); time <= g.CurrentTime(); ++time) {
+        for (int i = 0; i < g.NumPlayers(); ++i) {
+          masks[t].push_back(g.PossibleRoles(i, time));
+        }
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  for (const vector<uint64_t>& thread_masks : masks) {
+    int k = 0;
+    for (Time time = Time::Night(1); time <= g.CurrentTime(); ++time) {
+      for (int i = 0; i < g.NumPlayers(); ++i) {
+        EXPECT_EQ(thread_masks[k++], expected.PossibleRoles(i, time));
+      }
+    }
+  }
+}
+
 TEST(IsRolePossible, DemonPerspective) {
   GameState g(PLAYER, TROUBLE_BREWING, MakePlayers(10));
   g.AddNight(1);
@@ -17,6 +17,7 @@
 #include <chrono>  // NOLINT [build/c++11]
 
 #include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
 #include "src/game_sat_solver.h"
 #include "src/game_state.h"
 #include "src/util.h"
@@ -32,6 +33,28 @@ using std::string;
 ABSL_FLAG(string, game_log, "", "Game log file path.");
 ABSL_FLAG(string, solver_parameters, "", "Solver parameters file path.");
 ABSL_FLAG(string, output_solution, "", "Optional solution output file.");
+ABSL_FLAG(string, model_cache_dir, "",
+          "Optional directory for caching compiled SAT models across runs.");
+ABSL_FLAG(bool, model_stats, false,
+          "Print compile time and model size per part of the SAT model.");
+ABSL_FLAG(bool, preprocess_model, false,
+          "Simplify the compiled SAT model before solving.");
+ABSL_FLAG(bool, base_model_templates, false,
+          "Reuse the SAT model parts shared by games of the same setup.");
+ABSL_FLAG(bool, dense_role_vars, false,
+          "Create a SAT variable for every player, role and time step, even "
+          "for the roles ruled out by the claims and the perspective.");
+ABSL_FLAG(bool, integer_roles, false,
+          "Encode the role of a player at a time step as an integer variable "
+          "over the possible roles.");
+ABSL_FLAG(bool, setup_table, false,
+          "Encode the legal starting setups as a table constraint over the "
+          "roles in play, instead of role counts.");
+ABSL_FLAG(string, export_model, "",
+          "Optional path prefix for exporting the SAT model as DIMACS CNF "
+          "(.cnf) and OPB (.opb), with a variable map (.vars).");
+ABSL_FLAG(bool, cache_stats, false,
+          "Print the SAT model cache statistics and constraint arities.");
 
 namespace botc {
 
@@ -45,10 +68,48 @@ void Run() {
     ReadProtoFromFile(solver_parameters, &request);
   }
 
-  GameSatSolver s(g);
+  ModelOptions options = ModelOptionsForRequest(request);
+  const string model_cache_dir = absl::GetFlag(FLAGS_model_cache_dir);
+  if (!model_cache_dir.empty()) {
+    options.set_model_cache_dir(model_cache_dir);
+  }
+  if (absl::GetFlag(FLAGS_preprocess_model)) {
+    options.set_preprocess_model(true);
+  }
+  if (absl::GetFlag(FLAGS_base_model_templates)) {
+    options.set_use_base_model_templates(true);
+  }
+  if (absl::GetFlag(FLAGS_dense_role_vars)) {
+    options.set_dense_role_vars(true);
+  }
+  if (absl::GetFlag(FLAGS_integer_roles)) {
+    options.set_role_encoding(ModelOptions::INTEGER_ROLES);
+  }
+  if (absl::GetFlag(FLAGS_setup_table)) {
+    options.set_setup_encoding(ModelOptions::SETUP_TABLE);
+  }
+  GameSatSolver s(g, options);
+  if (absl::GetFlag(FLAGS_model_stats)) {
+    cout << "Model stats:\n" << s.GetModelStats() << endl;
+  }
+  if (absl::GetFlag(FLAGS_cache_stats)) {
+    cout << "Cache stats:\n" << s.GetCacheStats(true) << endl;
+  }
+  const string export_model = absl::GetFlag(FLAGS_export_model);
+  if (!export_model.empty()) {
+    const absl::Status st = s.ExportModel(request, export_model);
+    CHECK(st.ok()) << st;
+  }
   steady_clock::time_point begin = steady_clock::now();
-  SolverResponse solution = s.Solve(request);
+  google::protobuf::Arena arena;
+  const auto response = s.Solve(request, &arena);
+  CHECK(response.ok()) << response.status();
+  const SolverResponse& solution = **response;
   steady_clock::time_point end = steady_clock::now();
+  if (absl::GetFlag(FLAGS_model_stats) &&
+      !s.GetPreprocessorStats().passes.empty()) {
+    cout << "Preprocessor stats:\n" << s.GetPreprocessorStats() << endl;
+  }
 
   path output_solution = absl::GetFlag(FLAGS_output_solution);
   if (!output_solution.empty()) {
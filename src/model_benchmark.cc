@@ -0,0 +1,229 @@
+// Copyright 2022 Ola Rozenfeld
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Benchmarks variants of the SAT model (compile time, heap allocations while
+// compiling, model size, solve time) on a directory of game logs, e.g.:
+// bazel-bin/src/model_benchmark --examples_dir=src/examples/tb
+#include <algorithm>
+#include <atomic>
+#include <chrono>  // NOLINT [build/c++11]
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/strings/str_format.h"
+#include "src/game_sat_solver.h"
+#include "src/game_state.h"
+
+using std::chrono::duration;
+using std::chrono::steady_clock;
+using std::cout;
+using std::endl;
+using std::filesystem::directory_iterator;
+using std::filesystem::path;
+using std::string;
+using std::vector;
+
+ABSL_FLAG(string, examples_dir, "src/examples/tb",
+          "Directory of game logs (in text proto format) to benchmark.");
+ABSL_FLAG(int, repetitions, 1,
+          "Number of times to compile and solve every game log per variant.");
+
+// Heap allocations of the binary, counted by the global operator new.
+std::atomic<int64_t> num_allocations = 0;
+
+void* operator new(size_t size) {
+  ++num_allocations;
+  if (void* p = std::malloc(size == 0 ? 1 : size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+namespace botc {
+namespace {
+
+struct Variant {
+  string name;
+  ModelOptions options;
+  SolverRequest request;
+};
+
+vector<Variant> CardinalityEncodingVariants() {
+  vector<Variant> variants;
+  for (auto encoding : {ModelOptions::LINEAR, ModelOptions::SEQUENTIAL_COUNTER,
+                        ModelOptions::TOTALIZER,
+                        ModelOptions::CARDINALITY_NETWORK}) {
+    Variant v = {.name = ModelOptions::CardinalityEncoding_Name(encoding)};
+    v.options.set_cardinality_encoding(encoding);
+    variants.push_back(v);
+  }
+  return variants;
+}
+
+vector<Variant> ConstantFoldingVariants() {
+  Variant v = {.name = "NO_CONSTANT_FOLDING"};
+  v.options.set_disable_constant_folding(true);
+  return {v};
+}
+
+vector<Variant> DenseRoleVarVariants() {
+  Variant v = {.name = "DENSE_ROLE_VARS"};
+  v.options.set_dense_role_vars(true);
+  return {v};
+}
+
+vector<Variant> RoleEncodingVariants() {
+  Variant v = {.name = "INTEGER_ROLES"};
+  v.options.set_role_encoding(ModelOptions::INTEGER_ROLES);
+  return {v};
+}
+
+vector<Variant> SetupEncodingVariants() {
+  Variant table = {.name = "SETUP_TABLE"};
+  table.options.set_setup_encoding(ModelOptions::SETUP_TABLE);
+  Variant skip_catalog = {.name = "SKIP_SETUP_CATALOG"};
+  skip_catalog.options.add_variants(ModelOptions::SKIP_SETUP_CATALOG);
+  return {table, skip_catalog};
+}
+
+vector<Variant> DecisionStrategyVariants() {
+  Variant default_search = {.name = "DEFAULT_SEARCH"};
+  default_search.request.set_default_search(true);
+  Variant setup_search = {.name = "SETUP_SEARCH"};
+  for (auto stage : {SolverRequest::STARTING_DEMON,
+                     SolverRequest::STARTING_MINIONS,
+                     SolverRequest::STARTING_MISREGISTERING_ROLES,
+                     SolverRequest::POISONER_PICKS}) {
+    setup_search.request.add_decision_strategy(stage);
+  }
+  return {default_search, setup_search};
+}
+
+vector<Variant> BaseModelTemplateVariants() {
+  Variant v = {.name = "BASE_MODEL_TEMPLATES"};
+  v.options.set_use_base_model_templates(true);
+  return {v};
+}
+
+struct Result {
+  double compile_time = 0;  // In seconds, averaged over repetitions.
+  double solve_time = 0;
+  int64_t compile_allocations = 0;
+  ModelStats::Phase model_size;
+  int worlds = 0;
+};
+
+Result RunVariant(const GameState& g, const Variant& variant,
+                  int repetitions) {
+  Result result;
+  for (int i = 0; i < repetitions; ++i) {
+    const int64_t allocations = num_allocations;
+    steady_clock::time_point begin = steady_clock::now();
+    GameSatSolver s(g, variant.options);
+    steady_clock::time_point compiled = steady_clock::now();
+    result.compile_allocations += num_allocations - allocations;
+    google::protobuf::Arena arena;
+    const auto response = s.Solve(variant.request, &arena);
+    CHECK(response.ok()) << response.status();
+    result.worlds = (*response)->worlds_size();
+    steady_clock::time_point end = steady_clock::now();
+    result.compile_time += duration<double>(compiled - begin).count();
+    result.solve_time += duration<double>(end - compiled).count();
+    result.model_size = ModelStats::Phase();
+    for (const auto& p : s.GetModelStats().phases) {
+      result.model_size.variables += p.variables;
+      result.model_size.constraints += p.constraints;
+      result.model_size.literals += p.literals;
+    }
+  }
+  result.compile_time /= repetitions;
+  result.solve_time /= repetitions;
+  result.compile_allocations /= repetitions;
+  return result;
+}
+
+void RunBenchmark() {
+  const int repetitions = absl::GetFlag(FLAGS_repetitions);
+  vector<path> game_logs;
+  for (const auto& entry :
+       directory_iterator(absl::GetFlag(FLAGS_examples_dir))) {
+    if (entry.path().extension() == ".pbtxt") {
+      game_logs.push_back(entry.path());
+    }
+  }
+  std::sort(game_logs.begin(), game_logs.end());
+  vector<Variant> variants = CardinalityEncodingVariants();
+  for (const Variant& v : ConstantFoldingVariants()) {
+    variants.push_back(v);
+  }
+  for (const Variant& v : DenseRoleVarVariants()) {
+    variants.push_back(v);
+  }
+  for (const Variant& v : BaseModelTemplateVariants()) {
+    variants.push_back(v);
+  }
+  for (const Variant& v : RoleEncodingVariants()) {
+    variants.push_back(v);
+  }
+  for (const Variant& v : SetupEncodingVariants()) {
+    variants.push_back(v);
+  }
+  for (const Variant& v : DecisionStrategyVariants()) {
+    variants.push_back(v);
+  }
+  vector<string> rows;
+  for (const path& game_log : game_logs) {
+    GameState g = GameState::ReadFromFile(game_log);
+    int worlds = -1;
+    for (const Variant& v : variants) {
+      const Result r = RunVariant(g, v, repetitions);
+      rows.push_back(absl::StrFormat(
+          "%-24s %-12s %-20s %12.3f %10d %12.3f %10d %12d %10d %8d%s",
+          game_log.filename().string(), Perspective_Name(g.GetPerspective()),
+          v.name, r.compile_time * 1000,
+          r.compile_allocations, r.solve_time * 1000, r.model_size.variables,
+          r.model_size.constraints, r.model_size.literals, r.worlds,
+          worlds >= 0 && worlds != r.worlds ? " MISMATCH" : ""));
+      if (worlds < 0) {
+        worlds = r.worlds;
+      }
+    }
+  }
+  cout << absl::StrFormat(
+      "%-24s %-12s %-20s %12s %10s %12s %10s %12s %10s %8s\n", "Game",
+      "Perspective", "Variant", "Compile[ms]", "Allocs", "Solve[ms]",
+      "Variables", "Constraints", "Literals", "Worlds");
+  for (const string& row : rows) {
+    cout << row << endl;
+  }
+}
+
+}  // namespace
+}  // namespace botc
+
+int main(int argc, char** argv) {
+  absl::ParseCommandLine(argc, argv);
+  botc::RunBenchmark();
+  return 0;
+}
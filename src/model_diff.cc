@@ -0,0 +1,246 @@
+// Copyright 2022 Ola Rozenfeld
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/model_diff.h"
+
+#include <algorithm>
+#include <array>
+#include <utility>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/str_join.h"
+#include "ortools/sat/cp_model.pb.h"
+#include "ortools/sat/cp_model_utils.h"
+
+namespace botc {
+namespace {
+using operations_research::sat::ConstraintProto;
+using operations_research::sat::PositiveRef;
+using operations_research::sat::RefIsPositive;
+
+// A model with its variable keys and the tag source of every constraint.
+struct KeyedModel {
+  const CpModelProto& model;
+  vector<VarKey> keys;
+  vector<string> sources;
+
+  explicit KeyedModel(const ModelWrapper& wrapper)
+      : model(wrapper.Model().Build()), keys(wrapper.VarKeys()),
+        sources(model.constraints_size()) {
+    for (const ConstraintTagRange& range : wrapper.GetConstraintTags()) {
+      for (int i = range.begin; i < range.end; ++i) {
+        sources[i] = range.tag.source;
+      }
+    }
+  }
+
+  string Literal(int ref) const {
+    const VarKey& key = keys[PositiveRef(ref)];
+    const string& name = key.name.empty() ? key.family : key.name;
+    return RefIsPositive(ref) ? name : absl::StrCat("Not(", name, ")");
+  }
+
+  string Literals(absl::Span<const int> refs) const {
+    vector<string> literals;
+    for (int ref : refs) {
+      literals.push_back(Literal(ref));
+    }
+    std::sort(literals.begin(), literals.end());
+    return absl::StrJoin(literals, ", ");
+  }
+
+  // Returns the canonical form of a constraint.
+  string Constraint(const ConstraintProto& c) const {
+    string body;
+    switch (c.constraint_case()) {
+      case ConstraintProto::kBoolOr:
+        body = absl::StrCat("Or(", Literals(c.bool_or().literals()), ")");
+        break;
+      case ConstraintProto::kBoolAnd:
+        body = absl::StrCat("And(", Literals(c.bool_and().literals()), ")");
+        break;
+      case ConstraintProto::kAtMostOne:
+        body = absl::StrCat(
+            "AtMostOne(", Literals(c.at_most_one().literals()), ")");
+        break;
+      case ConstraintProto::kExactlyOne:
+        body = absl::StrCat(
+            "ExactlyOne(", Literals(c.exactly_one().literals()), ")");
+        break;
+      case ConstraintProto::kLinear: {
+        vector<string> terms;
+        for (int i = 0; i < c.linear().vars_size(); ++i) {
+          terms.push_back(absl::StrCat(c.linear().coeffs(i), "*",
+                                       Literal(c.linear().vars(i))));
+        }
+        std::sort(terms.begin(), terms.end());
+        body = absl::StrFormat("Linear(%s in [%s])",
+                               absl::StrJoin(terms, " + "),
+                               absl::StrJoin(c.linear().domain(), ", "));
+        break;
+      }
+      case ConstraintProto::kTable: {
+        vector<string> vars;
+        for (int var : c.table().vars()) {
+          vars.push_back(Literal(var));
+        }
+        body = absl::StrFormat("Table(%s in %d tuples)",
+                               absl::StrJoin(vars, ", "),
+                               c.table().values_size() /
+                                   std::max(1, c.table().vars_size()));
+        break;
+      }
+      default:
+        body = absl::StrCat("Constraint", c.constraint_case());
+    }
+    if (c.enforcement_literal_size() == 0) {
+      return body;
+    }
+    return absl::StrCat(Literals(c.enforcement_literal()), " -> ", body);
+  }
+};
+
+int Arity(const ConstraintProto& c) {
+  int result = c.enforcement_literal_size();
+  switch (c.constraint_case()) {
+    case ConstraintProto::kBoolOr:
+      return result + c.bool_or().literals_size();
+    case ConstraintProto::kBoolAnd:
+      return result + c.bool_and().literals_size();
+    case ConstraintProto::kAtMostOne:
+      return result + c.at_most_one().literals_size();
+    case ConstraintProto::kExactlyOne:
+      return result + c.exactly_one().literals_size();
+    case ConstraintProto::kLinear:
+      return result + c.linear().vars_size();
+    case ConstraintProto::kTable:
+      return result + c.table().vars_size();
+    default:
+      return result;
+  }
+}
+
+// Derived variable names nest, so long constraints are shortened.
+string Example(const string& constraint) {
+  constexpr int kMaxLength = 240;
+  if (constraint.size() <= kMaxLength) {
+    return constraint;
+  }
+  return absl::StrCat(constraint.substr(0, kMaxLength), "...");
+}
+
+bool IsFixed(const CpModelProto& model, int var) {
+  const auto& domain = model.variables(var).domain();
+  return domain.size() == 2 && domain[0] == domain[1];
+}
+}  // namespace
+
+ModelDiff DiffModels(const ModelWrapper& a, const ModelWrapper& b,
+                     int max_examples) {
+  ModelDiff diff;
+  const KeyedModel models[2] = {KeyedModel(a), KeyedModel(b)};
+  // The families and the counts in a and b of every variable key.
+  absl::flat_hash_map<pair<string, string>, std::array<int, 2>> vars;
+  // The tag sources in a and b of every canonical constraint.
+  absl::flat_hash_map<string, std::array<vector<string>, 2>> constraints;
+  for (int m = 0; m < 2; ++m) {
+    const KeyedModel& model = models[m];
+    for (int i = 0; i < model.keys.size(); ++i) {
+      const VarKey& key = model.keys[i];
+      ++vars[{key.family, key.name}][m];
+      if (key.family != "Constant" && IsFixed(model.model, i)) {
+        ++(m == 0 ? diff.fixed_literals.a : diff.fixed_literals.b);
+      }
+    }
+    for (int i = 0; i < model.model.constraints_size(); ++i) {
+      const ConstraintProto& c = model.model.constraints(i);
+      constraints[model.Constraint(c)][m].push_back(model.sources[i]);
+      auto& count = diff.constraint_arity[Arity(c)];
+      ++(m == 0 ? count.a : count.b);
+    }
+  }
+  for (const auto& [key, counts] : vars) {
+    if (counts[1] > counts[0]) {
+      diff.variables[key.first].added += counts[1] - counts[0];
+    } else if (counts[0] > counts[1]) {
+      diff.variables[key.first].removed += counts[0] - counts[1];
+    }
+  }
+  // Sorted, so that the examples do not depend on the hash order.
+  vector<const string*> keys;
+  for (const auto& it : constraints) {
+    keys.push_back(&it.first);
+  }
+  std::sort(keys.begin(), keys.end(),
+            [](const string* x, const string* y) { return *x < *y; });
+  for (const string* key : keys) {
+    const auto& sources = constraints[*key];
+    // The extra copies are attributed to the last sources that added them.
+    for (int i = sources[1].size(); i < sources[0].size(); ++i) {
+      ++diff.constraints[sources[0][i]].removed;
+      if (diff.removed_constraints.size() < max_examples) {
+        diff.removed_constraints.push_back(Example(*key));
+      }
+    }
+    for (int i = sources[0].size(); i < sources[1].size(); ++i) {
+      ++diff.constraints[sources[1][i]].added;
+      if (diff.added_constraints.size() < max_examples) {
+        diff.added_constraints.push_back(Example(*key));
+      }
+    }
+  }
+  for (auto it = diff.constraint_arity.begin();
+       it != diff.constraint_arity.end();) {
+    if (it->second.a == it->second.b) {
+      it = diff.constraint_arity.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  return diff;
+}
+
+ostream& operator<<(ostream& os, const ModelDiff& diff) {
+  if (diff.Empty()) {
+    return os << "The models are the same\n";
+  }
+  os << absl::StrFormat("%-32s %10s %10s\n", "Variables", "Added", "Removed");
+  for (const auto& [family, change] : diff.variables) {
+    os << absl::StrFormat("%-32s %10d %10d\n", family, change.added,
+                          change.removed);
+  }
+  os << absl::StrFormat("%-32s %10s %10s\n", "Constraints", "Added",
+                        "Removed");
+  for (const auto& [source, change] : diff.constraints) {
+    os << absl::StrFormat("%-32s %10d %10d\n",
+                          source.empty() ? "<untagged>" : source,
+                          change.added, change.removed);
+  }
+  os << absl::StrFormat("%-32s %10s %10s\n", "Constraint arity", "A", "B");
+  for (const auto& [arity, count] : diff.constraint_arity) {
+    os << absl::StrFormat("%-32d %10d %10d\n", arity, count.a, count.b);
+  }
+  os << absl::StrFormat("Fixed literals: %d -> %d\n", diff.fixed_literals.a,
+                        diff.fixed_literals.b);
+  for (const string& c : diff.added_constraints) {
+    os << "+ " << c << "\n";
+  }
+  for (const string& c : diff.removed_constraints) {
+    os << "- " << c << "\n";
+  }
+  return os;
+}
+
+}  // namespace botc
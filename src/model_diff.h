@@ -0,0 +1,69 @@
+// Copyright 2022 Ola Rozenfeld
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MODEL_DIFF_H_
+#define SRC_MODEL_DIFF_H_
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "src/model_wrapper.h"
+
+namespace botc {
+
+using std::map;
+using std::ostream;
+using std::string;
+using std::vector;
+
+// Differences between two compiled models of the same game, from model a to
+// model b.
+struct ModelDiff {
+  struct Change {
+    int added = 0;  // In b, but not in a.
+    int removed = 0;  // In a, but not in b.
+  };
+  struct Count {
+    int a = 0;
+    int b = 0;
+  };
+  map<string, Change> variables;  // By variable family (see VarKey).
+  map<string, Change> constraints;  // By constraint tag source.
+  map<int, Count> constraint_arity;  // Number of constraints by arity.
+  Count fixed_literals;  // Variables with a fixed value, except constants.
+  // Up to max_examples of the added and removed constraints, as (shortened)
+  // text.
+  vector<string> added_constraints;
+  vector<string> removed_constraints;
+
+  bool Empty() const {
+    return variables.empty() && constraints.empty() &&
+           fixed_literals.a == fixed_literals.b;
+  }
+};
+ostream& operator<<(ostream& os, const ModelDiff& diff);
+
+// Compares two models by the stable keys of their variables (see
+// ModelWrapper::VarKeys), so that the variable indices do not matter.
+// Constraints are compared as multisets of their canonical forms: the kind,
+// the sorted literal keys and the constants. Auxiliary variables of
+// cardinality encodings have no stable keys, so the constraints on them only
+// match by their shape.
+ModelDiff DiffModels(const ModelWrapper& a, const ModelWrapper& b,
+                     int max_examples = 10);
+
+}  // namespace botc
+
+#endif  // SRC_MODEL_DIFF_H_
@@ -0,0 +1,66 @@
+// Copyright 2022 Ola Rozenfeld
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Compiles a game log with two sets of model options and prints the
+// differences between the two SAT models, e.g.:
+// bazel-bin/src/model_diff --game_log=src/examples/tb/virgin.pbtxt
+//   --options_b="cardinality_encoding: TOTALIZER"
+#include <iostream>
+#include <string>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "google/protobuf/text_format.h"
+#include "ortools/base/logging.h"
+#include "src/game_sat_solver.h"
+#include "src/game_state.h"
+#include "src/model_diff.h"
+
+using std::cout;
+using std::string;
+
+ABSL_FLAG(string, game_log, "", "Game log file path (in text proto format).");
+ABSL_FLAG(string, options_a, "",
+          "Model options of the first model, in text proto format.");
+ABSL_FLAG(string, options_b, "",
+          "Model options of the second model, in text proto format.");
+ABSL_FLAG(int, max_examples, 10,
+          "Number of added and removed constraints to print.");
+
+namespace botc {
+
+ModelOptions ParseModelOptions(const string& text) {
+  ModelOptions options;
+  CHECK(google::protobuf::TextFormat::ParseFromString(text, &options))
+      << "Invalid model options: " << text;
+  return options;
+}
+
+void Run() {
+  const string game_log = absl::GetFlag(FLAGS_game_log);
+  CHECK(!game_log.empty()) << "Set --game_log to a valid path";
+  const GameState g = GameState::ReadFromFile(game_log);
+  GameSatSolver a(g, ParseModelOptions(absl::GetFlag(FLAGS_options_a)));
+  GameSatSolver b(g, ParseModelOptions(absl::GetFlag(FLAGS_options_b)));
+  cout << DiffModels(a.GetModel(), b.GetModel(),
+                     absl::GetFlag(FLAGS_max_examples));
+}
+
+}  // namespace botc
+
+int main(int argc, char** argv) {
+  absl::ParseCommandLine(argc, argv);
+  botc::Run();
+  return 0;
+}
@@ -0,0 +1,71 @@
+// Copyright 2022 Ola Rozenfeld
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/model_diff.h"
+
+#include "absl/strings/str_cat.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace botc {
+
+int NewFamily(ModelWrapper* model) {
+  return model->NewVarFamily("f", {3}, [](absl::Span<const int> key) {
+    return absl::StrCat("f", key[0]);
+  });
+}
+
+TEST(ModelDiff, MatchesVariablesByKey) {
+  // The same model, with the variables created in a different order.
+  ModelWrapper a(false), b(false);
+  const int fa = NewFamily(&a), fb = NewFamily(&b);
+  a.SetConstraintTag({.source = "x"});
+  a.AddOr({a.FamilyVar(fa, {0}), Not(a.FamilyVar(fa, {1})), a.NewVar("y")});
+  b.SetConstraintTag({.source = "x"});
+  const BoolVar y = b.NewVar("y"), f1 = b.FamilyVar(fb, {1});
+  b.AddOr({y, b.FamilyVar(fb, {0}), Not(f1)});
+  const ModelDiff diff = DiffModels(a, b);
+  EXPECT_TRUE(diff.Empty()) << diff;
+}
+
+TEST(ModelDiff, ReportsChangesBySource) {
+  ModelWrapper a(false), b(false);
+  const int fa = NewFamily(&a), fb = NewFamily(&b);
+  a.SetConstraintTag({.source = "x"});
+  a.AddOr({a.FamilyVar(fa, {0}), a.FamilyVar(fa, {1})});
+  a.AddImplication(a.FamilyVar(fa, {0}), a.FamilyVar(fa, {1}));
+  b.SetConstraintTag({.source = "x"});
+  b.AddOr({b.FamilyVar(fb, {0}), b.FamilyVar(fb, {1})});
+  b.SetConstraintTag({.source = "z"});
+  b.AddAtMostOne({b.FamilyVar(fb, {0}), b.FamilyVar(fb, {1}),
+                  b.FamilyVar(fb, {2})});
+  b.FixVariable(b.FamilyVar(fb, {2}), false);
+  const ModelDiff diff = DiffModels(a, b);
+  EXPECT_EQ(diff.variables.at("f").added, 1);
+  EXPECT_EQ(diff.variables.at("f").removed, 0);
+  EXPECT_EQ(diff.constraints.at("x").removed, 1);
+  EXPECT_EQ(diff.constraints.at("z").added, 1);
+  EXPECT_EQ(diff.constraint_arity.at(3).b, 1);
+  EXPECT_EQ(diff.fixed_literals.a, 0);
+  EXPECT_EQ(diff.fixed_literals.b, 1);
+  EXPECT_THAT(diff.added_constraints,
+              testing::ElementsAre("AtMostOne(f0, f1, f2)"));
+  EXPECT_THAT(diff.removed_constraints,
+              testing::ElementsAre("Or(Not(f0), f1)"));
+}
+}  // namespace botc
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
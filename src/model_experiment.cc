@@ -0,0 +1,153 @@
+// Copyright 2022 Ola Rozenfeld
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/model_experiment.h"
+
+#include <algorithm>
+#include <chrono>  // NOLINT [build/c++11]
+#include <cmath>
+#include <map>
+#include <numeric>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/str_join.h"
+#include "ortools/base/logging.h"
+#include "src/game_sat_solver.h"
+
+namespace botc {
+namespace {
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+// Returns the worlds of a response in a canonical order, as text.
+// The worlds are projected on the current roles, so the starting roles of a
+// world are only one representative, which may differ between the arms.
+vector<string> WorldKeys(const SolverResponse& response) {
+  vector<string> keys;
+  for (const auto& world : response.worlds()) {
+    // Protobuf maps have no defined order.
+    const std::map<string, Role> current(world.current_roles().begin(),
+                                         world.current_roles().end());
+    string key;
+    for (const auto& [player, role] : current) {
+      absl::StrAppend(&key, player, ":", Role_Name(role), " ");
+    }
+    keys.push_back(key);
+  }
+  std::sort(keys.begin(), keys.end());
+  return keys;
+}
+}  // namespace
+
+vector<ExperimentArm> ExperimentArms(const ModelExperiment& experiment) {
+  const int num_factors = experiment.factors_size();
+  CHECK_LT(num_factors, 16) << "Too many factors for a full factorial";
+  vector<ExperimentArm> arms;
+  for (int mask = 0; mask < (1 << num_factors); ++mask) {
+    ExperimentArm arm = {.request = experiment.request()};
+    vector<string> names;
+    for (int i = 0; i < num_factors; ++i) {
+      if (mask & (1 << i)) {
+        const auto& factor = experiment.factors(i);
+        names.push_back(factor.name());
+        arm.request.MergeFrom(factor.request());
+      }
+    }
+    arm.name = names.empty() ? "baseline" : absl::StrJoin(names, "+");
+    arms.push_back(arm);
+  }
+  return arms;
+}
+
+TimeDistribution GetTimeDistribution(vector<double> times) {
+  TimeDistribution d;
+  if (times.empty()) {
+    return d;
+  }
+  std::sort(times.begin(), times.end());
+  const int n = times.size();
+  d.min = times.front();
+  d.max = times.back();
+  d.median = n % 2 == 1 ? times[n / 2] : (times[n / 2 - 1] + times[n / 2]) / 2;
+  d.mean = std::accumulate(times.begin(), times.end(), 0.0) / n;
+  // Nearest rank.
+  d.p90 = times[std::max(0, static_cast<int>(std::ceil(0.9 * n)) - 1)];
+  return d;
+}
+
+ExperimentResults RunExperiment(
+    absl::Span<const pair<string, GameState>> games,
+    absl::Span<const ExperimentArm> arms, int trials) {
+  ExperimentResults results;
+  for (const auto& [name, g] : games) {
+    const int first = results.results.size();
+    for (const ExperimentArm& arm : arms) {
+      results.results.push_back({.game = name, .arm = arm.name});
+    }
+    vector<vector<string>> worlds(arms.size());
+    for (int trial = 0; trial < trials; ++trial) {
+      for (int i = 0; i < arms.size(); ++i) {
+        ArmResult& result = results.results[first + i];
+        steady_clock::time_point begin = steady_clock::now();
+        GameSatSolver s(g, ModelOptionsForRequest(arms[i].request));
+        steady_clock::time_point compiled = steady_clock::now();
+        google::protobuf::Arena arena;
+        const auto response = s.Solve(arms[i].request, &arena);
+        CHECK(response.ok()) << arms[i].name << ": " << response.status();
+        steady_clock::time_point end = steady_clock::now();
+        result.compile_times.push_back(
+            duration<double>(compiled - begin).count());
+        result.solve_times.push_back(duration<double>(end - compiled).count());
+        vector<string> keys = WorldKeys(**response);
+        if (trial == 0) {
+          result.worlds = keys.size();
+          worlds[i] = std::move(keys);
+        } else if (keys != worlds[i]) {
+          result.same_worlds = false;
+        }
+      }
+    }
+    for (int i = 1; i < arms.size(); ++i) {
+      if (worlds[i] != worlds[0]) {
+        results.results[first + i].same_worlds = false;
+      }
+    }
+  }
+  return results;
+}
+
+ostream& operator<<(ostream& os, const ExperimentResults& results) {
+  int game_width = 4, arm_width = 3;
+  for (const ArmResult& r : results.results) {
+    game_width = std::max(game_width, static_cast<int>(r.game.size()));
+    arm_width = std::max(arm_width, static_cast<int>(r.arm.size()));
+  }
+  os << absl::StrFormat("%-*s %-*s %12s %10s %10s %10s %10s %10s %8s %s\n",
+                        game_width, "Game", arm_width, "Arm", "Compile[ms]",
+                        "Solve[ms]", "min", "mean", "p90", "max", "Worlds",
+                        "Check");
+  for (const ArmResult& r : results.results) {
+    const TimeDistribution compile = GetTimeDistribution(r.compile_times);
+    const TimeDistribution solve = GetTimeDistribution(r.solve_times);
+    os << absl::StrFormat(
+        "%-*s %-*s %12.3f %10.3f %10.3f %10.3f %10.3f %10.3f %8d %s\n",
+        game_width, r.game, arm_width, r.arm, compile.median * 1000,
+        solve.median * 1000, solve.min * 1000, solve.mean * 1000,
+        solve.p90 * 1000, solve.max * 1000, r.worlds,
+        r.same_worlds ? "ok" : "WORLDS DIFFER");
+  }
+  return os;
+}
+
+}  // namespace botc
@@ -0,0 +1,79 @@
+// Copyright 2022 Ola Rozenfeld
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MODEL_EXPERIMENT_H_
+#define SRC_MODEL_EXPERIMENT_H_
+
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "src/game_state.h"
+#include "src/solver.pb.h"
+
+namespace botc {
+
+using std::ostream;
+using std::pair;
+using std::string;
+using std::vector;
+
+// A combination of the factors of an experiment being on or off.
+struct ExperimentArm {
+  string name;  // The names of the factors that are on, or "baseline".
+  // The base request, merged with the requests of the factors that are on.
+  SolverRequest request;
+};
+
+// Returns all the combinations of the experiment factors, the baseline (all
+// factors off) first.
+vector<ExperimentArm> ExperimentArms(const ModelExperiment& experiment);
+
+// Summary statistics of a sample of times, in seconds.
+struct TimeDistribution {
+  double min = 0;
+  double median = 0;
+  double mean = 0;
+  double p90 = 0;
+  double max = 0;
+};
+TimeDistribution GetTimeDistribution(vector<double> times);
+
+struct ArmResult {
+  string game;
+  string arm;
+  vector<double> compile_times;  // In seconds, one per trial.
+  vector<double> solve_times;
+  int worlds = 0;
+  // Whether the arm found the same worlds as the baseline on this game, and
+  // the same worlds in every trial.
+  bool same_worlds = true;
+};
+
+struct ExperimentResults {
+  vector<ArmResult> results;  // By game, then by arm.
+};
+ostream& operator<<(ostream& os, const ExperimentResults& results);
+
+// Compiles and solves every game with every arm, trials times. The arms are
+// interleaved within every trial, so that a drift of the machine load affects
+// all the arms alike.
+ExperimentResults RunExperiment(
+    absl::Span<const pair<string, GameState>> games,
+    absl::Span<const ExperimentArm> arms, int trials);
+
+}  // namespace botc
+
+#endif  // SRC_MODEL_EXPERIMENT_H_
@@ -0,0 +1,78 @@
+// Copyright 2022 Ola Rozenfeld
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Runs a model experiment (every combination of its factors, see
+// ModelExperiment in solver.proto) on a directory of game logs, and prints
+// the compile and solve time distributions of every combination, e.g.:
+// bazel-bin/src/model_experiment --examples_dir=src/examples/tb
+//   --experiment=src/examples/experiments/setup_encoding.pbtxt
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "ortools/base/logging.h"
+#include "src/game_state.h"
+#include "src/model_experiment.h"
+#include "src/util.h"
+
+using std::cout;
+using std::filesystem::directory_iterator;
+using std::filesystem::path;
+using std::pair;
+using std::string;
+using std::vector;
+
+ABSL_FLAG(string, examples_dir, "src/examples/tb",
+          "Directory of game logs (in text proto format) to run on.");
+ABSL_FLAG(string, experiment, "",
+          "Experiment file path (a ModelExperiment in text proto format).");
+ABSL_FLAG(int, trials, 5,
+          "Number of times to compile and solve every game log per "
+          "combination of the factors.");
+
+namespace botc {
+
+void Run() {
+  const string experiment_path = absl::GetFlag(FLAGS_experiment);
+  CHECK(!experiment_path.empty()) << "Set --experiment to a valid path";
+  ModelExperiment experiment;
+  ReadProtoFromFile(experiment_path, &experiment);
+  vector<path> game_logs;
+  for (const auto& entry :
+       directory_iterator(absl::GetFlag(FLAGS_examples_dir))) {
+    if (entry.path().extension() == ".pbtxt") {
+      game_logs.push_back(entry.path());
+    }
+  }
+  std::sort(game_logs.begin(), game_logs.end());
+  vector<pair<string, GameState>> games;
+  for (const path& game_log : game_logs) {
+    games.emplace_back(game_log.filename().string(),
+                       GameState::ReadFromFile(game_log));
+  }
+  cout << RunExperiment(games, ExperimentArms(experiment),
+                        absl::GetFlag(FLAGS_trials));
+}
+
+}  // namespace botc
+
+int main(int argc, char** argv) {
+  absl::ParseCommandLine(argc, argv);
+  botc::Run();
+  return 0;
+}
@@ -0,0 +1,88 @@
+// Copyright 2022 Ola Rozenfeld
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/model_experiment.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace botc {
+
+using testing::ElementsAre;
+
+TEST(ModelExperiment, EnumeratesAllCombinations) {
+  ModelExperiment experiment;
+  experiment.mutable_request()->set_default_search(true);
+  auto* factor = experiment.add_factors();
+  factor->set_name("a");
+  factor->mutable_request()->mutable_model_options()->add_variants(
+      ModelOptions::SKIP_SETUP_CATALOG);
+  factor = experiment.add_factors();
+  factor->set_name("b");
+  factor->mutable_request()->set_sat_parameters("symmetry_level: 2");
+  const vector<ExperimentArm> arms = ExperimentArms(experiment);
+  vector<string> names;
+  for (const auto& arm : arms) {
+    names.push_back(arm.name);
+    EXPECT_TRUE(arm.request.default_search()) << arm.name;
+  }
+  EXPECT_THAT(names, ElementsAre("baseline", "a", "b", "a+b"));
+  EXPECT_EQ(arms[0].request.model_options().variants_size(), 0);
+  EXPECT_EQ(arms[0].request.sat_parameters(), "");
+  EXPECT_EQ(arms[3].request.model_options().variants_size(), 1);
+  EXPECT_EQ(arms[3].request.sat_parameters(), "symmetry_level: 2");
+}
+
+TEST(ModelExperiment, ComputesTimeDistribution) {
+  const TimeDistribution d = GetTimeDistribution(
+      {5, 1, 3, 2, 4, 10, 6, 7, 9, 8});
+  EXPECT_EQ(d.min, 1);
+  EXPECT_EQ(d.max, 10);
+  EXPECT_EQ(d.median, 5.5);
+  EXPECT_EQ(d.mean, 5.5);
+  EXPECT_EQ(d.p90, 9);
+}
+
+TEST(ModelExperiment, ComparesWorldsToBaseline) {
+  GameState g(OBSERVER, TROUBLE_BREWING, {"P1", "P2", "P3", "P4", "P5"});
+  g.AddNight(1);
+  g.AddDay(1);
+  g.AddRoleClaims({CHEF, MAYOR, VIRGIN, SLAYER, RECLUSE}, "P1");
+  g.AddClaimRoleAction("P1", g.NewChefInfo(0));
+  ExperimentArm baseline = {.name = "baseline"};
+  ExperimentArm skip = {.name = "skip"};
+  skip.request.mutable_model_options()->add_variants(
+      ModelOptions::SKIP_SETUP_CATALOG);
+  ExperimentArm no_chef = {.name = "no_chef"};
+  no_chef.request.mutable_model_options()->add_disabled_phases("CHEF");
+  const vector<pair<string, GameState>> games = {{"chef", g}};
+  const ExperimentResults results =
+      RunExperiment(games, {baseline, skip, no_chef}, 2);
+  ASSERT_EQ(results.results.size(), 3);
+  for (const ArmResult& r : results.results) {
+    EXPECT_EQ(r.game, "chef");
+    EXPECT_EQ(r.compile_times.size(), 2);
+    EXPECT_EQ(r.solve_times.size(), 2);
+  }
+  EXPECT_TRUE(results.results[1].same_worlds);
+  EXPECT_EQ(results.results[1].worlds, results.results[0].worlds);
+  // Without the Chef constraints, the Chef number is ignored.
+  EXPECT_FALSE(results.results[2].same_worlds);
+  EXPECT_GT(results.results[2].worlds, results.results[0].worlds);
+}
+}  // namespace botc
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,369 @@
+// Copyright 2022 Ola Rozenfeld
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/model_export.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/str_join.h"
+#include "ortools/base/logging.h"
+#include "ortools/sat/cp_model.pb.h"
+#include "ortools/sat/cp_model_utils.h"
+
+namespace botc {
+namespace {
+using operations_research::sat::ConstraintProto;
+using operations_research::sat::NegatedRef;
+using operations_research::sat::PositiveRef;
+using operations_research::sat::RefIsPositive;
+using std::string;
+using std::vector;
+
+// A constraint enforcement -> lo <= Sum(literals) <= hi, over model literals,
+// where the sum may also not take the excluded values (from multi-interval
+// domains, e.g. Sum(literals) != k).
+struct Cardinality {
+  vector<int> enforcement;
+  vector<int> literals;
+  int lo = 0;
+  int hi = 0;
+  vector<int> excluded;
+};
+
+// Returns the constraints of the model (including fixed variables and the
+// assumptions) as cardinality constraints, with lo and hi clipped to the
+// number of literals.
+vector<Cardinality> Cardinalities(const CpModelProto& model,
+                                  absl::Span<const int> assumptions) {
+  vector<Cardinality> result;
+  for (int i = 0; i < model.variables_size(); ++i) {
+    const auto& domain = model.variables(i).domain();
+    CHECK(domain.size() == 2 && domain[0] >= 0 && domain[1] <= 1)
+        << "Only Boolean variables can be exported";
+    if (domain[0] == domain[1]) {
+      result.push_back({.literals = {domain[0] == 1 ? i : NegatedRef(i)},
+                        .lo = 1, .hi = 1});
+    }
+  }
+  for (int ref : assumptions) {
+    result.push_back({.literals = {ref}, .lo = 1, .hi = 1});
+  }
+  for (const ConstraintProto& c : model.constraints()) {
+    Cardinality card = {.enforcement = {c.enforcement_literal().begin(),
+                                        c.enforcement_literal().end()}};
+    auto set_literals = [&card](const auto& literals, int lo, int hi) {
+      card.literals.assign(literals.begin(), literals.end());
+      card.lo = lo;
+      card.hi = hi;
+    };
+    switch (c.constraint_case()) {
+      case ConstraintProto::kBoolOr:
+        set_literals(c.bool_or().literals(), 1, c.bool_or().literals_size());
+        break;
+      case ConstraintProto::kBoolAnd:
+        set_literals(c.bool_and().literals(), c.bool_and().literals_size(),
+                     c.bool_and().literals_size());
+        break;
+      case ConstraintProto::kAtMostOne:
+        set_literals(c.at_most_one().literals(), 0, 1);
+        break;
+      case ConstraintProto::kExactlyOne:
+        set_literals(c.exactly_one().literals(), 1, 1);
+        break;
+      case ConstraintProto::kLinear: {
+        const auto& linear = c.linear();
+        // Sum(x) - Sum(y) = Sum(x) + Sum(Not(y)) - |y|.
+        int64_t shift = 0;
+        for (int i = 0; i < linear.vars_size(); ++i) {
+          const int ref = linear.vars(i);
+          const int64_t coeff = linear.coeffs(i);
+          CHECK(coeff == 1 || coeff == -1)
+              << "Only coefficients +-1 can be exported";
+          card.literals.push_back(coeff == 1 ? ref : NegatedRef(ref));
+          shift += coeff == -1;
+        }
+        const int64_t n = card.literals.size();
+        auto clip = [n, shift](int64_t value) {
+          if (value <= std::numeric_limits<int64_t>::min() + n ||
+              value >= std::numeric_limits<int64_t>::max() - n) {
+            return value < 0 ? int64_t{-1} : n + 1;
+          }
+          return std::clamp<int64_t>(value + shift, -1, n + 1);
+        };
+        const int size = linear.domain_size();
+        // An infeasible interval is kept empty after clipping.
+        card.lo = std::max<int64_t>(clip(linear.domain(0)), 0);
+        card.hi = std::min<int64_t>(clip(linear.domain(size - 1)), n);
+        for (int i = 1; i + 1 < size; i += 2) {
+          for (int64_t v = clip(linear.domain(i)) + 1;
+               v < clip(linear.domain(i + 1)); ++v) {
+            if (card.lo < v && v < card.hi) {
+              card.excluded.push_back(v);
+            }
+          }
+        }
+        break;
+      }
+      default:
+        LOG(FATAL) << "Unsupported constraint: " << c.ShortDebugString();
+    }
+    result.push_back(std::move(card));
+  }
+  return result;
+}
+
+int DimacsLiteral(int ref) {
+  return RefIsPositive(ref) ? ref + 1 : -(PositiveRef(ref) + 1);
+}
+
+// Builds the clauses of a CNF, over DIMACS literals.
+class CnfBuilder {
+ public:
+  // Constant literals, simplified away by AddClause.
+  static constexpr int kTrue = std::numeric_limits<int>::max();
+  static constexpr int kFalse = -kTrue;
+
+  explicit CnfBuilder(int num_vars) : num_vars_(num_vars) {}
+
+  int NewVar() { return ++num_vars_; }
+  int NumVars() const { return num_vars_; }
+  const vector<vector<int>>& Clauses() const { return clauses_; }
+
+  // Adds the clause Or(Not(enforcement)) V Or(literals).
+  void AddClause(absl::Span<const int> enforcement,
+                 absl::Span<const int> literals) {
+    vector<int> clause;
+    for (int e : enforcement) {
+      clause.push_back(-e);
+    }
+    for (int l : literals) {
+      if (l == kTrue) {
+        return;
+      }
+      if (l != kFalse) {
+        clause.push_back(l);
+      }
+    }
+    clauses_.push_back(std::move(clause));
+  }
+
+  // Adds enforcement -> lo <= Sum(literals) <= hi, and Sum(literals) is not
+  // one of the excluded values.
+  void AddCardinality(absl::Span<const int> enforcement,
+                      absl::Span<const int> literals, int lo, int hi,
+                      absl::Span<const int> excluded) {
+    const int n = literals.size();
+    if (lo > hi) {
+      AddClause(enforcement, {});
+      return;
+    }
+    if (!excluded.empty()) {
+      if (lo == 1) {
+        AddClause(enforcement, literals);
+      }
+      AddCounter(enforcement, literals, lo, hi, excluded);
+      return;
+    }
+    if (lo <= 0 && hi >= n) {
+      return;
+    }
+    if (lo == n || hi == 0) {
+      for (int l : literals) {
+        AddClause(enforcement, {lo == n ? l : -l});
+      }
+      return;
+    }
+    if (lo >= 1) {
+      if (lo == 1) {
+        AddClause(enforcement, literals);
+      }
+      if (lo == 1 && hi >= n) {
+        return;
+      }
+    }
+    if (hi == 1 && n <= kMaxPairwise) {
+      for (int i = 0; i < n; ++i) {
+        for (int j = i + 1; j < n; ++j) {
+          AddClause(enforcement, {-literals[i], -literals[j]});
+        }
+      }
+      if (lo <= 1) {
+        return;
+      }
+    }
+    AddCounter(enforcement, literals, lo, hi, excluded);
+  }
+
+ private:
+  // At most one constraints up to this size are encoded pairwise.
+  static constexpr int kMaxPairwise = 6;
+
+  // Adds the cardinality constraint with a sequential counter:
+  // count[j] <-> Sum(literals so far) >= j.
+  void AddCounter(absl::Span<const int> enforcement,
+                  absl::Span<const int> literals, int lo, int hi,
+                  absl::Span<const int> excluded) {
+    const int n = literals.size();
+    int bound = hi < n ? std::max(lo, hi + 1) : lo;
+    for (int v : excluded) {
+      bound = std::max(bound, v + 1);
+    }
+    vector<int> count(bound + 1, kFalse);
+    count[0] = kTrue;
+    for (int i = 0; i < n; ++i) {
+      const int x = literals[i];
+      vector<int> next(bound + 1, kFalse);
+      next[0] = kTrue;
+      for (int j = 1; j <= std::min(i + 1, bound); ++j) {
+        const int r = next[j] = NewVar();
+        AddClause({}, {-count[j], r});
+        AddClause({}, {-count[j - 1], -x, r});
+        AddClause({}, {-r, count[j], count[j - 1]});
+        AddClause({}, {-r, count[j], x});
+      }
+      count = std::move(next);
+    }
+    if (lo > 1) {
+      AddClause(enforcement, {count[lo]});
+    }
+    if (hi < n) {
+      AddClause(enforcement, {-count[hi + 1]});
+    }
+    for (int v : excluded) {
+      AddClause(enforcement, {-count[v], count[v + 1]});
+    }
+  }
+
+  int num_vars_;
+  vector<vector<int>> clauses_;
+};
+
+string OpbTerm(int coeff, int ref) {
+  return absl::StrFormat("%+d %sx%d", coeff, RefIsPositive(ref) ? "" : "~",
+                         PositiveRef(ref) + 1);
+}
+
+// Returns the OPB constraint Sum(coeff * literals) + bound * Sum(Not(
+// enforcement)) >= bound, or = bound if not enforced and exact.
+string OpbConstraint(absl::Span<const int> enforcement,
+                     absl::Span<const int> literals, bool negate_literals,
+                     int bound, bool exact) {
+  vector<string> terms;
+  for (int l : literals) {
+    terms.push_back(OpbTerm(1, negate_literals ? NegatedRef(l) : l));
+  }
+  for (int e : enforcement) {
+    terms.push_back(OpbTerm(bound, NegatedRef(e)));
+  }
+  return absl::StrFormat("%s %s %d ;", absl::StrJoin(terms, " "),
+                         exact && enforcement.empty() ? "=" : ">=", bound);
+}
+}  // namespace
+
+void WriteDimacs(const CpModelProto& model, absl::Span<const int> assumptions,
+                 absl::Span<const int> projection, ostream& os) {
+  CnfBuilder cnf(model.variables_size());
+  vector<int> enforcement, literals;
+  for (const Cardinality& c : Cardinalities(model, assumptions)) {
+    enforcement.clear();
+    literals.clear();
+    for (int ref : c.enforcement) {
+      enforcement.push_back(DimacsLiteral(ref));
+    }
+    for (int ref : c.literals) {
+      literals.push_back(DimacsLiteral(ref));
+    }
+    cnf.AddCardinality(enforcement, literals, c.lo, c.hi, c.excluded);
+  }
+  vector<int> shown;
+  for (int var : projection) {
+    shown.push_back(var + 1);
+  }
+  std::sort(shown.begin(), shown.end());
+  os << absl::StrFormat("c %d model variables, %d auxiliary variables\n",
+                        model.variables_size(),
+                        cnf.NumVars() - model.variables_size());
+  if (!shown.empty()) {
+    os << "c p show " << absl::StrJoin(shown, " ") << " 0\n";
+    os << "c ind " << absl::StrJoin(shown, " ") << " 0\n";
+  }
+  os << absl::StrFormat("p cnf %d %d\n", cnf.NumVars(), cnf.Clauses().size());
+  for (const auto& clause : cnf.Clauses()) {
+    for (int l : clause) {
+      os << l << " ";
+    }
+    os << "0\n";
+  }
+}
+
+void WriteOpb(const CpModelProto& model, absl::Span<const int> assumptions,
+              ostream& os) {
+  vector<string> constraints;
+  int num_vars = model.variables_size();
+  for (const Cardinality& c : Cardinalities(model, assumptions)) {
+    const int n = c.literals.size();
+    if (c.lo > c.hi) {
+      // Infeasible unless not enforced: x + ~x = 1 < 2.
+      const int x = c.literals.empty() ? 0 : c.literals[0];
+      constraints.push_back(OpbConstraint(
+          c.enforcement, {x, NegatedRef(x)}, false, 2, false));
+      continue;
+    }
+    if (c.lo == c.hi) {
+      if (c.enforcement.empty()) {
+        constraints.push_back(
+            OpbConstraint({}, c.literals, false, c.lo, true));
+        continue;
+      }
+    }
+    if (c.lo > 0) {
+      constraints.push_back(
+          OpbConstraint(c.enforcement, c.literals, false, c.lo, false));
+    }
+    if (c.hi < n) {
+      // Sum(literals) <= hi <-> Sum(Not(literals)) >= n - hi.
+      constraints.push_back(
+          OpbConstraint(c.enforcement, c.literals, true, n - c.hi, false));
+    }
+    for (int v : c.excluded) {
+      // An auxiliary variable y selects Sum(literals) > v or < v.
+      const int y = num_vars++;
+      vector<int> enforcement = c.enforcement;
+      enforcement.push_back(y);
+      constraints.push_back(
+          OpbConstraint(enforcement, c.literals, false, v + 1, false));
+      enforcement.back() = NegatedRef(y);
+      constraints.push_back(
+          OpbConstraint(enforcement, c.literals, true, n - v + 1, false));
+    }
+  }
+  os << absl::StrFormat("* #variable= %d #constraint= %d\n", num_vars,
+                        constraints.size());
+  for (const string& c : constraints) {
+    os << c << "\n";
+  }
+}
+
+void WriteVarMap(absl::Span<const VarKey> keys, ostream& os) {
+  for (int i = 0; i < keys.size(); ++i) {
+    os << absl::StrFormat("%d %s %s\n", i + 1, keys[i].family, keys[i].name);
+  }
+}
+
+}  // namespace botc
@@ -0,0 +1,56 @@
+// Copyright 2022 Ola Rozenfeld
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MODEL_EXPORT_H_
+#define SRC_MODEL_EXPORT_H_
+
+#include <iostream>
+
+#include "absl/types/span.h"
+#include "ortools/sat/cp_model.h"
+#include "src/model_wrapper.h"
+
+namespace botc {
+
+using operations_research::sat::CpModelProto;
+using std::ostream;
+
+// Exporters of compiled Boolean models for external SAT, #SAT and
+// pseudo-Boolean solvers. Model variable i is variable i + 1 in the exported
+// formats. The assumptions (model literals) are exported as unit constraints.
+// The models may only contain clauses, conjunctions, at most one, exactly one
+// and linear constraints over literals with coefficients +-1.
+
+// Writes the model in DIMACS CNF. Cardinality constraints are encoded with
+// sequential counters, whose auxiliary variables (numbered after the model
+// variables) are fully defined by the literals they count, so the number of
+// solutions projected on the model variables is preserved. The projection
+// variables (model variable indices) are listed in "c p show" and "c ind"
+// lines, for projected model counters.
+void WriteDimacs(const CpModelProto& model, absl::Span<const int> assumptions,
+                 absl::Span<const int> projection, ostream& os);
+
+// Writes the model in the OPB format of the pseudo-Boolean competitions, with
+// enforcement literals linearized into the constraints. Excluded sum values
+// (Sum(literals) != k) get an auxiliary variable each, numbered after the model
+// variables.
+void WriteOpb(const CpModelProto& model, absl::Span<const int> assumptions,
+              ostream& os);
+
+// Writes a line per model variable: its exported variable number, family and
+// name, to map solutions back to the game (e.g. to player, role and time).
+void WriteVarMap(absl::Span<const VarKey> keys, ostream& os);
+
+}  // namespace botc
+
+#endif  // SRC_MODEL_EXPORT_H_
@@ -0,0 +1,288 @@
+// Copyright 2022 Ola Rozenfeld
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/model_export.h"
+
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_split.h"
+#include "ortools/sat/cp_model.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace botc {
+using operations_research::sat::BoolVar;
+using operations_research::sat::ConstraintProto;
+using operations_research::sat::CpModelBuilder;
+using operations_research::sat::LinearExpr;
+using std::set;
+using std::string;
+using std::vector;
+
+bool LiteralValue(int ref, int mask) {
+  const int var = ref >= 0 ? ref : -ref - 1;
+  const bool value = mask & (1 << var);
+  return ref >= 0 ? value : !value;
+}
+
+// Returns the model assignments (as bit masks) satisfying the model.
+set<int> Solutions(const CpModelProto& model, absl::Span<const int> assumptions) {
+  set<int> result;
+  for (int mask = 0; mask < (1 << model.variables_size()); ++mask) {
+    bool feasible = true;
+    for (int i = 0; i < model.variables_size(); ++i) {
+      const auto& domain = model.variables(i).domain();
+      const int value = LiteralValue(i, mask);
+      feasible &= domain[0] <= value && value <= domain[1];
+    }
+    for (int ref : assumptions) {
+      feasible &= LiteralValue(ref, mask);
+    }
+    for (const ConstraintProto& c : model.constraints()) {
+      bool enforced = true;
+      for (int ref : c.enforcement_literal()) {
+        enforced &= LiteralValue(ref, mask);
+      }
+      if (!enforced) {
+        continue;
+      }
+      int sum = 0, n = 0;
+      auto count = [&](const auto& literals) {
+        for (int ref : literals) {
+          sum += LiteralValue(ref, mask);
+          ++n;
+        }
+      };
+      switch (c.constraint_case()) {
+        case ConstraintProto::kBoolOr:
+          count(c.bool_or().literals());
+          feasible &= sum >= 1;
+          break;
+        case ConstraintProto::kBoolAnd:
+          count(c.bool_and().literals());
+          feasible &= sum == n;
+          break;
+        case ConstraintProto::kAtMostOne:
+          count(c.at_most_one().literals());
+          feasible &= sum <= 1;
+          break;
+        case ConstraintProto::kExactlyOne:
+          count(c.exactly_one().literals());
+          feasible &= sum == 1;
+          break;
+        case ConstraintProto::kLinear: {
+          const auto& linear = c.linear();
+          for (int i = 0; i < linear.vars_size(); ++i) {
+            sum += linear.coeffs(i) * LiteralValue(linear.vars(i), mask);
+          }
+          bool in_domain = false;
+          for (int i = 0; i < linear.domain_size(); i += 2) {
+            in_domain |= linear.domain(i) <= sum && sum <= linear.domain(i + 1);
+          }
+          feasible &= in_domain;
+          break;
+        }
+        default:
+          ADD_FAILURE() << "Unexpected constraint";
+      }
+    }
+    if (feasible) {
+      result.insert(mask);
+    }
+  }
+  return result;
+}
+
+vector<int> ParseInts(absl::string_view line) {
+  vector<int> result;
+  for (absl::string_view token : absl::StrSplit(line, ' ', absl::SkipEmpty())) {
+    int value;
+    if (absl::SimpleAtoi(token, &value)) {
+      result.push_back(value);
+    }
+  }
+  return result;
+}
+
+// Returns the number of solutions of a DIMACS CNF, and their projections on
+// the first num_model_vars variables.
+std::pair<int, set<int>> DimacsSolutions(const string& cnf,
+                                         int num_model_vars) {
+  int num_vars = 0;
+  vector<vector<int>> clauses;
+  for (absl::string_view line : absl::StrSplit(cnf, '\n', absl::SkipEmpty())) {
+    if (line[0] == 'c') {
+      continue;
+    }
+    if (line[0] == 'p') {
+      num_vars = ParseInts(line)[0];
+      continue;
+    }
+    vector<int> clause = ParseInts(line);
+    clause.pop_back();  // The trailing 0.
+    clauses.push_back(clause);
+  }
+  int count = 0;
+  set<int> projected;
+  for (int mask = 0; mask < (1 << num_vars); ++mask) {
+    bool feasible = true;
+    for (const auto& clause : clauses) {
+      bool satisfied = false;
+      for (int l : clause) {
+        satisfied |= LiteralValue(l > 0 ? l - 1 : l, mask);
+      }
+      if (!satisfied) {
+        feasible = false;
+        break;
+      }
+    }
+    if (feasible) {
+      ++count;
+      projected.insert(mask & ((1 << num_model_vars) - 1));
+    }
+  }
+  return {count, projected};
+}
+
+// Returns the solutions of an OPB model, projected on the first
+// num_model_vars variables.
+set<int> OpbSolutions(const string& opb, int num_model_vars) {
+  set<int> result;
+  const vector<string> lines = absl::StrSplit(opb, '\n', absl::SkipEmpty());
+  const int num_vars = ParseInts(lines[0])[0];
+  for (int mask = 0; mask < (1 << num_vars); ++mask) {
+    bool feasible = true;
+    for (const string& line : lines) {
+      if (line[0] == '*') {
+        continue;
+      }
+      const vector<string> tokens = absl::StrSplit(line, ' ');
+      int sum = 0;
+      int i = 0;
+      for (; tokens[i] != ">=" && tokens[i] != "="; i += 2) {
+        int coeff, var;
+        const string& x = tokens[i + 1];
+        const bool negated = x[0] == '~';
+        EXPECT_TRUE(absl::SimpleAtoi(tokens[i], &coeff));
+        EXPECT_TRUE(absl::SimpleAtoi(x.substr(negated ? 2 : 1), &var));
+        sum += coeff * LiteralValue(negated ? -var : var - 1, mask);
+      }
+      int bound;
+      EXPECT_TRUE(absl::SimpleAtoi(tokens[i + 1], &bound));
+      feasible &= tokens[i] == "=" ? sum == bound : sum >= bound;
+    }
+    if (feasible) {
+      result.insert(mask & ((1 << num_model_vars) - 1));
+    }
+  }
+  return result;
+}
+
+void ExpectSameSolutions(const CpModelProto& model,
+                         absl::Span<const int> assumptions) {
+  const set<int> expected = Solutions(model, assumptions);
+  vector<int> projection;
+  for (int i = 0; i < model.variables_size(); ++i) {
+    projection.push_back(i);
+  }
+  std::ostringstream cnf;
+  WriteDimacs(model, assumptions, projection, cnf);
+  const auto [count, projected] =
+      DimacsSolutions(cnf.str(), model.variables_size());
+  EXPECT_EQ(projected, expected) << cnf.str();
+  // The auxiliary variables are defined by the model variables.
+  EXPECT_EQ(count, expected.size()) << cnf.str();
+  std::ostringstream opb;
+  WriteOpb(model, assumptions, opb);
+  EXPECT_EQ(OpbSolutions(opb.str(), model.variables_size()), expected)
+      << opb.str();
+}
+
+TEST(ModelExport, ExportsClauses) {
+  CpModelBuilder builder;
+  const BoolVar a = builder.NewBoolVar(), b = builder.NewBoolVar(),
+      c = builder.NewBoolVar();
+  builder.AddBoolOr({a, Not(b)}).OnlyEnforceIf(c);
+  builder.AddBoolAnd({Not(a), c}).OnlyEnforceIf(b);
+  builder.AddAtMostOne({a, b, c});
+  builder.AddBoolOr({builder.FalseVar(), a, b});
+  ExpectSameSolutions(builder.Build(), {});
+  ExpectSameSolutions(builder.Build(), {Not(a).index()});
+}
+
+TEST(ModelExport, ExportsCardinalities) {
+  CpModelBuilder builder;
+  vector<BoolVar> x;
+  for (int i = 0; i < 5; ++i) {
+    x.push_back(builder.NewBoolVar());
+  }
+  builder.AddEquality(LinearExpr::Sum({x[0], Not(x[1]), x[2], x[3]}), 2)
+      .OnlyEnforceIf(x[4]);
+  ExpectSameSolutions(builder.Build(), {});
+}
+
+TEST(ModelExport, ExportsBounds) {
+  CpModelBuilder builder;
+  vector<BoolVar> x;
+  for (int i = 0; i < 4; ++i) {
+    x.push_back(builder.NewBoolVar());
+  }
+  builder.AddGreaterOrEqual(LinearExpr::Sum(x), 2);
+  builder.AddLessOrEqual(LinearExpr::Sum(x), 2);
+  ExpectSameSolutions(builder.Build(), {x[0].index()});
+}
+
+TEST(ModelExport, ExportsExcludedValues) {
+  CpModelBuilder builder;
+  vector<BoolVar> x;
+  for (int i = 0; i < 4; ++i) {
+    x.push_back(builder.NewBoolVar());
+  }
+  builder.AddNotEqual(LinearExpr::Sum({x[0], x[1], Not(x[2])}), 1)
+      .OnlyEnforceIf(x[3]);
+  ExpectSameSolutions(builder.Build(), {});
+}
+
+TEST(ModelExport, ExportsLargeAtMostOne) {
+  CpModelBuilder builder;
+  vector<BoolVar> x;
+  for (int i = 0; i < 7; ++i) {
+    x.push_back(builder.NewBoolVar());
+  }
+  builder.AddExactlyOne(x);
+  ExpectSameSolutions(builder.Build(), {});
+}
+
+TEST(ModelExport, WritesProjectionAndVarMap) {
+  CpModelBuilder builder;
+  const BoolVar a = builder.NewBoolVar(), b = builder.NewBoolVar();
+  builder.AddBoolOr({a, b});
+  std::ostringstream cnf;
+  WriteDimacs(builder.Build(), {}, {1}, cnf);
+  EXPECT_THAT(cnf.str(), testing::HasSubstr("c p show 2 0\n"));
+  EXPECT_THAT(cnf.str(), testing::HasSubstr("p cnf 2 1\n1 2 0\n"));
+  std::ostringstream vars;
+  WriteVarMap({{.family = "role", .name = "role_P1_IMP_night_1"},
+               {.family = "Auxiliary"}}, vars);
+  EXPECT_EQ(vars.str(), "1 role role_P1_IMP_night_1\n2 Auxiliary \n");
+}
+}  // namespace botc
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
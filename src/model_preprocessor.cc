@@ -0,0 +1,757 @@
+// Copyright 2022 Ola Rozenfeld
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/model_preprocessor.h"
+
+#include <algorithm>
+#include <chrono>  // NOLINT [build/c++11]
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <utility>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/strings/str_format.h"
+#include "ortools/sat/cp_model_utils.h"
+
+namespace botc {
+using operations_research::sat::ConstraintProto;
+using operations_research::sat::LinearConstraintProto;
+using operations_research::sat::NegatedRef;
+using operations_research::sat::PositiveRef;
+using operations_research::sat::RefIsPositive;
+using std::chrono::duration;
+using std::chrono::steady_clock;
+using std::pair;
+
+namespace {
+// Bounds of the variable elimination, as in the SatELite preprocessor: a
+// variable is eliminated only if resolution does not grow the clause count.
+constexpr int kMaxResolutions = 64;  // Clause pairs tried per variable.
+constexpr int kMaxResolventSize = 16;
+
+// A clause is a sorted set of literal refs.
+typedef vector<int> Clause;
+
+int NumLiterals(const ConstraintProto& c) {
+  int result = c.enforcement_literal_size();
+  switch (c.constraint_case()) {
+    case ConstraintProto::kBoolOr:
+      return result + c.bool_or().literals_size();
+    case ConstraintProto::kBoolAnd:
+      return result + c.bool_and().literals_size();
+    case ConstraintProto::kAtMostOne:
+      return result + c.at_most_one().literals_size();
+    case ConstraintProto::kExactlyOne:
+      return result + c.exactly_one().literals_size();
+    case ConstraintProto::kLinear:
+      return result + c.linear().vars_size();
+    default:
+      return result;
+  }
+}
+
+int NumLiterals(const CpModelProto& model) {
+  int result = 0;
+  for (const ConstraintProto& c : model.constraints()) {
+    result += NumLiterals(c);
+  }
+  return result;
+}
+
+bool IsClauseOrAnd(const ConstraintProto& c) {
+  return c.constraint_case() == ConstraintProto::kBoolOr ||
+         c.constraint_case() == ConstraintProto::kBoolAnd;
+}
+
+bool IsSupported(const ConstraintProto& c) {
+  switch (c.constraint_case()) {
+    case ConstraintProto::kBoolOr:
+    case ConstraintProto::kBoolAnd:
+    case ConstraintProto::kAtMostOne:
+    case ConstraintProto::kExactlyOne:
+    case ConstraintProto::kLinear:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool IsBooleanModel(const CpModelProto& model) {
+  for (const auto& v : model.variables()) {
+    for (int64_t bound : v.domain()) {
+      if (bound < 0 || bound > 1) {
+        return false;
+      }
+    }
+  }
+  // E.g. the table constraints of the SETUP_TABLE encoding.
+  for (const ConstraintProto& c : model.constraints()) {
+    if (!IsSupported(c)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// The passes treat all variables as literals.
+void SortUnique(vector<int>* literals) {
+  std::sort(literals->begin(), literals->end());
+  literals->erase(std::unique(literals->begin(), literals->end()),
+                  literals->end());
+}
+
+// Returns whether the sorted literals contain a literal and its negation.
+bool IsTautology(const Clause& clause) {
+  for (int lit : clause) {
+    if (lit < 0 && std::binary_search(clause.begin(), clause.end(),
+                                      NegatedRef(lit))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Returns the clause of a bool_or, or of a bool_and with a single literal,
+// with the enforcement literals negated into the clause.
+bool AsClause(const ConstraintProto& c, Clause* clause) {
+  const auto* literals = &c.bool_or().literals();
+  if (c.constraint_case() == ConstraintProto::kBoolAnd &&
+      c.bool_and().literals_size() == 1) {
+    literals = &c.bool_and().literals();
+  } else if (c.constraint_case() != ConstraintProto::kBoolOr) {
+    return false;
+  }
+  clause->assign(literals->begin(), literals->end());
+  for (int e : c.enforcement_literal()) {
+    clause->push_back(NegatedRef(e));
+  }
+  SortUnique(clause);
+  return true;
+}
+
+// Returns the clauses of a bool_or or a bool_and constraint.
+vector<Clause> AsClauses(const ConstraintProto& c) {
+  vector<Clause> result;
+  Clause negated_enforcement;
+  for (int e : c.enforcement_literal()) {
+    negated_enforcement.push_back(NegatedRef(e));
+  }
+  if (c.constraint_case() == ConstraintProto::kBoolOr) {
+    result.push_back(negated_enforcement);
+    result[0].insert(result[0].end(), c.bool_or().literals().begin(),
+                     c.bool_or().literals().end());
+  } else {
+    for (int lit : c.bool_and().literals()) {
+      result.push_back(negated_enforcement);
+      result.back().push_back(lit);
+    }
+  }
+  for (Clause& clause : result) {
+    SortUnique(&clause);
+  }
+  return result;
+}
+
+ConstraintProto ClauseConstraint(const Clause& clause) {
+  ConstraintProto c;
+  for (int lit : clause) {
+    c.mutable_bool_or()->add_literals(lit);
+  }
+  return c;
+}
+
+// Returns whether the constraint is a linear constraint without enforcement
+// over literals with unit coefficients and a fixed right hand side. The sum is
+// then rewritten as Sum(literals) == rhs, negating the literals of negative
+// coefficients.
+bool AsLiteralSum(const ConstraintProto& c, vector<int>* literals, int* rhs) {
+  if (c.constraint_case() != ConstraintProto::kLinear ||
+      c.enforcement_literal_size() > 0 || c.linear().domain_size() != 2 ||
+      c.linear().domain(0) != c.linear().domain(1)) {
+    return false;
+  }
+  const LinearConstraintProto& linear = c.linear();
+  literals->clear();
+  int64_t sum = linear.domain(0);
+  for (int i = 0; i < linear.vars_size(); ++i) {
+    if (linear.coeffs(i) == 1) {
+      literals->push_back(linear.vars(i));
+    } else if (linear.coeffs(i) == -1) {
+      literals->push_back(NegatedRef(linear.vars(i)));  // -x = (1 - x) - 1.
+      ++sum;
+    } else {
+      return false;
+    }
+  }
+  *rhs = sum;
+  return true;
+}
+
+void RemoveConstraints(const vector<bool>& removed, CpModelProto* model) {
+  auto* constraints = model->mutable_constraints();
+  int kept = 0;
+  for (int i = 0; i < constraints->size(); ++i) {
+    if (!removed[i]) {
+      if (kept != i) {
+        constraints->SwapElements(kept, i);
+      }
+      ++kept;
+    }
+  }
+  constraints->DeleteSubrange(kept, constraints->size() - kept);
+}
+
+// Union-find over literals: every variable is equal to its parent, or to its
+// negation if its parity is set.
+class LiteralUnionFind {
+ public:
+  explicit LiteralUnionFind(int num_vars)
+      : parent_(num_vars), parity_(num_vars, false) {
+    std::iota(parent_.begin(), parent_.end(), 0);
+  }
+
+  // Returns the representative literal of the literal.
+  int Find(int ref) {
+    const auto [root, parity] = FindVar(PositiveRef(ref));
+    return parity != !RefIsPositive(ref) ? NegatedRef(root) : root;
+  }
+
+  // Merges the literals. Returns false if they are complementary.
+  bool Union(int a, int b) {
+    a = Find(a);
+    b = Find(b);
+    if (a == b) {
+      return true;
+    }
+    if (a == NegatedRef(b)) {
+      return false;
+    }
+    if (PositiveRef(a) > PositiveRef(b)) {
+      std::swap(a, b);
+    }
+    // The variable with the smallest index stays the representative.
+    parent_[PositiveRef(b)] = PositiveRef(a);
+    parity_[PositiveRef(b)] = RefIsPositive(a) != RefIsPositive(b);
+    return true;
+  }
+
+ private:
+  pair<int, bool> FindVar(int var) {
+    int root = var;
+    bool parity = false;
+    while (parent_[root] != root) {
+      parity = parity != parity_[root];
+      root = parent_[root];
+    }
+    // Path compression.
+    for (bool p = parity; parent_[var] != var;) {
+      const int next = parent_[var];
+      const bool next_parity = p != parity_[var];
+      parent_[var] = root;
+      parity_[var] = p;
+      var = next;
+      p = next_parity;
+    }
+    return {root, parity};
+  }
+
+  vector<int> parent_;
+  vector<bool> parity_;
+};
+
+// Rewrites the literals of the constraint with their representatives. Returns
+// false if the constraint becomes trivially true.
+bool SubstituteLiterals(LiteralUnionFind* uf, ConstraintProto* c) {
+  auto map_literals = [uf](auto* literals) {
+    for (int& lit : *literals) {
+      lit = uf->Find(lit);
+    }
+  };
+  map_literals(c->mutable_enforcement_literal());
+  vector<int> enforcement(c->enforcement_literal().begin(),
+                          c->enforcement_literal().end());
+  SortUnique(&enforcement);
+  if (IsTautology(enforcement)) {
+    return false;  // Never enforced.
+  }
+  c->mutable_enforcement_literal()->Assign(enforcement.begin(),
+                                           enforcement.end());
+  auto enforced = [&enforcement](int lit) {
+    return std::binary_search(enforcement.begin(), enforcement.end(), lit);
+  };
+  switch (c->constraint_case()) {
+    case ConstraintProto::kBoolOr: {
+      vector<int> literals;
+      for (int lit : c->bool_or().literals()) {
+        literals.push_back(uf->Find(lit));
+      }
+      SortUnique(&literals);
+      if (IsTautology(literals) ||
+          std::any_of(literals.begin(), literals.end(), enforced)) {
+        return false;
+      }
+      c->mutable_bool_or()->mutable_literals()->Assign(literals.begin(),
+                                                       literals.end());
+      return true;
+    }
+    case ConstraintProto::kBoolAnd: {
+      vector<int> literals;
+      for (int lit : c->bool_and().literals()) {
+        lit = uf->Find(lit);
+        if (!enforced(lit)) {
+          literals.push_back(lit);
+        }
+      }
+      SortUnique(&literals);
+      if (literals.empty()) {
+        return false;
+      }
+      c->mutable_bool_and()->mutable_literals()->Assign(literals.begin(),
+                                                        literals.end());
+      return true;
+    }
+    case ConstraintProto::kAtMostOne:
+      map_literals(c->mutable_at_most_one()->mutable_literals());
+      return true;
+    case ConstraintProto::kExactlyOne:
+      map_literals(c->mutable_exactly_one()->mutable_literals());
+      return true;
+    case ConstraintProto::kLinear: {
+      LinearConstraintProto* linear = c->mutable_linear();
+      std::map<int, int64_t> coeffs;
+      int64_t offset = 0;
+      for (int i = 0; i < linear->vars_size(); ++i) {
+        const int rep = uf->Find(linear->vars(i));
+        const int64_t coeff = linear->coeffs(i);
+        if (RefIsPositive(rep)) {
+          coeffs[rep] += coeff;
+        } else {  // coeff * Not(x) = coeff - coeff * x.
+          coeffs[PositiveRef(rep)] -= coeff;
+          offset += coeff;
+        }
+      }
+      linear->clear_vars();
+      linear->clear_coeffs();
+      for (const auto& [var, coeff] : coeffs) {
+        if (coeff != 0) {
+          linear->add_vars(var);
+          linear->add_coeffs(coeff);
+        }
+      }
+      bool contains_zero = false;
+      for (int i = 0; i < linear->domain_size(); ++i) {
+        int64_t bound = linear->domain(i);
+        if (bound != std::numeric_limits<int64_t>::min() &&
+            bound != std::numeric_limits<int64_t>::max()) {
+          bound -= offset;
+          linear->set_domain(i, bound);
+        }
+        if (i % 2 == 1 && linear->domain(i - 1) <= 0 && bound >= 0) {
+          contains_zero = true;
+        }
+      }
+      return linear->vars_size() > 0 || !contains_zero;
+    }
+    default:
+      return true;
+  }
+}
+
+// Passes return the number of removed variables.
+int SubstituteEquivalentLiterals(CpModelProto* model) {
+  const int num_vars = model->variables_size();
+  LiteralUnionFind uf(num_vars);
+  absl::flat_hash_set<pair<int, int>> implications;
+  auto add_implication = [&](int a, int b) {
+    if (implications.contains({b, a})) {
+      uf.Union(a, b);
+    }
+    implications.insert({a, b});
+    implications.insert({NegatedRef(b), NegatedRef(a)});
+  };
+  for (const ConstraintProto& c : model->constraints()) {
+    vector<int> literals;
+    int rhs;
+    if (AsLiteralSum(c, &literals, &rhs)) {
+      if (literals.size() == 2 && rhs == 1) {
+        uf.Union(literals[0], NegatedRef(literals[1]));
+      }
+      continue;
+    }
+    Clause clause;
+    if (AsClause(c, &clause) && clause.size() == 2) {
+      add_implication(NegatedRef(clause[0]), clause[1]);
+    }
+    if (c.constraint_case() == ConstraintProto::kBoolAnd &&
+        c.enforcement_literal_size() == 1) {
+      for (int lit : c.bool_and().literals()) {
+        add_implication(c.enforcement_literal(0), lit);
+      }
+    }
+  }
+  int substituted = 0;
+  vector<bool> removed(model->constraints_size(), false);
+  for (int i = 0; i < model->constraints_size(); ++i) {
+    removed[i] = !SubstituteLiterals(&uf, model->mutable_constraints(i));
+  }
+  RemoveConstraints(removed, model);
+  // Removes the duplicates created by the substitution.
+  absl::flat_hash_set<string> seen;
+  removed.assign(model->constraints_size(), false);
+  for (int i = 0; i < model->constraints_size(); ++i) {
+    removed[i] = !seen.insert(model->constraints(i).SerializeAsString()).second;
+  }
+  RemoveConstraints(removed, model);
+  // Every substituted variable keeps its value through a single equality.
+  for (int var = 0; var < num_vars; ++var) {
+    const int rep = uf.Find(var);
+    if (rep == var) {
+      continue;
+    }
+    ++substituted;
+    LinearConstraintProto* linear = model->add_constraints()->mutable_linear();
+    linear->add_vars(var);
+    linear->add_coeffs(1);
+    linear->add_vars(PositiveRef(rep));
+    linear->add_coeffs(RefIsPositive(rep) ? -1 : 1);
+    linear->add_domain(RefIsPositive(rep) ? 0 : 1);
+    linear->add_domain(RefIsPositive(rep) ? 0 : 1);
+  }
+  return substituted;
+}
+
+int RemoveSubsumedClauses(CpModelProto* model) {
+  const int n = model->constraints_size();
+  vector<Clause> clauses(n);
+  vector<int> ids;
+  absl::flat_hash_map<int, vector<int>> occurrences;
+  for (int i = 0; i < n; ++i) {
+    if (AsClause(model->constraints(i), &clauses[i]) && !clauses[i].empty()) {
+      ids.push_back(i);
+      for (int lit : clauses[i]) {
+        occurrences[lit].push_back(i);
+      }
+    }
+  }
+  std::stable_sort(ids.begin(), ids.end(), [&clauses](int a, int b) {
+    return clauses[a].size() < clauses[b].size();
+  });
+  vector<bool> removed(n, false);
+  for (int id : ids) {
+    if (removed[id]) {
+      continue;
+    }
+    const Clause& clause = clauses[id];
+    // Any clause containing this one contains its rarest literal.
+    const vector<int>* candidates = &occurrences.at(clause[0]);
+    for (int lit : clause) {
+      if (occurrences.at(lit).size() < candidates->size()) {
+        candidates = &occurrences.at(lit);
+      }
+    }
+    for (int other : *candidates) {
+      if (other != id && !removed[other] &&
+          clauses[other].size() >= clause.size() &&
+          std::includes(clauses[other].begin(), clauses[other].end(),
+                        clause.begin(), clause.end())) {
+        removed[other] = true;
+      }
+    }
+  }
+  RemoveConstraints(removed, model);
+  return 0;
+}
+
+int EliminateVariables(absl::Span<const int> protected_vars,
+                       CpModelProto* model) {
+  const int num_vars = model->variables_size();
+  for (const ConstraintProto& c : model->constraints()) {
+    if (!IsSupported(c)) {
+      return 0;
+    }
+  }
+  // Only unfixed variables that occur in clauses alone are eliminated.
+  vector<bool> blocked(num_vars, false);
+  for (int var : protected_vars) {
+    blocked[var] = true;
+  }
+  for (int lit : model->assumptions()) {
+    blocked[PositiveRef(lit)] = true;
+  }
+  for (int var = 0; var < num_vars; ++var) {
+    const auto& domain = model->variables(var).domain();
+    if (domain.size() != 2 || domain[0] == domain[1]) {
+      blocked[var] = true;
+    }
+  }
+  struct DbClause {
+    Clause literals;
+    int origin;  // The constraint index, or -1 for a resolvent.
+    bool alive = true;
+  };
+  vector<DbClause> db;
+  vector<vector<int>> occurrences(num_vars);
+  auto add_clause = [&](Clause clause, int origin) {
+    for (int lit : clause) {
+      occurrences[PositiveRef(lit)].push_back(db.size());
+    }
+    db.push_back({.literals = std::move(clause), .origin = origin});
+  };
+  for (int i = 0; i < model->constraints_size(); ++i) {
+    const ConstraintProto& c = model->constraints(i);
+    if (IsClauseOrAnd(c)) {
+      for (Clause& clause : AsClauses(c)) {
+        if (!IsTautology(clause)) {
+          add_clause(std::move(clause), i);
+        }
+      }
+      continue;
+    }
+    for (int lit : c.enforcement_literal()) {
+      blocked[PositiveRef(lit)] = true;
+    }
+    for (int lit : c.at_most_one().literals()) {
+      blocked[PositiveRef(lit)] = true;
+    }
+    for (int lit : c.exactly_one().literals()) {
+      blocked[PositiveRef(lit)] = true;
+    }
+    for (int var : c.linear().vars()) {
+      blocked[PositiveRef(var)] = true;
+    }
+  }
+
+  vector<bool> dissolved(model->constraints_size(), false);
+  vector<int> eliminated;
+  for (int var = 0; var < num_vars; ++var) {
+    if (blocked[var]) {
+      continue;
+    }
+    vector<int> pos, neg;
+    for (int id : occurrences[var]) {
+      if (db[id].alive) {
+        const Clause& clause = db[id].literals;
+        (std::binary_search(clause.begin(), clause.end(), var) ? pos : neg)
+            .push_back(id);
+      }
+    }
+    if (pos.size() * neg.size() > kMaxResolutions) {
+      continue;
+    }
+    vector<Clause> resolvents;
+    bool bounded = true;
+    for (int p : pos) {
+      for (int q : neg) {
+        Clause resolvent;
+        for (int lit : db[p].literals) {
+          if (lit != var) {
+            resolvent.push_back(lit);
+          }
+        }
+        for (int lit : db[q].literals) {
+          if (lit != NegatedRef(var)) {
+            resolvent.push_back(lit);
+          }
+        }
+        SortUnique(&resolvent);
+        if (IsTautology(resolvent)) {
+          continue;
+        }
+        if (resolvent.size() > kMaxResolventSize) {
+          bounded = false;
+          break;
+        }
+        resolvents.push_back(std::move(resolvent));
+      }
+      if (!bounded) {
+        break;
+      }
+    }
+    if (!bounded || resolvents.size() > pos.size() + neg.size()) {
+      continue;
+    }
+    for (const vector<int>* ids : {&pos, &neg}) {
+      for (int id : *ids) {
+        db[id].alive = false;
+        if (db[id].origin >= 0) {
+          dissolved[db[id].origin] = true;
+        }
+      }
+    }
+    for (Clause& resolvent : resolvents) {
+      add_clause(std::move(resolvent), -1);
+    }
+    eliminated.push_back(var);
+  }
+
+  // The remaining clauses of dissolved constraints are added as clauses.
+  for (const DbClause& clause : db) {
+    if (clause.alive && (clause.origin < 0 || dissolved[clause.origin])) {
+      *model->add_constraints() = ClauseConstraint(clause.literals);
+    }
+  }
+  dissolved.resize(model->constraints_size(), false);
+  RemoveConstraints(dissolved, model);
+  for (int var : eliminated) {
+    model->mutable_variables(var)->set_domain(1, 0);
+  }
+  return eliminated.size();
+}
+
+int MergeExactlyOne(CpModelProto* model) {
+  const int n = model->constraints_size();
+  vector<bool> removed(n, false);
+  // Sums of literals equal to one.
+  for (int i = 0; i < n; ++i) {
+    vector<int> literals;
+    int rhs;
+    if (AsLiteralSum(model->constraints(i), &literals, &rhs) && rhs == 1) {
+      ConstraintProto* c = model->mutable_constraints(i);
+      c->clear_linear();
+      c->mutable_exactly_one()->mutable_literals()->Assign(literals.begin(),
+                                                           literals.end());
+    }
+  }
+  // At most one constraints with a clause over the same literals.
+  absl::flat_hash_map<vector<int>, int> clauses;
+  for (int i = 0; i < n; ++i) {
+    const ConstraintProto& c = model->constraints(i);
+    if (c.constraint_case() == ConstraintProto::kBoolOr &&
+        c.enforcement_literal_size() == 0) {
+      vector<int> literals(c.bool_or().literals().begin(),
+                           c.bool_or().literals().end());
+      SortUnique(&literals);
+      clauses.try_emplace(std::move(literals), i);
+    }
+  }
+  vector<vector<int>> sets(n);
+  absl::flat_hash_map<int, vector<int>> occurrences;
+  for (int i = 0; i < n; ++i) {
+    ConstraintProto* c = model->mutable_constraints(i);
+    if (c->enforcement_literal_size() > 0) {
+      continue;
+    }
+    if (c->constraint_case() == ConstraintProto::kAtMostOne) {
+      sets[i].assign(c->at_most_one().literals().begin(),
+                     c->at_most_one().literals().end());
+      SortUnique(&sets[i]);
+      if (sets[i].size() < c->at_most_one().literals_size()) {
+        sets[i].clear();  // A repeated literal is false, so keep it as is.
+        continue;
+      }
+      const auto it = clauses.find(sets[i]);
+      if (it != clauses.end() && !removed[it->second]) {
+        removed[it->second] = true;
+        c->clear_at_most_one();
+        c->mutable_exactly_one()->mutable_literals()->Assign(sets[i].begin(),
+                                                             sets[i].end());
+      }
+    } else if (c->constraint_case() == ConstraintProto::kExactlyOne) {
+      sets[i].assign(c->exactly_one().literals().begin(),
+                     c->exactly_one().literals().end());
+      SortUnique(&sets[i]);
+      if (sets[i].size() < c->exactly_one().literals_size()) {
+        sets[i].clear();
+        continue;
+      }
+    }
+    for (int lit : sets[i]) {
+      occurrences[lit].push_back(i);
+    }
+  }
+  // At most one constraints implied by another one over more literals.
+  for (int i = 0; i < n; ++i) {
+    if (sets[i].empty() || model->constraints(i).constraint_case() !=
+                               ConstraintProto::kAtMostOne) {
+      continue;
+    }
+    for (int other : occurrences[sets[i][0]]) {
+      if (other == i || removed[other] ||
+          sets[other].size() < sets[i].size() ||
+          !std::includes(sets[other].begin(), sets[other].end(),
+                         sets[i].begin(), sets[i].end())) {
+        continue;
+      }
+      // Of two equal at most one constraints, only the later one is removed.
+      if (sets[other].size() > sets[i].size() || other < i ||
+          model->constraints(other).constraint_case() ==
+              ConstraintProto::kExactlyOne) {
+        removed[i] = true;
+        break;
+      }
+    }
+  }
+  RemoveConstraints(removed, model);
+  return 0;
+}
+
+void RunPass(const string& name, const std::function<int()>& pass,
+             CpModelProto* model, PreprocessorStats* stats) {
+  const int constraints = model->constraints_size();
+  const int literals = NumLiterals(*model);
+  const steady_clock::time_point begin = steady_clock::now();
+  const int variables = pass();
+  const steady_clock::time_point end = steady_clock::now();
+  stats->passes.push_back({
+      .name = name,
+      .wall_time = duration<double>(end - begin).count(),
+      .variables = variables,
+      .constraints = constraints - model->constraints_size(),
+      .literals = literals - NumLiterals(*model)});
+}
+}  // namespace
+
+PreprocessorStats PreprocessModel(absl::Span<const int> protected_vars,
+                                  CpModelProto* model) {
+  PreprocessorStats stats;
+  if (!IsBooleanModel(*model)) {
+    return stats;
+  }
+  RunPass("EquivalentLiterals",
+          [model] { return SubstituteEquivalentLiterals(model); }, model,
+          &stats);
+  RunPass("SubsumedClauses", [model] { return RemoveSubsumedClauses(model); },
+          model, &stats);
+  RunPass("VariableElimination",
+          [&] { return EliminateVariables(protected_vars, model); }, model,
+          &stats);
+  RunPass("ExactlyOne", [model] { return MergeExactlyOne(model); }, model,
+          &stats);
+  return stats;
+}
+
+ostream& operator<<(ostream& os, const PreprocessorStats& stats) {
+  PreprocessorStats::Pass total = {.name = "Total"};
+  os << absl::StrFormat("%-20s %12s %10s %12s %10s\n", "Pass", "Time[ms]",
+                        "Variables", "Constraints", "Literals");
+  auto print_pass = [&os](const PreprocessorStats::Pass& p) {
+    os << absl::StrFormat("%-20s %12.3f %10d %12d %10d\n", p.name,
+                          p.wall_time * 1000, p.variables, p.constraints,
+                          p.literals);
+  };
+  for (const auto& p : stats.passes) {
+    print_pass(p);
+    total.wall_time += p.wall_time;
+    total.variables += p.variables;
+    total.constraints += p.constraints;
+    total.literals += p.literals;
+  }
+  print_pass(total);
+  return os;
+}
+
+}  // namespace botc
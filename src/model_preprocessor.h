@@ -0,0 +1,65 @@
+// Copyright 2022 Ola Rozenfeld
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MODEL_PREPROCESSOR_H_
+#define SRC_MODEL_PREPROCESSOR_H_
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "ortools/sat/cp_model.h"
+
+namespace botc {
+
+using operations_research::sat::CpModelProto;
+using std::ostream;
+using std::string;
+using std::vector;
+
+// Statistics of preprocessing a model, per pass.
+struct PreprocessorStats {
+  struct Pass {
+    string name;
+    double wall_time = 0;  // In seconds.
+    // Removed by the pass:
+    int variables = 0;  // Substituted or eliminated.
+    int constraints = 0;
+    int literals = 0;
+  };
+  vector<Pass> passes;
+};
+ostream& operator<<(ostream& os, const PreprocessorStats& stats);
+
+// Simplifies a compiled model before it is handed to CP-SAT. The passes run in
+// order:
+// * EquivalentLiterals: substitutes literals proven equal (by equalities or
+//   by implications in both directions) with a representative literal. Every
+//   substituted variable keeps a single equality to its representative.
+// * SubsumedClauses: removes clauses that contain another clause.
+// * VariableElimination: bounded variable elimination by clause resolution,
+//   for variables that only occur in clauses and are not protected.
+// * ExactlyOne: turns sums of literals equal to one, and at most one
+//   constraints with a matching clause, into exactly one constraints, and
+//   removes at most one constraints implied by others.
+// Variable indices are kept, and so are the solution values of all variables
+// except the eliminated ones, which are fixed to false. Protected variables
+// and the variables of the model assumptions are never eliminated.
+// Models with integer variables are returned unchanged.
+PreprocessorStats PreprocessModel(absl::Span<const int> protected_vars,
+                                  CpModelProto* model);
+
+}  // namespace botc
+
+#endif  // SRC_MODEL_PREPROCESSOR_H_
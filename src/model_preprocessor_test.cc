@@ -0,0 +1,177 @@
+// Copyright 2022 Ola Rozenfeld
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/model_preprocessor.h"
+
+#include "ortools/sat/cp_model.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace botc {
+using operations_research::sat::BoolVar;
+using operations_research::sat::ConstraintProto;
+using operations_research::sat::CpModelBuilder;
+using operations_research::sat::CpSolverResponse;
+using operations_research::sat::LinearExpr;
+
+bool IsFeasible(const CpSolverResponse& response) {
+  return (response.status() == operations_research::sat::OPTIMAL ||
+          response.status() == operations_research::sat::FEASIBLE);
+}
+
+// Returns the feasibility of the model for every assignment of the variables.
+vector<bool> FeasibleAssignments(CpModelProto model,
+                                 absl::Span<const int> vars) {
+  vector<bool> result;
+  for (int mask = 0; mask < (1 << vars.size()); ++mask) {
+    model.clear_assumptions();
+    for (int i = 0; i < vars.size(); ++i) {
+      const bool val = mask & (1 << i);
+      model.add_assumptions(val ? vars[i] : -vars[i] - 1);
+    }
+    result.push_back(IsFeasible(operations_research::sat::Solve(model)));
+  }
+  return result;
+}
+
+vector<int> Indices(absl::Span<const BoolVar> vars) {
+  vector<int> result;
+  for (const BoolVar& v : vars) {
+    result.push_back(v.index());
+  }
+  return result;
+}
+
+int CountConstraints(const CpModelProto& model,
+                     ConstraintProto::ConstraintCase constraint_case) {
+  int result = 0;
+  for (const ConstraintProto& c : model.constraints()) {
+    result += c.constraint_case() == constraint_case;
+  }
+  return result;
+}
+
+const PreprocessorStats::Pass& GetPass(const PreprocessorStats& stats,
+                                       const string& name) {
+  for (const auto& p : stats.passes) {
+    if (p.name == name) {
+      return p;
+    }
+  }
+  ADD_FAILURE() << "Missing pass " << name;
+  return stats.passes[0];
+}
+
+TEST(ModelPreprocessor, SubstitutesEquivalentLiterals) {
+  CpModelBuilder builder;
+  BoolVar x = builder.NewBoolVar(), y = builder.NewBoolVar(),
+      z = builder.NewBoolVar(), w = builder.NewBoolVar();
+  builder.AddEquality(x, y);
+  builder.AddImplication(y, Not(z));
+  builder.AddImplication(Not(z), y);
+  builder.AddBoolOr({x, w});
+  builder.AddBoolOr({y, w});
+  builder.AddBoolOr({Not(z), w});
+  CpModelProto model = builder.Build();
+  const vector<int> vars = Indices({x, y, z, w});
+  const vector<bool> expected = FeasibleAssignments(model, vars);
+
+  const PreprocessorStats stats = PreprocessModel(vars, &model);
+  const auto& pass = GetPass(stats, "EquivalentLiterals");
+  EXPECT_EQ(pass.variables, 2);
+  EXPECT_EQ(pass.constraints, 3);  // 3 equivalences and 2 duplicates, +2.
+  EXPECT_EQ(CountConstraints(model, ConstraintProto::kBoolOr), 1);
+  EXPECT_EQ(FeasibleAssignments(model, vars), expected);
+}
+
+TEST(ModelPreprocessor, RemovesSubsumedClauses) {
+  CpModelBuilder builder;
+  BoolVar a = builder.NewBoolVar(), b = builder.NewBoolVar(),
+      c = builder.NewBoolVar();
+  builder.AddBoolOr({a, b, c});
+  builder.AddBoolOr({a, b});
+  builder.AddBoolOr({b, a});
+  builder.AddBoolOr({a, b}).OnlyEnforceIf(c);
+  builder.AddBoolOr({Not(a), c});
+  CpModelProto model = builder.Build();
+  const vector<int> vars = Indices({a, b, c});
+  const vector<bool> expected = FeasibleAssignments(model, vars);
+
+  const PreprocessorStats stats = PreprocessModel(vars, &model);
+  // The reordered duplicate is removed by the substitution pass already.
+  EXPECT_EQ(GetPass(stats, "EquivalentLiterals").constraints, 1);
+  EXPECT_EQ(GetPass(stats, "SubsumedClauses").constraints, 2);
+  EXPECT_EQ(model.constraints_size(), 2);
+  EXPECT_EQ(FeasibleAssignments(model, vars), expected);
+}
+
+TEST(ModelPreprocessor, EliminatesAuxiliaryVariables) {
+  CpModelBuilder builder;
+  BoolVar a = builder.NewBoolVar(), b = builder.NewBoolVar(),
+      c = builder.NewBoolVar(), t = builder.NewBoolVar();
+  // t <-> a ^ b, t V c.
+  builder.AddBoolAnd({a, b}).OnlyEnforceIf(t);
+  builder.AddBoolOr({Not(a), Not(b), t});
+  builder.AddBoolOr({t, c});
+  CpModelProto model = builder.Build();
+  const vector<int> vars = Indices({a, b, c});
+  const vector<bool> expected = FeasibleAssignments(model, vars);
+
+  const PreprocessorStats stats = PreprocessModel(vars, &model);
+  EXPECT_EQ(GetPass(stats, "VariableElimination").variables, 1);
+  EXPECT_THAT(model.variables(t.index()).domain(), testing::ElementsAre(0, 0));
+  for (const ConstraintProto& constraint : model.constraints()) {
+    for (int lit : constraint.bool_or().literals()) {
+      EXPECT_NE(lit, t.index());
+      EXPECT_NE(lit, Not(t).index());
+    }
+  }
+  EXPECT_EQ(FeasibleAssignments(model, vars), expected);
+}
+
+TEST(ModelPreprocessor, KeepsProtectedVariables) {
+  CpModelBuilder builder;
+  BoolVar a = builder.NewBoolVar(), t = builder.NewBoolVar();
+  builder.AddBoolOr({a, t});
+  CpModelProto model = builder.Build();
+  const PreprocessorStats stats = PreprocessModel(Indices({a, t}), &model);
+  EXPECT_EQ(GetPass(stats, "VariableElimination").variables, 0);
+  EXPECT_EQ(model.constraints_size(), 1);
+}
+
+TEST(ModelPreprocessor, MergesExactlyOne) {
+  CpModelBuilder builder;
+  vector<BoolVar> x;
+  for (int i = 0; i < 5; ++i) {
+    x.push_back(builder.NewBoolVar());
+  }
+  builder.AddEquality(LinearExpr::Sum({x[0], x[1], Not(x[2])}), 1);
+  builder.AddAtMostOne({x[0], x[1]});  // Implied by the sum.
+  builder.AddAtMostOne({x[3], x[4]});
+  builder.AddBoolOr({x[4], x[3]});
+  CpModelProto model = builder.Build();
+  const vector<int> vars = Indices(x);
+  const vector<bool> expected = FeasibleAssignments(model, vars);
+
+  const PreprocessorStats stats = PreprocessModel(vars, &model);
+  EXPECT_EQ(GetPass(stats, "ExactlyOne").constraints, 2);
+  EXPECT_EQ(model.constraints_size(), 2);
+  EXPECT_EQ(CountConstraints(model, ConstraintProto::kExactlyOne), 2);
+  EXPECT_EQ(FeasibleAssignments(model, vars), expected);
+}
+}  // namespace botc
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
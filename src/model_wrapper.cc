@@ -15,17 +15,33 @@
 
 #include <algorithm>
 #include <fstream>
+#include <initializer_list>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <set>
+#include <utility>
 
+#include "absl/strings/str_join.h"
+#include "ortools/base/logging.h"
 #include "ortools/sat/cp_model.h"
+#include "ortools/sat/cp_model_utils.h"
 #include "src/util.h"
 
 namespace botc {
+using operations_research::Domain;
+using operations_research::sat::Constraint;
+using operations_research::sat::ConstraintProto;
+using operations_research::sat::DecisionStrategyProto;
 using operations_research::sat::LinearExpr;
+using operations_research::sat::NegatedRef;
+using operations_research::sat::RefIsPositive;
+using operations_research::sat::TableConstraint;
 using std::ofstream;
+using std::pair;
 
-vector<BoolVar> Not(absl::Span<const BoolVar> literals) {
-  vector<BoolVar> result;
+Literals Not(absl::Span<const BoolVar> literals) {
+  Literals result;
   for (const auto& v : literals) {
     result.push_back(Not(v));
   }
@@ -73,14 +89,371 @@ string AndConstraintName(absl::Span<const BoolVar> literals) {
 string OrConstraintName(absl::Span<const BoolVar> literals) {
   return ConstraintName("V", literals);
 }
+
+// Operator tags of structural keys.
+enum KeyOp {
+  kAnd, kOr, kEquality, kImplication, kImplicationAnd, kImplicationOr,
+  kImplicationSum, kImplicationNotSum, kImplicationEq, kEquivalenceSum,
+  kEqualitySum, kAtMostOne, kIntEq, kVarAnd, kVarOr, kVarSum, kVarSumEq,
+  kTable
+};
+
+// Returns the canonical structural key of a constraint or derived variable:
+// the operator tag, the constants (e.g. enforcement literals or sums), and
+// the sorted literal indices. The key is built in the given scratch buffer,
+// so that probing the caches does not allocate.
+const vector<int>& StructuralKey(KeyOp op,
+                                 std::initializer_list<int> constants,
+                                 absl::Span<const BoolVar> literals,
+                                 vector<int>* key) {
+  key->clear();
+  key->push_back(op);
+  key->insert(key->end(), constants.begin(), constants.end());
+  for (const BoolVar& v : literals) {
+    key->push_back(v.index());
+  }
+  std::sort(key->begin() + 1 + constants.size(), key->end());
+  return *key;
+}
+
+int NumLiterals(const ConstraintProto& c) {
+  int result = c.enforcement_literal_size();
+  switch (c.constraint_case()) {
+    case ConstraintProto::kBoolOr:
+      return result + c.bool_or().literals_size();
+    case ConstraintProto::kBoolAnd:
+      return result + c.bool_and().literals_size();
+    case ConstraintProto::kAtMostOne:
+      return result + c.at_most_one().literals_size();
+    case ConstraintProto::kExactlyOne:
+      return result + c.exactly_one().literals_size();
+    case ConstraintProto::kLinear:
+      return result + c.linear().vars_size();
+    default:
+      return result;
+  }
+}
 }  // namespace
 
+bool ModelWrapper::IsNewConstraint(absl::Span<const int> key) {
+  if (!constraint_cache_.contains(key)) {
+    constraint_cache_.insert(StoreKey(key));
+    ++constraints_;
+    return true;
+  }
+  ++duplicate_constraints_;
+  return false;
+}
+
+bool ModelWrapper::LookupEquivalentVar(absl::Span<const int> key,
+                                       const string& name, BoolVar* var) {
+  CacheStats::Counter& counter = equivalent_var_counters_[key[0] - kVarAnd];
+  const auto it = equivalent_var_cache_.find(key);
+  if (it != equivalent_var_cache_.end()) {
+    ++counter.hits;
+    *var = it->second;
+    return false;
+  }
+  ++counter.misses;
+  *var = named_ ? model_.NewBoolVar().WithName(name) : model_.NewBoolVar();
+  equivalent_var_cache_[StoreKey(key)] = *var;
+  return true;
+}
+
+absl::Span<const int> ModelWrapper::StoreKey(absl::Span<const int> key) {
+  constexpr int kKeyBlockSize = 1 << 12;
+  if (key_blocks_.empty() || key_block_size_ + key.size() > kKeyBlockSize) {
+    key_blocks_.push_back(std::make_unique<int[]>(
+        std::max<int>(kKeyBlockSize, key.size())));
+    key_block_size_ = 0;
+  }
+  int* stored = key_blocks_.back().get() + key_block_size_;
+  std::copy(key.begin(), key.end(), stored);
+  key_block_size_ += key.size();
+  return absl::Span<const int>(stored, key.size());
+}
+
+void ModelWrapper::ToProto(CompiledModel* pb) const {
+  *pb->mutable_model() = model_.Build();
+  for (const VarFamily& family : families_) {
+    auto* f = pb->add_families();
+    f->set_name(family.name);
+    for (int index = 0; index < family.vars.size(); ++index) {
+      if (family.vars[index].has_value()) {
+        f->add_keys(index);
+        f->add_vars(family.vars[index]->index());
+      }
+    }
+  }
+  for (const auto& it : var_cache_) {
+    auto* v = pb->add_named_vars();
+    v->set_name(it.first);
+    v->set_var(it.second.index());
+  }
+  for (const auto& it : int_var_cache_) {
+    auto* v = pb->add_int_vars();
+    v->set_name(it.first);
+    v->set_var(it.second.index());
+  }
+  for (const auto& it : equivalent_var_cache_) {
+    auto* v = pb->add_derived_vars();
+    for (int k : it.first) {
+      v->add_key(k);
+    }
+    v->set_var(it.second.index());
+  }
+  for (const auto& [begin, tag] : constraint_tags_) {
+    auto* t = pb->add_constraint_tags();
+    t->set_begin(begin);
+    t->set_source(tag.source);
+    t->set_role(tag.role);
+    t->set_time(tag.time);
+    t->set_event(tag.event);
+  }
+}
+
+void ModelWrapper::FromProto(const CompiledModel& pb) {
+  CHECK_EQ(pb.families_size(), families_.size())
+      << "Variable families do not match the compiled model";
+  model_.CopyFrom(pb.model());
+  values_.clear();  // Synced again from the variable domains.
+  for (int i = 0; i < families_.size(); ++i) {
+    const auto& f = pb.families(i);
+    CHECK_EQ(f.name(), families_[i].name)
+        << "Variable families do not match the compiled model";
+    for (int j = 0; j < f.keys_size(); ++j) {
+      families_[i].vars[f.keys(j)] =
+          model_.GetBoolVarFromProtoIndex(f.vars(j));
+    }
+  }
+  for (const auto& v : pb.named_vars()) {
+    var_cache_[v.name()] = model_.GetBoolVarFromProtoIndex(v.var());
+  }
+  for (const auto& v : pb.int_vars()) {
+    int_var_cache_[v.name()] = model_.GetIntVarFromProtoIndex(v.var());
+  }
+  for (const auto& v : pb.derived_vars()) {
+    equivalent_var_cache_[StoreKey(v.key())] =
+        model_.GetBoolVarFromProtoIndex(v.var());
+  }
+  constraint_tags_.clear();
+  for (const auto& t : pb.constraint_tags()) {
+    constraint_tags_.push_back(
+        {t.begin(), {.source = t.source(), .role = t.role(), .time = t.time(),
+                     .event = t.event()}});
+  }
+}
+
+void ModelWrapper::SetConstraintTag(const ConstraintTag& tag) {
+  const int begin = model_.Build().constraints_size();
+  if (!constraint_tags_.empty() && constraint_tags_.back().first == begin) {
+    constraint_tags_.back().second = tag;  // The last range is empty.
+  } else {
+    constraint_tags_.push_back({begin, tag});
+  }
+}
+
+vector<ConstraintTagRange> ModelWrapper::GetConstraintTags() const {
+  vector<ConstraintTagRange> result;
+  const int num_constraints = model_.Build().constraints_size();
+  for (int i = 0; i < constraint_tags_.size(); ++i) {
+    const auto& [begin, tag] = constraint_tags_[i];
+    result.push_back({.tag = tag, .begin = begin,
+                      .end = i + 1 < constraint_tags_.size()
+                          ? constraint_tags_[i + 1].first : num_constraints});
+  }
+  return result;
+}
+
+ConstraintTag ModelWrapper::GetConstraintTag(int constraint) const {
+  const auto it = std::upper_bound(
+      constraint_tags_.begin(), constraint_tags_.end(), constraint,
+      [](int c, const pair<int, ConstraintTag>& t) { return c < t.first; });
+  if (it == constraint_tags_.begin()) {
+    return ConstraintTag();
+  }
+  return std::prev(it)->second;
+}
+
+CacheStats ModelWrapper::GetCacheStats(bool arity_histogram) const {
+  CacheStats stats;
+  stats.vars["NewVar"] = named_var_counter_;
+  for (const VarFamily& family : families_) {
+    stats.vars[family.name] = family.counter;
+  }
+  const char* kinds[] = {"And", "Or", "Sum", "SumEq"};
+  for (int i = 0; i < 4; ++i) {
+    stats.vars[absl::StrCat("EquivalentVar", kinds[i])] =
+        equivalent_var_counters_[i];
+  }
+  stats.constraints = constraints_;
+  stats.duplicate_constraints = duplicate_constraints_;
+  stats.fixed_literals = fixed_literals_;
+  stats.folded_constraints = folded_constraints_;
+  for (const auto& it : var_cache_) {
+    stats.key_bytes += it.first.size();
+  }
+  for (const auto& it : equivalent_var_cache_) {
+    stats.key_bytes += it.first.size() * sizeof(int);
+  }
+  for (const auto& key : constraint_cache_) {
+    stats.key_bytes += key.size() * sizeof(int);
+  }
+  if (arity_histogram) {
+    for (const ConstraintProto& c : model_.Build().constraints()) {
+      stats.constraint_arity[NumLiterals(c)]++;
+    }
+  }
+  return stats;
+}
+
+ostream& operator<<(ostream& os, const CacheStats& stats) {
+  os << absl::StrFormat("%-24s %12s %12s\n", "Variables", "Hits", "Misses");
+  for (const auto& [name, counter] : stats.vars) {
+    os << absl::StrFormat("%-24s %12d %12d\n", name, counter.hits,
+                          counter.misses);
+  }
+  os << absl::StrFormat("Constraints: %d added, %d duplicates suppressed\n",
+                        stats.constraints, stats.duplicate_constraints);
+  os << absl::StrFormat("Constant folding: %d literals fixed, %d constraints "
+                        "folded\n", stats.fixed_literals,
+                        stats.folded_constraints);
+  os << absl::StrFormat("Cache key bytes: %d\n", stats.key_bytes);
+  if (!stats.constraint_arity.empty()) {
+    os << absl::StrFormat("%-24s %12s\n", "Constraint arity", "Count");
+    for (const auto& [arity, count] : stats.constraint_arity) {
+      os << absl::StrFormat("%-24d %12d\n", arity, count);
+    }
+  }
+  return os;
+}
+
+vector<string> ModelWrapper::VarNames() const {
+  const CpModelProto& model_pb = model_.Build();
+  vector<string> names(model_pb.variables_size());
+  for (int i = 0; i < model_pb.variables_size(); ++i) {
+    names[i] = model_pb.variables(i).name();
+  }
+  if (named_) {
+    return names;
+  }
+  for (int i = 0; i < model_pb.variables_size(); ++i) {
+    const auto& domain = model_pb.variables(i).domain();
+    if (domain.size() == 2 && domain[0] == domain[1]) {
+      names[i] = absl::StrCat(domain[0]);  // FalseVar or TrueVar.
+    }
+  }
+  for (const auto& it : var_cache_) {
+    names[it.second.index()] = it.first;
+  }
+  for (const auto& it : int_var_cache_) {
+    names[it.second.index()] = it.first;
+  }
+  for (const VarFamily& family : families_) {
+    vector<int> key(family.dims.size());
+    for (int index = 0; index < family.vars.size(); ++index) {
+      if (!family.vars[index].has_value()) {
+        continue;
+      }
+      for (int i = family.dims.size() - 1, rest = index; i >= 0; --i) {
+        key[i] = rest % family.dims[i];
+        rest /= family.dims[i];
+      }
+      names[family.vars[index]->index()] = family.namer(key);
+    }
+  }
+  // Derived variables are named after their structural keys. Literals are
+  // always created before the variables derived from them.
+  vector<pair<int, absl::Span<const int>>> derived;
+  for (const auto& it : equivalent_var_cache_) {
+    derived.push_back({it.second.index(), it.first});
+  }
+  std::sort(derived.begin(), derived.end());
+  for (const auto& [index, key] : derived) {
+    const KeyOp op = KeyOp(key[0]);
+    const int literals_start = op == kVarSumEq ? 2 : 1;
+    vector<string> literal_names;
+    for (int i = literals_start; i < key.size(); ++i) {
+      const int literal = key[i];
+      literal_names.push_back(literal >= 0 ? names[literal] : absl::StrFormat(
+          "Not(%s)", names[NegatedRef(literal)]));
+    }
+    const string separator = op == kVarAnd ? " ^ " : op == kVarOr ? " V " : " + ";
+    string name = absl::StrJoin(literal_names, separator);
+    if (op == kVarSumEq) {
+      name = absl::StrFormat("%d = %s", key[1], name);
+    }
+    names[index] = absl::StrCat("(", name, ")");
+  }
+  return names;
+}
+
+vector<VarKey> ModelWrapper::VarKeys() const {
+  const CpModelProto& model_pb = model_.Build();
+  const vector<string> names = VarNames();
+  vector<VarKey> keys(names.size(), {.family = "Auxiliary"});
+  for (const auto& it : var_cache_) {
+    keys[it.second.index()] = {.family = "NewVar", .name = it.first};
+  }
+  for (const auto& it : int_var_cache_) {
+    keys[it.second.index()] = {.family = "IntVar", .name = it.first};
+  }
+  for (const VarFamily& family : families_) {
+    for (const auto& v : family.vars) {
+      if (v.has_value()) {
+        keys[v->index()] = {.family = family.name, .name = names[v->index()]};
+      }
+    }
+  }
+  for (const auto& it : equivalent_var_cache_) {
+    // Derived variables can be aliases of other literals.
+    const int index = it.second.index();
+    if (RefIsPositive(index) && keys[index].family == "Auxiliary") {
+      keys[index] = {.family = "EquivalentVar", .name = names[index]};
+    }
+  }
+  // Constants, including derived variables folded to a constant.
+  for (int i = 0; i < keys.size(); ++i) {
+    const auto& domain = model_pb.variables(i).domain();
+    if ((keys[i].family == "Auxiliary" || keys[i].family == "EquivalentVar") &&
+        domain.size() == 2 && domain[0] == domain[1]) {
+      keys[i] = {.family = "Constant", .name = absl::StrCat(domain[0])};
+    }
+  }
+  return keys;
+}
+
+void ModelWrapper::NameVariables(CpModelProto* model) const {
+  const vector<string> names = VarNames();
+  for (int i = 0; i < model->variables_size() && i < names.size(); ++i) {
+    if (model->variables(i).name().empty()) {
+      model->mutable_variables(i)->set_name(names[i]);
+    }
+  }
+}
+
+int ModelWrapper::NumConstraintLiterals(int from_constraint) const {
+  const CpModelProto& model_pb = model_.Build();
+  int result = 0;
+  for (int i = from_constraint; i < model_pb.constraints_size(); ++i) {
+    result += NumLiterals(model_pb.constraints(i));
+  }
+  return result;
+}
+
 void ModelWrapper::WriteToFile(const path& filename) const {
-  WriteProtoToFile(model_.Build(), filename);
+  if (named_) {
+    WriteProtoToFile(model_.Build(), filename);
+    return;
+  }
+  CpModelProto model_pb = model_.Build();
+  NameVariables(&model_pb);
+  WriteProtoToFile(model_pb, filename);
 }
 
 void ModelWrapper::WriteVariablesToFile(const path& filename) const {
-  const auto& model_pb = model_.Build();
+  CpModelProto model_pb = model_.Build();
+  NameVariables(&model_pb);
   ofstream f;
   f.open(filename);
     for (int i = 0; i < model_pb.variables_size(); ++i) {
@@ -92,16 +465,26 @@ void ModelWrapper::WriteVariablesToFile(const path& filename) const {
 void ModelWrapper::WriteSatSolutionToFile(const CpSolverResponse& response,
                                           const path& filename) {
   // We print the model variables sorted by name.
+  const vector<string> names = VarNames();
   vector<BoolVar> vars;
   for (const auto& it : var_cache_) {
     vars.push_back(it.second);
   }
+  for (const VarFamily& family : families_) {
+    for (const auto& v : family.vars) {
+      if (v.has_value()) {
+        vars.push_back(*v);
+      }
+    }
+  }
   std::sort(vars.begin(), vars.end(),
-      [](const BoolVar& l, const BoolVar& r) { return l.Name() < r.Name(); });
+      [&names](const BoolVar& l, const BoolVar& r) {
+        return names[l.index()] < names[r.index()];
+      });
   ofstream f;
   f.open(filename);
   for (const BoolVar& v : vars) {
-    f << v.Name() << ": " << SolutionIntegerValue(response, v) << "\n";
+    f << names[v.index()] << ": " << SolutionIntegerValue(response, v) << "\n";
   }
   f.close();
 }
@@ -109,100 +492,375 @@ void ModelWrapper::WriteSatSolutionToFile(const CpSolverResponse& response,
 BoolVar ModelWrapper::NewVar(const string& name) {
   const auto it = var_cache_.find(name);
   if (it != var_cache_.end()) {
+    ++named_var_counter_.hits;
     return it->second;
   }
-  BoolVar v = model_.NewBoolVar().WithName(name);
+  ++named_var_counter_.misses;
+  BoolVar v = named_ ? model_.NewBoolVar().WithName(name)
+                     : model_.NewBoolVar();
   var_cache_[name] = v;
   return v;
 }
 
+IntVar ModelWrapper::NewIntVar(absl::Span<const int64_t> values,
+                               const string& name) {
+  const auto it = int_var_cache_.find(name);
+  if (it != int_var_cache_.end()) {
+    return it->second;
+  }
+  IntVar v = model_.NewIntVar(
+      Domain::FromValues(vector<int64_t>(values.begin(), values.end())));
+  if (named_) {
+    v = v.WithName(name);
+  }
+  int_var_cache_[name] = v;
+  return v;
+}
+
+void ModelWrapper::SetAssumptions(absl::Span<const BoolVar> literals,
+                                  CpModelProto* model) {
+  model->clear_assumptions();
+  for (const BoolVar& literal : literals) {
+    model->add_assumptions(literal.index());
+  }
+}
+
+void ModelWrapper::SetDecisionStrategy(const vector<vector<BoolVar>>& stages,
+                                       CpModelProto* model) {
+  model->clear_search_strategy();
+  for (const vector<BoolVar>& stage : stages) {
+    if (stage.empty()) {
+      continue;
+    }
+    DecisionStrategyProto* strategy = model->add_search_strategy();
+    for (const BoolVar& literal : stage) {
+      strategy->add_variables(literal.index());
+    }
+    strategy->set_variable_selection_strategy(
+        DecisionStrategyProto::CHOOSE_FIRST);
+    strategy->set_domain_reduction_strategy(
+        DecisionStrategyProto::SELECT_MAX_VALUE);
+  }
+}
+
+int ModelWrapper::NewVarFamily(const string& name, absl::Span<const int> dims,
+                               VarNamer namer) {
+  int size = 1;
+  for (int d : dims) {
+    CHECK_GT(d, 0) << "Invalid variable family dimension";
+    size *= d;
+  }
+  families_.push_back({.name = name,
+                       .dims = vector<int>(dims.begin(), dims.end()),
+                       .namer = namer,
+                       .vars = vector<std::optional<BoolVar>>(size)});
+  return families_.size() - 1;
+}
+
+int ModelWrapper::FamilyIndex(int family, absl::Span<const int> key) const {
+  const auto& dims = families_[family].dims;
+  CHECK_EQ(key.size(), dims.size()) << "Invalid variable family key";
+  int index = 0;
+  for (int i = 0; i < dims.size(); ++i) {
+    CHECK(key[i] >= 0 && key[i] < dims[i]) << "Variable family key out of range";
+    index = index * dims[i] + key[i];
+  }
+  return index;
+}
+
+BoolVar ModelWrapper::FamilyVar(int family, absl::Span<const int> key) {
+  VarFamily& f = families_[family];
+  auto& v = f.vars[FamilyIndex(family, key)];
+  if (v.has_value()) {
+    ++f.counter.hits;
+  } else {
+    ++f.counter.misses;
+    v = named_ ? model_.NewBoolVar().WithName(f.namer(key))
+               : model_.NewBoolVar();
+  }
+  return *v;
+}
+
+int ModelWrapper::LiteralValue(const BoolVar& literal) {
+  if (!constant_folding_) {
+    return -1;
+  }
+  const int index = literal.index();
+  const int var = index >= 0 ? index : NegatedRef(index);
+  if (var >= values_.size()) {
+    const CpModelProto& model_pb = model_.Build();
+    for (int i = values_.size(); i <= var; ++i) {
+      const auto& domain = model_pb.variables(i).domain();
+      values_.push_back(domain.size() == 2 && domain[0] == domain[1]
+                            ? domain[0] : -1);
+    }
+  }
+  const int value = values_[var];
+  if (value < 0) {
+    return -1;
+  }
+  return index >= 0 ? value : 1 - value;
+}
+
+void ModelWrapper::FixLiteral(const BoolVar& literal) {
+  switch (LiteralValue(literal)) {
+    case 0:
+      AddContradiction(absl::StrCat("fixed literal ", literal.Name()));
+      return;
+    case 1:
+      return;
+  }
+  const int index = literal.index();
+  const int var = index >= 0 ? index : NegatedRef(index);
+  if (constant_folding_) {
+    values_[var] = index >= 0;
+    ++fixed_literals_;
+  }
+  model_.FixVariable(model_.GetBoolVarFromProtoIndex(var), index >= 0);
+}
+
+ModelWrapper::FoldedLiterals ModelWrapper::Fold(
+    absl::Span<const BoolVar> literals) {
+  FoldedLiterals result;
+  if (!constant_folding_) {
+    result.unfixed.assign(literals.begin(), literals.end());
+    return result;
+  }
+  for (const BoolVar& v : literals) {
+    switch (LiteralValue(v)) {
+      case 0:
+        ++result.num_false;
+        break;
+      case 1:
+        ++result.num_true;
+        break;
+      default:
+        result.unfixed.push_back(v);
+    }
+  }
+  return result;
+}
+
 void ModelWrapper::FixVariable(const BoolVar& var, bool val) {
-  model_.FixVariable(var, val);
+  FixLiteral(val ? var : Not(var));
 }
 
 void ModelWrapper::AddAnd(absl::Span<const BoolVar> literals) {
-  const string name = AndConstraintName(literals);
-  if (!constraint_cache_.contains(name)) {
-    model_.AddBoolAnd(literals).WithName(name);
-    constraint_cache_.insert(name);
+  if (constant_folding_) {  // All literals are units.
+    ++folded_constraints_;
+    for (const BoolVar& v : literals) {
+      FixLiteral(v);
+    }
+    return;
+  }
+  if (IsNewConstraint(StructuralKey(kAnd, {}, literals, &key_))) {
+    Constraint c = model_.AddBoolAnd(literals);
+    if (named_) {
+      c.WithName(AndConstraintName(literals));
+    }
   }
 }
 
 void ModelWrapper::AddOr(absl::Span<const BoolVar> literals) {
-  const string name = OrConstraintName(literals);
-  if (!constraint_cache_.contains(name)) {
-    model_.AddBoolOr(literals).WithName(name);
-    constraint_cache_.insert(name);
+  const FoldedLiterals f = Fold(literals);
+  if (constant_folding_ && (f.num_true > 0 || f.unfixed.size() <= 1)) {
+    ++folded_constraints_;
+    if (f.num_true > 0) {
+      return;  // Satisfied.
+    }
+    if (f.unfixed.empty()) {
+      AddContradiction(absl::StrCat("false clause ",
+                                    OrConstraintName(literals)));
+    } else {
+      FixLiteral(f.unfixed[0]);
+    }
+    return;
+  }
+  if (IsNewConstraint(StructuralKey(kOr, {}, f.unfixed, &key_))) {
+    Constraint c = model_.AddBoolOr(f.unfixed);
+    if (named_) {
+      c.WithName(OrConstraintName(f.unfixed));
+    }
   }
 }
 
 void ModelWrapper::AddEquality(const BoolVar& v1, const BoolVar& v2) {
-  const bool less = v1.Name() < v2.Name();
+  const int val1 = LiteralValue(v1);
+  const int val2 = LiteralValue(v2);
+  if (val1 >= 0 || val2 >= 0) {
+    ++folded_constraints_;
+    if (val1 < 0) {
+      FixLiteral(val2 ? v1 : Not(v1));
+    } else if (val2 < 0) {
+      FixLiteral(val1 ? v2 : Not(v2));
+    } else if (val1 != val2) {
+      AddContradiction(absl::StrFormat("%s = %s", v1.Name(), v2.Name()));
+    }
+    return;
+  }
+  const bool less = v1.index() < v2.index();
   const BoolVar& left = less ? v1 : v2;
   const BoolVar& right = less ? v2 : v1;
-  const string name = absl::StrFormat("%s = %s", left.Name(), right.Name());
-  if (!constraint_cache_.contains(name)) {
-    model_.AddEquality(left, right).WithName(name);
-    constraint_cache_.insert(name);
+  if (IsNewConstraint(StructuralKey(kEquality, {left.index(), right.index()},
+                                    {}, &key_))) {
+    Constraint c = model_.AddEquality(left, right);
+    if (named_) {
+      c.WithName(absl::StrFormat("%s = %s", left.Name(), right.Name()));
+    }
   }
 }
 
 void ModelWrapper::AddImplication(const BoolVar& v1, const BoolVar& v2) {
-  const string name = absl::StrFormat("%s -> %s", v1.Name(), v2.Name());
-  if (!constraint_cache_.contains(name)) {
-    model_.AddImplication(v1, v2).WithName(name);
-    constraint_cache_.insert(name);
+  const int val1 = LiteralValue(v1);
+  const int val2 = LiteralValue(v2);
+  if (val1 >= 0 || val2 >= 0) {
+    ++folded_constraints_;
+    if (val1 == 1) {
+      FixLiteral(v2);
+    } else if (val2 == 0) {
+      FixLiteral(Not(v1));
+    }
+    return;
+  }
+  if (IsNewConstraint(StructuralKey(kImplication, {v1.index(), v2.index()},
+                                    {}, &key_))) {
+    Constraint c = model_.AddImplication(v1, v2);
+    if (named_) {
+      c.WithName(absl::StrFormat("%s -> %s", v1.Name(), v2.Name()));
+    }
   }
 }
 
 void ModelWrapper::AddImplicationAnd(const BoolVar& var,
                                      absl::Span<const BoolVar> literals) {
   if (literals.size() == 0) {
-    model_.FixVariable(var, false);
+    FixVariable(var, false);
     return;
   }
-  const string name = AndConstraintName(var, literals);
-  if (!constraint_cache_.contains(name)) {
-    model_.AddBoolAnd(literals).OnlyEnforceIf(var).WithName(name);
-    constraint_cache_.insert(name);
+  const int val = LiteralValue(var);
+  const FoldedLiterals f = Fold(literals);
+  if (val >= 0 || f.num_false > 0 || f.unfixed.empty()) {
+    ++folded_constraints_;
+    if (val == 0) {
+      return;
+    }
+    if (f.num_false > 0) {
+      FixLiteral(Not(var));
+      return;
+    }
+    if (val == 1) {
+      for (const BoolVar& v : f.unfixed) {
+        FixLiteral(v);
+      }
+    }
+    return;
+  }
+  if (IsNewConstraint(StructuralKey(kImplicationAnd, {var.index()},
+                                    f.unfixed, &key_))) {
+    Constraint c = model_.AddBoolAnd(f.unfixed).OnlyEnforceIf(var);
+    if (named_) {
+      c.WithName(AndConstraintName(var, f.unfixed));
+    }
   }
 }
 
 void ModelWrapper::AddImplicationOr(const BoolVar& var,
                                     absl::Span<const BoolVar> literals) {
   if (literals.size() == 0) {
-    model_.FixVariable(var, false);
+    FixVariable(var, false);
     return;
   }
-  const string name = OrConstraintName(var, literals);
-  if (!constraint_cache_.contains(name)) {
-    model_.AddBoolOr(literals).OnlyEnforceIf(var).WithName(name);
-    constraint_cache_.insert(name);
+  const int val = LiteralValue(var);
+  const FoldedLiterals f = Fold(literals);
+  if (val == 0 || f.num_true > 0 || f.unfixed.empty()) {
+    ++folded_constraints_;
+    if (val != 0 && f.num_true == 0) {
+      FixLiteral(Not(var));
+    }
+    return;
+  }
+  if (val == 1) {
+    AddOr(f.unfixed);
+    return;
+  }
+  if (IsNewConstraint(StructuralKey(kImplicationOr, {var.index()},
+                                    f.unfixed, &key_))) {
+    Constraint c = model_.AddBoolOr(f.unfixed).OnlyEnforceIf(var);
+    if (named_) {
+      c.WithName(OrConstraintName(var, f.unfixed));
+    }
   }
 }
 
 void ModelWrapper::AddImplicationSum(
-  const BoolVar& var, absl::Span<const BoolVar> literals, int sum) {
-  const string name = absl::StrFormat(
-      "%s -> %d = %s", var.Name(), sum, ConstraintName("+", literals));
-  if (!constraint_cache_.contains(name)) {
-    model_.AddEquality(LinearExpr::Sum(literals), sum)
-          .OnlyEnforceIf(var)
-          .WithName(name);
-    constraint_cache_.insert(name);
+    const BoolVar& var, absl::Span<const BoolVar> literals, int sum,
+    CardinalityEncoding encoding) {
+  if (encoding == CardinalityEncoding::kDefault) {
+    encoding = default_encoding_;
+  }
+  const int val = LiteralValue(var);
+  const FoldedLiterals f = Fold(literals);
+  const int n = f.unfixed.size();
+  sum -= f.num_true;
+  if (constant_folding_ && (val == 0 || sum < 0 || sum > n || n == 0)) {
+    ++folded_constraints_;
+    if (val != 0 && (sum < 0 || sum > n)) {
+      FixLiteral(Not(var));
+    }
+    return;
+  }
+  if (val == 1) {
+    AddEqualitySum(f.unfixed, sum, encoding);
+    return;
+  }
+  if (IsNewConstraint(StructuralKey(kImplicationSum, {var.index(), sum},
+                                    f.unfixed, &key_))) {
+    if (encoding != CardinalityEncoding::kLinear) {
+      AddUnaryCountSumEq(var, f.unfixed, sum, encoding, /*equivalent=*/false);
+      return;
+    }
+    Constraint c = model_.AddEquality(LinearExpr::Sum(f.unfixed), sum)
+                         .OnlyEnforceIf(var);
+    if (named_) {
+      c.WithName(absl::StrFormat("%s -> %d = %s", var.Name(), sum,
+                                 ConstraintName("+", f.unfixed)));
+    }
   }
 }
 
 void ModelWrapper::AddImplicationEq(const BoolVar& var,
                                     const BoolVar& left,
                                     const BoolVar& right) {
-  const string name = absl::StrFormat(
-      "%s -> %s = %s", var.Name(), left.Name(), right.Name());
-  if (!constraint_cache_.contains(name)) {
-    model_.AddEquality(left, right)
-          .OnlyEnforceIf(var)
-          .WithName(name);
-    constraint_cache_.insert(name);
+  const int val = LiteralValue(var);
+  const int left_val = LiteralValue(left);
+  const int right_val = LiteralValue(right);
+  if (val >= 0 || left_val >= 0 || right_val >= 0) {
+    if (val == 1) {
+      AddEquality(left, right);
+      return;
+    }
+    if (val == 0 || (left_val >= 0 && right_val >= 0)) {
+      ++folded_constraints_;
+      if (val != 0 && left_val != right_val) {
+        FixLiteral(Not(var));
+      }
+      return;
+    }
+    // One side is fixed, so var implies the value of the other side.
+    const BoolVar& other = left_val >= 0 ? right : left;
+    const int value = left_val >= 0 ? left_val : right_val;
+    AddImplication(var, value ? other : Not(other));
+    return;
+  }
+  const int l = std::min(left.index(), right.index());
+  const int r = std::max(left.index(), right.index());
+  if (IsNewConstraint(StructuralKey(kImplicationEq, {var.index(), l, r}, {},
+                                    &key_))) {
+    Constraint c = model_.AddEquality(left, right).OnlyEnforceIf(var);
+    if (named_) {
+      c.WithName(absl::StrFormat(
+          "%s -> %s = %s", var.Name(), left.Name(), right.Name()));
+    }
   }
 }
 
@@ -220,56 +878,412 @@ void ModelWrapper::AddEquivalenceOr(
 
 void ModelWrapper::AddEquivalenceSum(const BoolVar& var,
                                      absl::Span<const BoolVar> literals) {
-  const string name = absl::StrFormat(
-      "%s = %s", var.Name(), ConstraintName("+", literals));
-  if (!constraint_cache_.contains(name)) {
-    model_.AddEquality(LinearExpr::Sum(literals), var).WithName(name);
-    constraint_cache_.insert(name);
+  const int val = LiteralValue(var);
+  const FoldedLiterals f = Fold(literals);
+  if (constant_folding_ &&
+      (val >= 0 || f.num_true > 0 || f.unfixed.size() <= 1)) {
+    ++folded_constraints_;
+    if (f.num_true > 1) {
+      AddContradiction(absl::StrFormat(
+          "%s = %s", var.Name(), ConstraintName("+", literals)));
+    } else if (f.num_true == 1) {
+      FixLiteral(var);
+      AddEqualitySum(f.unfixed, 0);
+    } else if (val >= 0) {
+      AddEqualitySum(f.unfixed, val);
+    } else if (f.unfixed.empty()) {
+      FixLiteral(Not(var));
+    } else {
+      AddEquality(var, f.unfixed[0]);
+    }
+    return;
+  }
+  if (IsNewConstraint(StructuralKey(kEquivalenceSum, {var.index()},
+                                    f.unfixed, &key_))) {
+    Constraint c = model_.AddEquality(LinearExpr::Sum(f.unfixed), var);
+    if (named_) {
+      c.WithName(absl::StrFormat(
+          "%s = %s", var.Name(), ConstraintName("+", f.unfixed)));
+    }
   }
 }
 
 void ModelWrapper::AddEquivalenceSumEq(const BoolVar& var,
                                        absl::Span<const BoolVar> literals,
-                                       int sum) {
-  const string sum_name = ConstraintName("+", literals);
-  const string name1 = absl::StrFormat(
-      "%s -> %d = %s", var.Name(), sum, sum_name);
-  const string name2 = absl::StrFormat(
-      "%s -> %d != %s", Not(var).Name(), sum, sum_name);
-  if (!constraint_cache_.contains(name1)) {
-    model_.AddEquality(LinearExpr::Sum(literals), sum)
-          .OnlyEnforceIf(var)
-          .WithName(name1);
-    constraint_cache_.insert(name1);
+                                       int sum, CardinalityEncoding encoding) {
+  if (encoding == CardinalityEncoding::kDefault) {
+    encoding = default_encoding_;
   }
-  if (!constraint_cache_.contains(name2)) {
-    model_.AddNotEqual(LinearExpr::Sum(literals), sum)
-          .OnlyEnforceIf(Not(var))
-          .WithName(name2);
-    constraint_cache_.insert(name2);
+  const int val = LiteralValue(var);
+  const FoldedLiterals f = Fold(literals);
+  const int n = f.unfixed.size();
+  sum -= f.num_true;
+  if (constant_folding_) {
+    if (sum < 0 || sum > n || n == 0) {  // The sum is constant.
+      ++folded_constraints_;
+      FixLiteral(sum == 0 ? var : Not(var));
+      return;
+    }
+    if (val == 1) {
+      AddEqualitySum(f.unfixed, sum, encoding);
+      return;
+    }
+  }
+  AddImplicationSum(var, f.unfixed, sum, encoding);
+  if (IsNewConstraint(StructuralKey(kImplicationNotSum,
+                                    {Not(var).index(), sum}, f.unfixed,
+                                    &key_))) {
+    if (encoding != CardinalityEncoding::kLinear) {
+      AddUnaryCountSumEq(var, f.unfixed, sum, encoding, /*equivalent=*/true);
+      return;
+    }
+    Constraint c = model_.AddNotEqual(LinearExpr::Sum(f.unfixed), sum)
+                         .OnlyEnforceIf(Not(var));
+    if (named_) {
+      c.WithName(absl::StrFormat("%s -> %d != %s", Not(var).Name(), sum,
+                                 ConstraintName("+", f.unfixed)));
+    }
   }
 }
 
-void ModelWrapper::AddEqualitySum(absl::Span<const BoolVar> literals, int sum) {
-  const string name = absl::StrFormat(
-      "%d = %s", sum, ConstraintName("+", literals));
-  if (!constraint_cache_.contains(name)) {
-    model_.AddEquality(LinearExpr::Sum(literals), sum).WithName(name);
-    constraint_cache_.insert(name);
+void ModelWrapper::AddEqualitySum(absl::Span<const BoolVar> literals, int sum,
+                                  CardinalityEncoding encoding) {
+  if (encoding == CardinalityEncoding::kDefault) {
+    encoding = default_encoding_;
+  }
+  const FoldedLiterals f = Fold(literals);
+  const int n = f.unfixed.size();
+  sum -= f.num_true;
+  if (constant_folding_ && (sum <= 0 || sum >= n)) {
+    ++folded_constraints_;
+    if (sum < 0 || sum > n) {
+      AddContradiction(absl::StrFormat(
+          "%d = %s", sum + f.num_true, ConstraintName("+", literals)));
+      return;
+    }
+    for (const BoolVar& v : f.unfixed) {  // All false or all true.
+      FixLiteral(sum == 0 ? Not(v) : v);
+    }
+    return;
+  }
+  if (IsNewConstraint(StructuralKey(kEqualitySum, {sum}, f.unfixed, &key_))) {
+    if (encoding != CardinalityEncoding::kLinear) {
+      AddUnaryCountSumEq(TrueVar(), f.unfixed, sum, encoding,
+                         /*equivalent=*/false);
+      return;
+    }
+    Constraint c = model_.AddEquality(LinearExpr::Sum(f.unfixed), sum);
+    if (named_) {
+      c.WithName(absl::StrFormat(
+          "%d = %s", sum, ConstraintName("+", f.unfixed)));
+    }
   }
 }
 
 void ModelWrapper::AddAtMostOne(absl::Span<const BoolVar> literals) {
-  const string name = absl::StrFormat("1 >= %s", ConstraintName("+", literals));
-  if (!constraint_cache_.contains(name)) {
-    model_.AddAtMostOne(literals).WithName(name);
-    constraint_cache_.insert(name);
+  const FoldedLiterals f = Fold(literals);
+  if (constant_folding_ && (f.num_true > 0 || f.unfixed.size() <= 1)) {
+    ++folded_constraints_;
+    if (f.num_true > 1) {
+      AddContradiction(absl::StrFormat("1 >= %s",
+                                       ConstraintName("+", literals)));
+    } else if (f.num_true == 1) {
+      for (const BoolVar& v : f.unfixed) {
+        FixLiteral(Not(v));
+      }
+    }
+    return;
+  }
+  if (IsNewConstraint(StructuralKey(kAtMostOne, {}, f.unfixed, &key_))) {
+    Constraint c = model_.AddAtMostOne(f.unfixed);
+    if (named_) {
+      c.WithName(absl::StrFormat("1 >= %s", ConstraintName("+", f.unfixed)));
+    }
+  }
+}
+
+void ModelWrapper::AddEquivalenceIntEq(const BoolVar& var, const IntVar& x,
+                                       int64_t value) {
+  if (!IsNewConstraint(StructuralKey(
+          kIntEq, {var.index(), x.index(), static_cast<int>(value)}, {},
+          &key_))) {
+    return;
+  }
+  const int val = LiteralValue(var);
+  if (val == 1) {
+    Constraint c = model_.AddEquality(x, value);
+    if (named_) {
+      c.WithName(absl::StrFormat("%s = %d", x.Name(), value));
+    }
+    return;
+  }
+  if (val == 0) {
+    Constraint c = model_.AddNotEqual(x, value);
+    if (named_) {
+      c.WithName(absl::StrFormat("%s != %d", x.Name(), value));
+    }
+    return;
+  }
+  Constraint eq = model_.AddEquality(x, value).OnlyEnforceIf(var);
+  Constraint ne = model_.AddNotEqual(x, value).OnlyEnforceIf(Not(var));
+  if (named_) {
+    eq.WithName(absl::StrFormat("%s -> %s = %d", var.Name(), x.Name(), value));
+    ne.WithName(absl::StrFormat("%s -> %s != %d", Not(var).Name(), x.Name(),
+                                value));
+  }
+}
+
+void ModelWrapper::AddAllowedAssignments(
+    absl::Span<const BoolVar> literals,
+    const vector<vector<int64_t>>& tuples) {
+  // The table is over the variables of the unfixed literals, so the columns of
+  // the fixed literals only filter the tuples.
+  vector<int> columns;
+  vector<IntVar> vars;
+  for (int i = 0; i < literals.size(); ++i) {
+    if (LiteralValue(literals[i]) < 0) {
+      columns.push_back(i);
+      const BoolVar& l = literals[i];
+      vars.push_back(IntVar(RefIsPositive(l.index()) ? l : Not(l)));
+    }
+  }
+  std::set<vector<int64_t>> projected;
+  for (const vector<int64_t>& tuple : tuples) {
+    CHECK_EQ(tuple.size(), literals.size());
+    bool allowed = true;
+    for (int i = 0; i < literals.size() && allowed; ++i) {
+      const int value = LiteralValue(literals[i]);
+      allowed = value < 0 || value == tuple[i];
+    }
+    if (!allowed) {
+      continue;
+    }
+    vector<int64_t> row;
+    for (int i : columns) {
+      row.push_back(RefIsPositive(literals[i].index()) ? tuple[i]
+                                                        : 1 - tuple[i]);
+    }
+    projected.insert(row);
+  }
+  if (projected.empty()) {
+    AddContradiction(absl::StrFormat(
+        "no allowed assignment of %s", ConstraintName(",", literals)));
+    return;
+  }
+  if (constant_folding_ && projected.size() == 1) {
+    ++folded_constraints_;
+    const vector<int64_t>& row = *projected.begin();
+    for (int j = 0; j < vars.size(); ++j) {
+      const BoolVar v = vars[j].ToBoolVar();
+      FixLiteral(row[j] == 1 ? v : Not(v));
+    }
+    return;
+  }
+  // The key of a table is its operator tag, its number of columns, the
+  // column variables in order, and the sorted rows.
+  key_.assign({kTable, static_cast<int>(vars.size())});
+  for (const IntVar& var : vars) {
+    key_.push_back(var.index());
+  }
+  for (const vector<int64_t>& row : projected) {
+    key_.insert(key_.end(), row.begin(), row.end());
+  }
+  if (!IsNewConstraint(key_)) {
+    return;
+  }
+  TableConstraint c = model_.AddAllowedAssignments(vars);
+  for (const vector<int64_t>& row : projected) {
+    c.AddTuple(row);
+  }
+  if (named_) {
+    c.WithName(absl::StrFormat("%s in %d tuples", ConstraintName(",", literals),
+                               projected.size()));
   }
 }
 
 void ModelWrapper::AddContradiction(const string& reason) {
-  model_.AddBoolOr({model_.FalseVar()})
-        .WithName(absl::StrCat("Contradiction: ", reason));
+  Constraint c = model_.AddBoolOr({model_.FalseVar()});
+  if (named_) {
+    c.WithName(absl::StrCat("Contradiction: ", reason));
+  }
+}
+
+void ModelWrapper::AddUnaryCountSumEq(const BoolVar& var,
+                                      absl::Span<const BoolVar> literals,
+                                      int sum, CardinalityEncoding encoding,
+                                      bool equivalent) {
+  const int n = literals.size();
+  if (sum < 0 || sum > n) {
+    AddOr({Not(var)});  // The sum is impossible.
+    return;
+  }
+  // Sum(literals) == sum iff count >= sum and not count >= sum + 1.
+  const vector<BoolVar> count = UnaryCount(literals, std::min(sum + 1, n),
+                                           encoding);
+  vector<BoolVar> sum_eq;
+  if (sum > 0) {
+    sum_eq.push_back(count[sum - 1]);
+  }
+  if (sum < n) {
+    sum_eq.push_back(Not(count[sum]));
+  }
+  if (sum_eq.empty()) {  // Always true.
+    if (equivalent) {
+      AddOr({var});
+    }
+    return;
+  }
+  if (equivalent) {
+    AddEquivalenceAnd(var, sum_eq);
+  } else {
+    AddImplicationAnd(var, sum_eq);
+  }
+}
+
+vector<BoolVar> ModelWrapper::UnaryCount(absl::Span<const BoolVar> literals,
+                                         int bound,
+                                         CardinalityEncoding encoding) {
+  if (bound <= 0) {
+    return {};
+  }
+  switch (encoding) {
+    case CardinalityEncoding::kSequentialCounter:
+      return SequentialCounter(literals, bound);
+    case CardinalityEncoding::kTotalizer:
+      return Totalizer(literals, bound);
+    case CardinalityEncoding::kCardinalityNetwork:
+      return SortingNetwork(literals, bound);
+    default:
+      LOG(FATAL) << "Not a unary count encoding";
+      return {};
+  }
+}
+
+string ModelWrapper::AuxVarName(const string& prefix) const {
+  if (!named_) {
+    return "";
+  }
+  return absl::StrFormat("%s_%d", prefix, model_.Build().variables_size());
+}
+
+vector<BoolVar> ModelWrapper::SequentialCounter(
+    absl::Span<const BoolVar> literals, int bound) {
+  // After processing a literal, count[j] <-> at least j + 1 of the literals
+  // processed so far are true.
+  vector<BoolVar> count;
+  for (const BoolVar& x : literals) {
+    vector<BoolVar> next(std::min<int>(count.size() + 1, bound));
+    for (int j = 0; j < next.size(); ++j) {
+      const BoolVar carry = j == 0 ? x : NewEquivalentVarAnd(
+          {x, count[j - 1]}, AuxVarName("seq_carry"));
+      next[j] = j < count.size() ? NewEquivalentVarOr(
+          {count[j], carry}, AuxVarName("seq_count")) : carry;
+    }
+    count = std::move(next);
+  }
+  return count;
+}
+
+vector<BoolVar> ModelWrapper::Totalizer(absl::Span<const BoolVar> literals,
+                                        int bound) {
+  if (literals.size() == 1) {
+    return {literals[0]};
+  }
+  const int half = literals.size() / 2;
+  const vector<BoolVar> left = Totalizer(literals.subspan(0, half), bound);
+  const vector<BoolVar> right = Totalizer(literals.subspan(half), bound);
+  // Sum >= j + 1 iff left >= a and right >= b, for some a + b = j + 1.
+  const int size = std::min<int>(left.size() + right.size(), bound);
+  vector<BoolVar> count;
+  for (int j = 0; j < size; ++j) {
+    vector<BoolVar> cases;
+    for (int a = 0; a <= j + 1 && a <= left.size(); ++a) {
+      const int b = j + 1 - a;
+      if (b > right.size()) {
+        continue;
+      }
+      if (a == 0) {
+        cases.push_back(right[b - 1]);
+      } else if (b == 0) {
+        cases.push_back(left[a - 1]);
+      } else {
+        cases.push_back(NewEquivalentVarAnd({left[a - 1], right[b - 1]},
+                                            AuxVarName("totalizer_case")));
+      }
+    }
+    count.push_back(NewEquivalentVarOr(cases, AuxVarName("totalizer_count")));
+  }
+  return count;
+}
+
+vector<BoolVar> ModelWrapper::SortingNetwork(
+    absl::Span<const BoolVar> literals, int bound) {
+  // Pads the literals to a power of 2 and truncates the sorted halves to the
+  // smallest power of 2 >= bound, since only their top elements can be in the
+  // top bound of the merged result.
+  int size = 1, width = 1;
+  while (size < literals.size()) {
+    size *= 2;
+  }
+  while (width < bound) {
+    width *= 2;
+  }
+  vector<BoolVar> padded(literals.begin(), literals.end());
+  padded.resize(size, FalseVar());
+  std::function<vector<BoolVar>(absl::Span<const BoolVar>)> sort =
+      [&](absl::Span<const BoolVar> lits) -> vector<BoolVar> {
+    if (lits.size() == 1) {
+      return {lits[0]};
+    }
+    const int half = lits.size() / 2;
+    vector<BoolVar> merged = OddEvenMerge(sort(lits.subspan(0, half)),
+                                          sort(lits.subspan(half)));
+    if (merged.size() > width) {
+      merged.resize(width);
+    }
+    return merged;
+  };
+  vector<BoolVar> sorted = sort(padded);
+  sorted.resize(std::min<int>(literals.size(), bound));
+  return sorted;
+}
+
+vector<BoolVar> ModelWrapper::OddEvenMerge(absl::Span<const BoolVar> left,
+                                           absl::Span<const BoolVar> right) {
+  const int false_index = model_.FalseVar().index();
+  // A comparator puts the larger literal first. The false literal comes from
+  // padding, so it is handled without new variables.
+  auto compare = [&](const BoolVar& a, const BoolVar& b) -> pair<BoolVar,
+                                                                 BoolVar> {
+    if (b.index() == false_index) {
+      return {a, b};
+    }
+    if (a.index() == false_index) {
+      return {b, a};
+    }
+    return {NewEquivalentVarOr({a, b}, AuxVarName("sorter_max")),
+            NewEquivalentVarAnd({a, b}, AuxVarName("sorter_min"))};
+  };
+  const int n = left.size();
+  if (n == 1) {
+    const auto [max, min] = compare(left[0], right[0]);
+    return {max, min};
+  }
+  vector<BoolVar> left_even, left_odd, right_even, right_odd;
+  for (int i = 0; i < n; ++i) {
+    (i % 2 == 0 ? left_even : left_odd).push_back(left[i]);
+    (i % 2 == 0 ? right_even : right_odd).push_back(right[i]);
+  }
+  const vector<BoolVar> even = OddEvenMerge(left_even, right_even);
+  const vector<BoolVar> odd = OddEvenMerge(left_odd, right_odd);
+  vector<BoolVar> merged = {even[0]};
+  for (int i = 0; i < n - 1; ++i) {
+    const auto [max, min] = compare(odd[i], even[i + 1]);
+    merged.push_back(max);
+    merged.push_back(min);
+  }
+  merged.push_back(odd[n - 1]);
+  return merged;
 }
 
 BoolVar ModelWrapper::NewEquivalentVarAnd(
@@ -277,79 +1291,85 @@ BoolVar ModelWrapper::NewEquivalentVarAnd(
   if (literals.size() == 0) {
     return model_.FalseVar();
   }
-  if (literals.size() == 1) {
-    return literals[0];  // Optimization: don't create a new variable.
+  const FoldedLiterals f = Fold(literals);
+  if (f.num_false > 0) {
+    return model_.FalseVar();
   }
-  const string key = ConstraintName("^", literals);
-  const auto it = var_cache_.find(key);
-  if (it != var_cache_.end()) {
-    return it->second;
+  if (f.unfixed.empty()) {  // All literals are true.
+    return model_.TrueVar();
+  }
+  if (f.unfixed.size() == 1) {
+    return f.unfixed[0];  // Optimization: don't create a new variable.
+  }
+  BoolVar var;
+  if (LookupEquivalentVar(StructuralKey(kVarAnd, {}, f.unfixed, &key_), name,
+                          &var)) {
+    AddEquivalenceAnd(var, f.unfixed);
   }
-  BoolVar var = model_.NewBoolVar().WithName(name);
-  AddEquivalenceAnd(var, literals);
-  var_cache_[key] = var;
   return var;
 }
 
 BoolVar ModelWrapper::NewEquivalentVarOr(
     absl::Span<const BoolVar> literals, const string& name) {
-  if (literals.size() == 0) {
+  const FoldedLiterals f = Fold(literals);
+  if (f.num_true > 0) {
+    return model_.TrueVar();
+  }
+  if (f.unfixed.empty()) {
     return model_.FalseVar();
   }
-  if (literals.size() == 1) {
-    return literals[0];  // Optimization: don't create a new variable.
+  if (f.unfixed.size() == 1) {
+    return f.unfixed[0];  // Optimization: don't create a new variable.
   }
-  const string key = ConstraintName("V", literals);
-  const auto it = var_cache_.find(key);
-  if (it != var_cache_.end()) {
-    return it->second;
+  BoolVar var;
+  if (LookupEquivalentVar(StructuralKey(kVarOr, {}, f.unfixed, &key_), name,
+                          &var)) {
+    AddEquivalenceOr(var, f.unfixed);
   }
-  BoolVar var = model_.NewBoolVar().WithName(name);
-  AddEquivalenceOr(var, literals);
-  var_cache_[key] = var;
   return var;
 }
 
 BoolVar ModelWrapper::NewEquivalentVarSum(
     absl::Span<const BoolVar> literals, const string& name) {
-  if (literals.size() == 0) {
+  const FoldedLiterals f = Fold(literals);
+  if (f.num_true > 0) {  // The other literals must be false.
+    AddEquivalenceSum(model_.TrueVar(), literals);
+    return model_.TrueVar();
+  }
+  if (f.unfixed.empty()) {
     return model_.FalseVar();
   }
-  if (literals.size() == 1) {
-    return literals[0];  // Optimization: don't create a new variable.
+  if (f.unfixed.size() == 1) {
+    return f.unfixed[0];  // Optimization: don't create a new variable.
   }
-  const string key = ConstraintName("+", literals);
-  const auto it = var_cache_.find(key);
-  if (it != var_cache_.end()) {
-    return it->second;
+  BoolVar var;
+  if (LookupEquivalentVar(StructuralKey(kVarSum, {}, f.unfixed, &key_), name,
+                          &var)) {
+    AddEquivalenceSum(var, f.unfixed);
   }
-  BoolVar var = model_.NewBoolVar().WithName(name);
-  AddEquivalenceSum(var, literals);
-  var_cache_[key] = var;
   return var;
 }
 
 BoolVar ModelWrapper::NewEquivalentVarSumEq(
-    absl::Span<const BoolVar> literals, int sum, const string& name) {
-  if (literals.size() == 0) {
+    absl::Span<const BoolVar> literals, int sum, const string& name,
+    CardinalityEncoding encoding) {
+  const FoldedLiterals f = Fold(literals);
+  const int n = f.unfixed.size();
+  sum -= f.num_true;
+  if (sum < 0 || sum > n) {
     return model_.FalseVar();
   }
-  if (literals.size() == 1) {
-    switch (sum) {
-      case 0: return Not(literals[0]);
-      case 1: return literals[0];
-      default: model_.FalseVar();
-    }
+  if (n == 0) {
+    return model_.TrueVar();
   }
-  const string key = absl::StrFormat(
-      "%d=%s", sum, ConstraintName("+", literals));
-  const auto it = var_cache_.find(key);
-  if (it != var_cache_.end()) {
-    return it->second;
+  if (n == 1) {  // Optimization: don't create a new variable.
+    return sum == 0 ? Not(f.unfixed[0]) : f.unfixed[0];
+  }
+  BoolVar var;
+  if (LookupEquivalentVar(StructuralKey(kVarSumEq, {sum}, f.unfixed, &key_),
+                          name, &var)) {
+    AddEquivalenceSumEq(var, f.unfixed, sum, encoding);
   }
-  BoolVar var = model_.NewBoolVar().WithName(name);
-  AddEquivalenceSumEq(var, literals, sum);
-  var_cache_[key] = var;
   return var;
 }
 
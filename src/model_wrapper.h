@@ -14,35 +14,138 @@
 #ifndef SRC_MODEL_WRAPPER_H_
 #define SRC_MODEL_WRAPPER_H_
 
+#include <cstdint>
 #include <filesystem>
+#include <functional>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <optional>
 #include <string>
 #include <vector>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
 
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/container/inlined_vector.h"
 #include "absl/strings/str_format.h"
 #include "absl/types/span.h"
 #include "ortools/sat/cp_model.h"
+#include "src/compiled_model.pb.h"
 
 namespace botc {
 
 using operations_research::sat::CpModelBuilder;
+using operations_research::sat::CpModelProto;
 using operations_research::sat::CpSolverResponse;
 using operations_research::sat::BoolVar;
+using operations_research::sat::IntVar;
 using std::filesystem::path;
 using std::map;
+using std::ostream;
+using std::pair;
 using std::string;
 using std::vector;
 using std::unordered_map;
 using std::unordered_set;
 
-vector<BoolVar> Not(absl::Span<const BoolVar> literals);
+// Short lists of literals (clauses, cases of a role), stored inline so that
+// building them while compiling the model does not allocate.
+typedef absl::InlinedVector<BoolVar, 16> Literals;
+
+Literals Not(absl::Span<const BoolVar> literals);
+
+// Formats the name of a variable in a family from its key.
+typedef std::function<string(absl::Span<const int>)> VarNamer;
+
+// Encodings of cardinality constraints (Sum(literals) == k), used by the sum
+// constraints of the ModelWrapper.
+enum class CardinalityEncoding {
+  kDefault,  // The default encoding of the ModelWrapper.
+  kLinear,  // Native CP-SAT linear constraints.
+  kSequentialCounter,  // Unary counters over literal prefixes, O(n * k).
+  kTotalizer,  // Unary counters merged over a binary tree, O(n * k).
+  kCardinalityNetwork,  // Odd-even merge sorting network truncated to k + 1.
+};
+
+// Counters of the ModelWrapper caches, to measure how effective dedup is.
+struct CacheStats {
+  struct Counter {
+    int64_t hits = 0;
+    int64_t misses = 0;  // A miss creates the variable.
+  };
+  // Variable lookups by family name, "NewVar" for named variables, and
+  // "EquivalentVar<kind>" for derived variables.
+  map<string, Counter> vars;
+  int64_t constraints = 0;  // Added to the model.
+  int64_t duplicate_constraints = 0;  // Suppressed by the constraint cache.
+  int64_t key_bytes = 0;  // Held by all cache keys.
+  int64_t fixed_literals = 0;  // Fixed by constant folding.
+  int64_t folded_constraints = 0;  // Dropped or reduced to fixed literals.
+  // Optional histogram of constraint arity (number of literals) to count.
+  map<int, int64_t> constraint_arity;
+};
+ostream& operator<<(ostream& os, const CacheStats& stats);
+
+// Provenance of the constraints of a model: the part of the model that added
+// them and, if applicable, the game specifics they encode (-1 otherwise).
+struct ConstraintTag {
+  string source;  // E.g. a compile phase, or "AddEmpathConstraints".
+  int role = -1;  // A Role enum value.
+  int time = -1;  // A Time index.
+  int event = -1;  // Index of the originating event in the GameLog.
+};
+
+// The constraints of the model in [begin, end) with the same tag.
+struct ConstraintTagRange {
+  ConstraintTag tag;
+  int begin = 0;
+  int end = 0;
+};
+
+// A stable key of a model variable, which does not depend on its index.
+struct VarKey {
+  // The variable family name, "NewVar" for named variables, "EquivalentVar"
+  // for derived variables, "Constant", or "Auxiliary" for encoding variables.
+  string family;
+  string name;  // Empty for auxiliary variables.
+};
 
 // A convenience wrapper over CpModelBuilder.
+// An unnamed wrapper does not materialize any variable or constraint names in
+// the model, which makes it smaller and cheaper to copy. The variable names
+// are then rebuilt from the variable keys when writing to files.
+// With constant folding, the wrapper tracks the literals fixed so far (the
+// constants, fixed variables and unit constraints) and simplifies every new
+// constraint against them before it is emitted: satisfied constraints are
+// dropped, false literals are removed, and constraints reduced to units fix
+// their literals instead. Constraints added earlier are not revisited.
 class ModelWrapper {
  public:
+  explicit ModelWrapper(bool named = true) : named_(named) {}
   const CpModelBuilder& Model() const { return model_; }
+  bool Named() const { return named_; }
+  // Returns the stable keys of all model variables, by index.
+  vector<VarKey> VarKeys() const;
+  // Fills in the missing variable names of a copy of the model.
+  void NameVariables(CpModelProto* model) const;
+  // Returns the number of literals in all constraints from the given index on.
+  int NumConstraintLiterals(int from_constraint) const;
+  // Saves the model with all variable caches. The wrapper can then be restored
+  // with FromProto, after declaring the same variable families.
+  void ToProto(CompiledModel* pb) const;
+  void FromProto(const CompiledModel& pb);
+  // Tags all constraints added from now on, until the next call. Tags are kept
+  // per range of constraints, so they cost no memory per constraint.
+  void SetConstraintTag(const ConstraintTag& tag);
+  // Returns the tagged ranges of the model constraints, in order.
+  vector<ConstraintTagRange> GetConstraintTags() const;
+  // Returns the tag of a model constraint (empty if untagged).
+  ConstraintTag GetConstraintTag(int constraint) const;
+  // The arity histogram requires a pass over the model.
+  CacheStats GetCacheStats(bool arity_histogram) const;
   void WriteToFile(const path& filename) const;
   void WriteVariablesToFile(const path& filename) const;
   void WriteSatSolutionToFile(const CpSolverResponse& response,
@@ -55,9 +158,45 @@ class ModelWrapper {
     }
     return nullptr;
   }
-  BoolVar FalseVar() { return model_.FalseVar().WithName("0"); }
-  BoolVar TrueVar() { return model_.TrueVar().WithName("1"); }
+  // Integer variables over a set of values (e.g. the role of a player at a
+  // time step), constrained through their channeling literals only (see
+  // AddEquivalenceIntEq).
+  IntVar NewIntVar(absl::Span<const int64_t> values, const string& name);
+  // Variable families are dense tables of variables indexed by a key of small
+  // non-negative integers (e.g. player x role x time), so that looking up a
+  // variable is an array access. The namer is only called on variable creation.
+  int NewVarFamily(const string& name, absl::Span<const int> dims,
+                   VarNamer namer);
+  BoolVar FamilyVar(int family, absl::Span<const int> key);
+  const BoolVar* FindFamilyVar(int family,  // null if not defined.
+                               absl::Span<const int> key) const {
+    const auto& v = families_[family].vars[FamilyIndex(family, key)];
+    return v.has_value() ? &(*v) : nullptr;
+  }
+  // The literal of a model proto literal index (negative if negated).
+  BoolVar Literal(int index) {
+    return index >= 0 ? model_.GetBoolVarFromProtoIndex(index)
+                      : Not(model_.GetBoolVarFromProtoIndex(-index - 1));
+  }
+  BoolVar FalseVar() {
+    return named_ ? model_.FalseVar().WithName("0") : model_.FalseVar();
+  }
+  BoolVar TrueVar() {
+    return named_ ? model_.TrueVar().WithName("1") : model_.TrueVar();
+  }
+  // Must be set before any constraint is added.
+  void SetConstantFolding(bool enabled) { constant_folding_ = enabled; }
   void FixVariable(const BoolVar& var, bool val);
+  // Replaces the assumptions (literals assumed true while solving) of a copy
+  // of the model. The model itself never has assumptions, so that it can be
+  // shared by concurrent solves.
+  static void SetAssumptions(absl::Span<const BoolVar> literals,
+                             CpModelProto* model);
+  // Replaces the decision strategy of a copy of the model: the solver branches
+  // on the literals of every stage in order, trying true first, before the
+  // other variables.
+  static void SetDecisionStrategy(const vector<vector<BoolVar>>& stages,
+                                  CpModelProto* model);
   void AddAnd(absl::Span<const BoolVar> literals);
   void AddOr(absl::Span<const BoolVar> literals);
   void AddEquality(const BoolVar& var, bool val) {
@@ -72,19 +211,32 @@ class ModelWrapper {
   void AddImplicationEq(const BoolVar& var,  // var -> left = right
                         const BoolVar& left,
                         const BoolVar& right);
-  void AddImplicationSum(const BoolVar& var,
-                         absl::Span<const BoolVar> literals, int sum);
+  // The cardinality constraints below use the default encoding unless another
+  // encoding is requested.
+  void SetDefaultCardinalityEncoding(CardinalityEncoding encoding) {
+    default_encoding_ = encoding;
+  }
+  void AddImplicationSum(
+      const BoolVar& var, absl::Span<const BoolVar> literals, int sum,
+      CardinalityEncoding encoding = CardinalityEncoding::kDefault);
   void AddEquivalenceAnd(const BoolVar& var,
                          absl::Span<const BoolVar> literals);
   void AddEquivalenceOr(const BoolVar& var,
                         absl::Span<const BoolVar> literals);
   void AddEquivalenceSum(const BoolVar& var,  // var = Sum(literals)
                          absl::Span<const BoolVar> literals);
-  void AddEquivalenceSumEq(const BoolVar& var,
-                           absl::Span<const BoolVar> literals,
-                           int sum);
-  void AddEqualitySum(absl::Span<const BoolVar> literals, int sum);
+  void AddEquivalenceSumEq(
+      const BoolVar& var, absl::Span<const BoolVar> literals, int sum,
+      CardinalityEncoding encoding = CardinalityEncoding::kDefault);
+  void AddEqualitySum(
+      absl::Span<const BoolVar> literals, int sum,
+      CardinalityEncoding encoding = CardinalityEncoding::kDefault);
   void AddAtMostOne(absl::Span<const BoolVar> literals);
+  void AddEquivalenceIntEq(const BoolVar& var,  // var <-> x == value
+                           const IntVar& x, int64_t value);
+  // The literals take one of the tuples of values (0 or 1 per literal).
+  void AddAllowedAssignments(absl::Span<const BoolVar> literals,
+                             const vector<vector<int64_t>>& tuples);
   void AddContradiction(const string& reason);
   BoolVar NewEquivalentVarAnd(absl::Span<const BoolVar> literals,
                               const string& name);
@@ -92,13 +244,85 @@ class ModelWrapper {
                              const string& name);
   BoolVar NewEquivalentVarSum(absl::Span<const BoolVar> literals,
                               const string& name);
-  BoolVar NewEquivalentVarSumEq(absl::Span<const BoolVar> literals, int sum,
-                                const string& name);
+  BoolVar NewEquivalentVarSumEq(
+      absl::Span<const BoolVar> literals, int sum, const string& name,
+      CardinalityEncoding encoding = CardinalityEncoding::kDefault);
 
  private:
+  struct VarFamily {
+    string name;
+    vector<int> dims;
+    VarNamer namer;
+    vector<std::optional<BoolVar>> vars;
+    CacheStats::Counter counter;
+  };
+  struct FoldedLiterals {
+    Literals unfixed;
+    int num_true = 0;
+    int num_false = 0;
+  };
+  int FamilyIndex(int family, absl::Span<const int> key) const;
+  // Returns the value of a fixed literal, or -1 if unfixed (or not folding).
+  int LiteralValue(const BoolVar& literal);
+  // Fixes the literal to true, or adds a contradiction if it is false.
+  void FixLiteral(const BoolVar& literal);
+  // Splits the literals into the unfixed ones and the counts of fixed ones.
+  FoldedLiterals Fold(absl::Span<const BoolVar> literals);
+  // Returns the names of all model variables, rebuilt if unnamed.
+  vector<string> VarNames() const;
+  // Returns whether the constraint with the structural key wasn't added yet.
+  bool IsNewConstraint(absl::Span<const int> key);
+  // Adds var -> Sum(literals) == sum (or var <-> Sum(literals) == sum, if
+  // equivalent) using a unary count encoding.
+  void AddUnaryCountSumEq(const BoolVar& var,
+                          absl::Span<const BoolVar> literals, int sum,
+                          CardinalityEncoding encoding, bool equivalent);
+  // Returns literals equivalent to Sum(literals) >= j, for j = 1..bound.
+  vector<BoolVar> UnaryCount(absl::Span<const BoolVar> literals, int bound,
+                             CardinalityEncoding encoding);
+  vector<BoolVar> SequentialCounter(absl::Span<const BoolVar> literals,
+                                    int bound);
+  vector<BoolVar> Totalizer(absl::Span<const BoolVar> literals, int bound);
+  // Returns the literals sorted in decreasing order, truncated to bound.
+  vector<BoolVar> SortingNetwork(absl::Span<const BoolVar> literals,
+                                 int bound);
+  vector<BoolVar> OddEvenMerge(absl::Span<const BoolVar> left,
+                               absl::Span<const BoolVar> right);
+  // Returns the name of an auxiliary encoding variable, if named.
+  string AuxVarName(const string& prefix) const;
+  // Returns whether the derived variable with the structural key was created.
+  bool LookupEquivalentVar(absl::Span<const int> key, const string& name,
+                           BoolVar* var);
+  // Returns a copy of the structural key, stored in the key blocks.
+  absl::Span<const int> StoreKey(absl::Span<const int> key);
+
+  bool named_;
+  // The first constraint of every tagged range, in order.
+  vector<pair<int, ConstraintTag>> constraint_tags_;
+  CardinalityEncoding default_encoding_ = CardinalityEncoding::kLinear;
+  bool constant_folding_ = true;
+  // Fixed values of the variables by index (-1 if unfixed), synced lazily from
+  // the variable domains for variables created outside of the wrapper.
+  vector<int8_t> values_;
   CpModelBuilder model_;
-  unordered_map<string, BoolVar> var_cache_;  // To prevent duplicate variables
-  unordered_set<string> constraint_cache_;    // and constraints.
+  vector<VarFamily> families_;
+  unordered_map<string, BoolVar> var_cache_;  // Named variables.
+  unordered_map<string, IntVar> int_var_cache_;  // Integer variables.
+  // Hash-consing of derived variables and constraints by structural keys (an
+  // operator tag followed by canonical literal indices), to prevent duplicates.
+  // The keys are probed from a scratch buffer and stored back to back in
+  // fixed blocks, so that neither probing nor storing a key allocates a vector.
+  absl::flat_hash_map<absl::Span<const int>, BoolVar> equivalent_var_cache_;
+  absl::flat_hash_set<absl::Span<const int>> constraint_cache_;
+  vector<int> key_;
+  vector<std::unique_ptr<int[]>> key_blocks_;
+  int key_block_size_ = 0;  // Used size of the last key block.
+  CacheStats::Counter named_var_counter_;
+  CacheStats::Counter equivalent_var_counters_[4];  // And, Or, Sum, SumEq.
+  int64_t constraints_ = 0;
+  int64_t duplicate_constraints_ = 0;
+  int64_t fixed_literals_ = 0;
+  int64_t folded_constraints_ = 0;
 };
 
 }  // namespace botc
@@ -22,6 +22,7 @@ using operations_research::sat::LinearExpr;
 TEST(ModelWrapper, EquivalentToCpModel) {
   CpModelBuilder original;
   ModelWrapper wrapper;
+  wrapper.SetConstantFolding(false);  // Emit the constraints as given.
 
   BoolVar x_o = original.NewBoolVar().WithName("x");
   BoolVar y_o = original.NewBoolVar().WithName("y");
@@ -84,6 +85,342 @@ TEST(ModelWrapper, CachingWorks) {
   wrapper.AddEquality(y, x);
   EXPECT_EQ(wrapper.Model().Build().constraints_size(), 2);
 }
+
+TEST(ModelWrapper, StructuralCaching) {
+  ModelWrapper wrapper;
+
+  BoolVar x = wrapper.NewVar("x");
+  BoolVar y = wrapper.NewVar("y");
+  BoolVar z = wrapper.NewVar("z");
+  // Derived variables are keyed by structure, not by the requested name.
+  BoolVar s = wrapper.NewEquivalentVarSumEq({x, y, z}, 2, "s");
+  EXPECT_EQ(s, wrapper.NewEquivalentVarSumEq({z, x, y}, 2, "other"));
+  EXPECT_NE(s, wrapper.NewEquivalentVarSumEq({x, y, z}, 1, "s1"));
+  EXPECT_EQ(wrapper.Model().Build().variables_size(), 5);
+  EXPECT_EQ(wrapper.Model().Build().constraints_size(), 4);
+  // Equivalence sum constraints share their first half with implications.
+  wrapper.AddImplicationSum(s, {y, z, x}, 2);
+  wrapper.AddImplicationEq(s, x, y);
+  wrapper.AddImplicationEq(s, y, x);
+  wrapper.AddAtMostOne({z, y});
+  wrapper.AddAtMostOne({y, z});
+  EXPECT_EQ(wrapper.Model().Build().constraints_size(), 6);
+}
+
+TEST(ModelWrapper, VarFamilies) {
+  ModelWrapper wrapper;
+
+  const int f = wrapper.NewVarFamily("f", {2, 3}, [](absl::Span<const int> key) {
+    return absl::StrFormat("f_%d_%d", key[0], key[1]);
+  });
+  EXPECT_EQ(wrapper.FindFamilyVar(f, {1, 2}), nullptr);
+  BoolVar x = wrapper.FamilyVar(f, {1, 2});
+  EXPECT_EQ(x.Name(), "f_1_2");
+  EXPECT_EQ(x, wrapper.FamilyVar(f, {1, 2}));  // Variable caching.
+  ASSERT_NE(wrapper.FindFamilyVar(f, {1, 2}), nullptr);
+  EXPECT_EQ(*wrapper.FindFamilyVar(f, {1, 2}), x);
+  EXPECT_NE(x, wrapper.FamilyVar(f, {0, 2}));
+  EXPECT_EQ(wrapper.Model().Build().variables_size(), 2);
+}
+
+TEST(ModelWrapper, CacheStats) {
+  ModelWrapper wrapper;
+
+  BoolVar x = wrapper.NewVar("x");
+  wrapper.NewVar("x");
+  const int f = wrapper.NewVarFamily("f", {2}, [](absl::Span<const int> key) {
+    return absl::StrFormat("f_%d", key[0]);
+  });
+  BoolVar y = wrapper.FamilyVar(f, {0});
+  wrapper.FamilyVar(f, {0});
+  wrapper.FamilyVar(f, {1});
+  wrapper.NewEquivalentVarOr({x, y}, "x_or_y");
+  wrapper.NewEquivalentVarOr({y, x}, "y_or_x");
+  wrapper.AddOr({x, y});
+  wrapper.AddOr({y, x});
+  const CacheStats stats = wrapper.GetCacheStats(/*arity_histogram=*/true);
+  EXPECT_EQ(stats.vars.at("NewVar").hits, 1);
+  EXPECT_EQ(stats.vars.at("NewVar").misses, 1);
+  EXPECT_EQ(stats.vars.at("f").hits, 1);
+  EXPECT_EQ(stats.vars.at("f").misses, 2);
+  EXPECT_EQ(stats.vars.at("EquivalentVarOr").hits, 1);
+  EXPECT_EQ(stats.vars.at("EquivalentVarOr").misses, 1);
+  EXPECT_EQ(stats.constraints, 3);  // Two for the Or equivalence.
+  EXPECT_EQ(stats.duplicate_constraints, 1);
+  EXPECT_GT(stats.key_bytes, 0);
+  EXPECT_THAT(stats.constraint_arity,
+              testing::ElementsAre(testing::Pair(2, 1), testing::Pair(3, 2)));
+}
+
+TEST(ModelWrapper, ProtoRoundTrip) {
+  auto namer = [](absl::Span<const int> key) {
+    return absl::StrFormat("f_%d", key[0]);
+  };
+  ModelWrapper wrapper;
+  BoolVar x = wrapper.NewVar("x");
+  const int f = wrapper.NewVarFamily("f", {2}, namer);
+  BoolVar y = wrapper.FamilyVar(f, {1});
+  BoolVar z = wrapper.NewEquivalentVarAnd({x, y}, "z");
+  CompiledModel pb;
+  wrapper.ToProto(&pb);
+
+  ModelWrapper restored;
+  restored.NewVarFamily("f", {2}, namer);
+  restored.FromProto(pb);
+  EXPECT_EQ(restored.Model().Build().DebugString(),
+            wrapper.Model().Build().DebugString());
+  EXPECT_EQ(restored.NewVar("x").index(), x.index());
+  EXPECT_EQ(restored.FamilyVar(f, {1}).index(), y.index());
+  EXPECT_EQ(restored.FindFamilyVar(f, {0}), nullptr);
+  EXPECT_EQ(restored.NewEquivalentVarAnd({y, x}, "z").index(), z.index());
+  EXPECT_EQ(restored.Model().Build().variables_size(), 3);
+}
+
+bool IsFeasible(const CpSolverResponse& response) {
+  return (response.status() == operations_research::sat::OPTIMAL ||
+          response.status() == operations_research::sat::FEASIBLE);
+}
+
+// Solves a copy of the model under the assumptions.
+CpSolverResponse SolveWithAssumptions(const ModelWrapper& wrapper,
+                                      absl::Span<const BoolVar> assumptions) {
+  CpModelProto model = wrapper.Model().Build();
+  ModelWrapper::SetAssumptions(assumptions, &model);
+  return operations_research::sat::Solve(model);
+}
+
+class CardinalityEncodingTest
+    : public testing::TestWithParam<CardinalityEncoding> {};
+
+TEST_P(CardinalityEncodingTest, SumEqualsForAllAssignments) {
+  const int n = 5;
+  for (int sum = -1; sum <= n + 1; ++sum) {
+    ModelWrapper wrapper;
+    wrapper.SetDefaultCardinalityEncoding(GetParam());
+    vector<BoolVar> x;
+    for (int i = 0; i < n; ++i) {
+      x.push_back(wrapper.NewVar(absl::StrFormat("x%d", i)));
+    }
+    BoolVar eq = wrapper.NewEquivalentVarSumEq(x, sum, "eq");
+    BoolVar implies_eq = wrapper.NewVar("implies_eq");
+    wrapper.AddImplicationSum(implies_eq, x, sum);
+    for (int mask = 0; mask < (1 << n); ++mask) {
+      vector<BoolVar> assignment;
+      int count = 0;
+      for (int i = 0; i < n; ++i) {
+        const bool val = mask & (1 << i);
+        assignment.push_back(val ? x[i] : Not(x[i]));
+        count += val;
+      }
+      const auto response = SolveWithAssumptions(wrapper, assignment);
+      ASSERT_TRUE(IsFeasible(response));
+      EXPECT_EQ(SolutionBooleanValue(response, eq), count == sum)
+          << "sum " << sum << " mask " << mask;
+      assignment.push_back(implies_eq);
+      EXPECT_EQ(IsFeasible(SolveWithAssumptions(wrapper, assignment)),
+                count == sum) << "sum " << sum << " mask " << mask;
+    }
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    ModelWrapper, CardinalityEncodingTest,
+    testing::Values(CardinalityEncoding::kLinear,
+                    CardinalityEncoding::kSequentialCounter,
+                    CardinalityEncoding::kTotalizer,
+                    CardinalityEncoding::kCardinalityNetwork));
+
+TEST(ModelWrapper, UnnamedModel) {
+  ModelWrapper wrapper(/*named=*/false);
+
+  BoolVar x = wrapper.NewVar("x");
+  const int f = wrapper.NewVarFamily("f", {2}, [](absl::Span<const int> key) {
+    return absl::StrFormat("f_%d", key[0]);
+  });
+  BoolVar y = wrapper.FamilyVar(f, {1});
+  BoolVar z = wrapper.NewEquivalentVarAnd({y, Not(x)}, "z");
+  wrapper.NewEquivalentVarSumEq({x, z}, 1, "s");
+  wrapper.AddOr({x, wrapper.FalseVar()});
+  CpModelProto model = wrapper.Model().Build();
+  for (const auto& v : model.variables()) {
+    EXPECT_EQ(v.name(), "");
+  }
+  for (const auto& c : model.constraints()) {
+    EXPECT_EQ(c.name(), "");
+  }
+  wrapper.NameVariables(&model);
+  vector<string> names;
+  for (const auto& v : model.variables()) {
+    names.push_back(v.name());
+  }
+  EXPECT_THAT(names, testing::ElementsAre(
+      "x", "f_1", "(Not(x) ^ f_1)", "(1 = x + (Not(x) ^ f_1))", "0"));
+}
+
+TEST(ModelWrapper, ConstantFolding) {
+  ModelWrapper wrapper;
+  BoolVar x = wrapper.NewVar("x");
+  BoolVar y = wrapper.NewVar("y");
+  BoolVar z = wrapper.NewVar("z");
+  wrapper.FixVariable(x, true);
+  wrapper.AddOr({x, y});  // Satisfied.
+  wrapper.AddOr({Not(x), y, z});  // Reduced to y V z.
+  wrapper.AddImplication(x, y);  // Fixes y.
+  wrapper.AddImplicationAnd(y, {z, x});  // Fixes z.
+  EXPECT_EQ(wrapper.NewEquivalentVarAnd({x, y}, "a").index(),
+            wrapper.TrueVar().index());
+  EXPECT_EQ(wrapper.NewEquivalentVarOr({Not(x), Not(z)}, "b").index(),
+            wrapper.FalseVar().index());
+  const CpModelProto& model = wrapper.Model().Build();
+  ASSERT_EQ(model.constraints_size(), 1);
+  EXPECT_THAT(model.constraints(0).bool_or().literals(),
+              testing::ElementsAre(y.index(), z.index()));
+  for (const BoolVar& v : {x, y, z}) {
+    EXPECT_THAT(model.variables(v.index()).domain(),
+                testing::ElementsAre(1, 1));
+  }
+  const CacheStats stats = wrapper.GetCacheStats(false);
+  EXPECT_EQ(stats.fixed_literals, 3);
+  EXPECT_EQ(stats.folded_constraints, 3);
+
+  wrapper.FixVariable(z, false);  // Contradicts the fixed value.
+  EXPECT_EQ(wrapper.Model().Build().constraints_size(), 2);
+}
+
+TEST(ModelWrapper, ConstantFoldingPreservesSolutions) {
+  const int n = 4;
+  ModelWrapper folded, unfolded;
+  unfolded.SetConstantFolding(false);
+  vector<BoolVar> folded_x, unfolded_x;
+  for (auto [wrapper, x] : {std::make_pair(&folded, &folded_x),
+                            std::make_pair(&unfolded, &unfolded_x)}) {
+    for (int i = 0; i < n; ++i) {
+      x->push_back(wrapper->NewVar(absl::StrCat("x", i)));
+    }
+    const vector<BoolVar>& v = *x;
+    wrapper->FixVariable(v[0], true);
+    wrapper->AddOr({Not(v[0]), v[1], v[2]});
+    const BoolVar e = wrapper->NewEquivalentVarSumEq(v, 2, "e");
+    wrapper->AddImplicationEq(v[0], e, v[3]);
+    wrapper->AddAtMostOne({Not(v[0]), v[1], v[3]});
+    wrapper->AddImplicationSum(v[1], {v[0], v[2], v[3]}, 2);
+    const BoolVar s = wrapper->NewEquivalentVarSum({Not(v[0]), v[2]}, "s");
+    wrapper->AddImplication(s, v[3]);
+  }
+  for (int mask = 0; mask < (1 << n); ++mask) {
+    vector<BoolVar> folded_assignment, unfolded_assignment;
+    for (int i = 0; i < n; ++i) {
+      const bool val = mask & (1 << i);
+      folded_assignment.push_back(val ? folded_x[i] : Not(folded_x[i]));
+      unfolded_assignment.push_back(val ? unfolded_x[i] : Not(unfolded_x[i]));
+    }
+    EXPECT_EQ(IsFeasible(SolveWithAssumptions(folded, folded_assignment)),
+              IsFeasible(SolveWithAssumptions(unfolded, unfolded_assignment)))
+        << "mask " << mask;
+  }
+}
+TEST(ModelWrapper, ChannelsIntVars) {
+  ModelWrapper wrapper;
+  const IntVar x = wrapper.NewIntVar({2, 5, 7}, "x");
+  EXPECT_EQ(wrapper.NewIntVar({2, 5, 7}, "x").index(), x.index());
+  const BoolVar a = wrapper.NewVar("a"), b = wrapper.NewVar("b");
+  wrapper.AddEquivalenceIntEq(a, x, 2);
+  wrapper.AddEquivalenceIntEq(b, x, 5);
+  wrapper.AddEquivalenceIntEq(b, x, 5);  // Deduplicated.
+  EXPECT_EQ(wrapper.Model().Build().constraints_size(), 4);
+  // The literals are exclusive, and x = 7 iff both are false.
+  for (int mask = 0; mask < 4; ++mask) {
+    EXPECT_EQ(IsFeasible(SolveWithAssumptions(
+                  wrapper, {mask & 1 ? a : Not(a), mask & 2 ? b : Not(b)})),
+              mask != 3) << "mask " << mask;
+  }
+  CompiledModel pb;
+  wrapper.ToProto(&pb);
+  ModelWrapper restored;
+  restored.FromProto(pb);
+  EXPECT_EQ(restored.NewIntVar({2, 5, 7}, "x").index(), x.index());
+  EXPECT_EQ(restored.VarKeys()[x.index()].family, "IntVar");
+}
+
+TEST(ModelWrapper, AddsAllowedAssignments) {
+  ModelWrapper wrapper;
+  const BoolVar x = wrapper.NewVar("x"), y = wrapper.NewVar("y");
+  const BoolVar z = wrapper.NewVar("z");
+  wrapper.FixVariable(z, true);
+  // Allows x != y, or Not(x) with y, projected on the unfixed literals.
+  wrapper.AddAllowedAssignments({x, Not(y), z},
+                                {{1, 1, 1}, {0, 0, 1}, {0, 1, 1}, {1, 0, 0}});
+  const CpModelProto& model = wrapper.Model().Build();
+  const auto& table = model.constraints(model.constraints_size() - 1).table();
+  EXPECT_EQ(table.vars_size(), 2);
+  EXPECT_EQ(table.values_size(), 6);
+  for (int mask = 0; mask < 4; ++mask) {
+    const bool x_value = mask & 1, y_value = mask & 2;
+    EXPECT_EQ(IsFeasible(SolveWithAssumptions(
+                  wrapper, {x_value ? x : Not(x), y_value ? y : Not(y)})),
+              !x_value || !y_value) << "mask " << mask;
+  }
+  // The same table, with its tuples in another order, is a duplicate.
+  const int constraints = model.constraints_size();
+  wrapper.AddAllowedAssignments({x, Not(y), z},
+                                {{1, 0, 0}, {0, 1, 1}, {0, 0, 1}, {1, 1, 1}});
+  EXPECT_EQ(wrapper.Model().Build().constraints_size(), constraints);
+  EXPECT_EQ(wrapper.GetCacheStats(false).duplicate_constraints, 1);
+  // A single allowed tuple fixes the literals.
+  ModelWrapper folded;
+  const BoolVar a = folded.NewVar("a"), b = folded.NewVar("b");
+  folded.AddAllowedAssignments({a, b}, {{1, 0}});
+  EXPECT_EQ(folded.Model().Build().constraints_size(), 0);
+  EXPECT_TRUE(IsFeasible(SolveWithAssumptions(folded, {Not(b)})));
+  EXPECT_FALSE(IsFeasible(SolveWithAssumptions(folded, {Not(a)})));
+}
+
+TEST(ModelWrapper, SetsDecisionStrategy) {
+  ModelWrapper wrapper;
+  const BoolVar x = wrapper.NewVar("x"), y = wrapper.NewVar("y");
+  CpModelProto model = wrapper.Model().Build();
+  ModelWrapper::SetDecisionStrategy({{x, y}, {}, {Not(y)}}, &model);
+  ASSERT_EQ(model.search_strategy_size(), 2);
+  EXPECT_EQ(model.search_strategy(0).variables_size(), 2);
+  EXPECT_EQ(model.search_strategy(1).variables(0), Not(y).index());
+  ModelWrapper::SetDecisionStrategy({}, &model);
+  EXPECT_EQ(model.search_strategy_size(), 0);
+  EXPECT_EQ(wrapper.Model().Build().search_strategy_size(), 0);
+}
+
+TEST(ModelWrapper, TagsConstraints) {
+  ModelWrapper model;
+  const BoolVar x = model.NewVar("x"), y = model.NewVar("y");
+  model.SetConstraintTag({.source = "a"});
+  model.AddOr({x, y});
+  model.AddImplication(x, y);
+  model.SetConstraintTag({.source = "unused"});
+  model.SetConstraintTag({.source = "b", .role = 1, .time = 2, .event = 3});
+  model.AddAtMostOne({x, y});
+  const auto tags = model.GetConstraintTags();
+  ASSERT_EQ(tags.size(), 2);
+  EXPECT_EQ(tags[0].tag.source, "a");
+  EXPECT_EQ(tags[0].begin, 0);
+  EXPECT_EQ(tags[0].end, 2);
+  EXPECT_EQ(tags[1].tag.source, "b");
+  EXPECT_EQ(tags[1].begin, 2);
+  EXPECT_EQ(tags[1].end, 3);
+  EXPECT_EQ(model.GetConstraintTag(1).source, "a");
+  EXPECT_EQ(model.GetConstraintTag(2).event, 3);
+
+  CompiledModel pb;
+  model.ToProto(&pb);
+  ModelWrapper restored;
+  restored.FromProto(pb);
+  const auto restored_tags = restored.GetConstraintTags();
+  ASSERT_EQ(restored_tags.size(), 2);
+  EXPECT_EQ(restored_tags[1].tag.source, "b");
+  EXPECT_EQ(restored_tags[1].tag.role, 1);
+  EXPECT_EQ(restored_tags[1].tag.time, 2);
+  EXPECT_EQ(restored_tags[1].begin, 2);
+  EXPECT_EQ(restored_tags[1].end, 3);
+}
+
 }  // namespace botc
 
 int main(int argc, char **argv) {
@@ -0,0 +1,124 @@
+// Copyright 2022 Ola Rozenfeld
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/setup_catalog.h"
+
+#include <algorithm>
+#include <bit>
+
+#include "ortools/base/logging.h"
+#include "src/game_state.h"
+
+namespace botc {
+namespace {
+constexpr int kMinPlayers = 5;
+constexpr int kMaxPlayers = 15;
+
+// Returns all the sets of size roles out of the roles.
+vector<RoleSet> Combinations(absl::Span<const Role> roles, int size) {
+  vector<RoleSet> result;
+  if (size < 0 || size > roles.size()) {
+    return result;
+  }
+  for (uint32_t mask = 0; mask < (uint32_t{1} << roles.size()); ++mask) {
+    if (std::popcount(mask) != size) {
+      continue;
+    }
+    RoleSet set = 0;
+    for (int i = 0; i < roles.size(); ++i) {
+      if (mask & (uint32_t{1} << i)) {
+        set |= RoleBit(roles[i]);
+      }
+    }
+    result.push_back(set);
+  }
+  return result;
+}
+}  // namespace
+
+RoleSet MakeRoleSet(absl::Span<const Role> roles) {
+  RoleSet result = 0;
+  for (Role role : roles) {
+    result |= RoleBit(role);
+  }
+  return result;
+}
+
+bool HasRole(RoleSet roles, Role role) {
+  return (roles & RoleBit(role)) != 0;
+}
+
+int NumRoles(RoleSet roles) {
+  return std::popcount(roles);
+}
+
+const SetupCatalog& SetupCatalog::Get(Script script) {
+  CHECK_EQ(script, TROUBLE_BREWING)
+      << Script_Name(script) << " setups are not supported";
+  static const SetupCatalog* const kTroubleBrewing =
+      new SetupCatalog(TROUBLE_BREWING);
+  return *kTroubleBrewing;
+}
+
+SetupCatalog::SetupCatalog(Script script) {
+  const auto townsfolk_roles = TownsfolkRoles(script);
+  const auto outsider_roles = OutsiderRoles(script);
+  const auto minion_roles = MinionRoles(script);
+  const auto demon_roles = DemonRoles(script);
+  for (int num_players = kMinPlayers; num_players <= kMaxPlayers;
+       ++num_players) {
+    const int index = num_players - kMinPlayers;
+    vector<RoleSet>& setups = setups_.emplace_back();
+    for (RoleSet evil : Combinations(minion_roles, kNumMinions[index])) {
+      // The Baron adds two Outsiders, in place of two Townsfolk.
+      const int baron = HasRole(evil, BARON) ? 2 : 0;
+      const vector<RoleSet> outsiders =
+          Combinations(outsider_roles, kNumOutsiders[index] + baron);
+      const vector<RoleSet> townsfolk =
+          Combinations(townsfolk_roles, kNumTownsfolk[index] - baron);
+      for (Role demon : demon_roles) {
+        for (RoleSet o : outsiders) {
+          for (RoleSet t : townsfolk) {
+            setups.push_back(evil | RoleBit(demon) | o | t);
+          }
+        }
+      }
+    }
+    std::sort(setups.begin(), setups.end());
+  }
+}
+
+absl::Span<const RoleSet> SetupCatalog::Setups(int num_players) const {
+  CHECK_GE(num_players, kMinPlayers);
+  CHECK_LE(num_players, kMaxPlayers);
+  return setups_[num_players - kMinPlayers];
+}
+
+int SetupCatalog::SetupIndex(int num_players, RoleSet setup) const {
+  const auto setups = Setups(num_players);
+  const auto it = std::lower_bound(setups.begin(), setups.end(), setup);
+  return it != setups.end() && *it == setup ? it - setups.begin() : -1;
+}
+
+vector<RoleSet> SetupCatalog::FilterSetups(int num_players, RoleSet required,
+                                           RoleSet excluded) const {
+  vector<RoleSet> result;
+  for (RoleSet setup : Setups(num_players)) {
+    if ((setup & required) == required && (setup & excluded) == 0) {
+      result.push_back(setup);
+    }
+  }
+  return result;
+}
+
+}  // namespace botc
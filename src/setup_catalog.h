@@ -0,0 +1,62 @@
+// Copyright 2022 Ola Rozenfeld
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_SETUP_CATALOG_H_
+#define SRC_SETUP_CATALOG_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "src/game_log.pb.h"
+
+namespace botc {
+
+using std::vector;
+
+// A set of roles, as a bit mask with a bit per Role value.
+typedef uint64_t RoleSet;
+static_assert(Role_ARRAYSIZE <= 64, "Roles do not fit a RoleSet");
+
+inline RoleSet RoleBit(Role role) { return RoleSet{1} << role; }
+RoleSet MakeRoleSet(absl::Span<const Role> roles);
+bool HasRole(RoleSet roles, Role role);
+int NumRoles(RoleSet roles);
+
+// The legal starting setups of a script: the sets of roles in play, for every
+// number of players. A setup has the script's numbers of Townsfolk, Outsiders,
+// Minions and one Demon, with the Baron adding two Outsiders in place of two
+// Townsfolk. The catalog is computed once per process and script.
+class SetupCatalog {
+ public:
+  static const SetupCatalog& Get(Script script);
+
+  // The legal setups for the number of players, sorted.
+  absl::Span<const RoleSet> Setups(int num_players) const;
+  // Returns the index of the setup in Setups(num_players), or -1 if the setup
+  // is not legal.
+  int SetupIndex(int num_players, RoleSet setup) const;
+  // Returns the legal setups with all the required roles, and none of the
+  // excluded roles.
+  vector<RoleSet> FilterSetups(int num_players, RoleSet required,
+                               RoleSet excluded) const;
+
+ private:
+  explicit SetupCatalog(Script script);
+
+  vector<vector<RoleSet>> setups_;  // x number of players - 5
+};
+
+}  // namespace botc
+
+#endif  // SRC_SETUP_CATALOG_H_
@@ -0,0 +1,88 @@
+// Copyright 2022 Ola Rozenfeld
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/setup_catalog.h"
+
+#include "gtest/gtest.h"
+#include "src/game_state.h"
+
+namespace botc {
+namespace {
+
+int CountRoles(RoleSet setup, absl::Span<const Role> roles) {
+  return NumRoles(setup & MakeRoleSet(roles));
+}
+
+TEST(SetupCatalog, CountsSetups) {
+  const SetupCatalog& catalog = SetupCatalog::Get(TROUBLE_BREWING);
+  // 3 Minions x 3 of 13 Townsfolk, or the Baron with 2 of 4 Outsiders x 1 of
+  // 13 Townsfolk.
+  EXPECT_EQ(catalog.Setups(5).size(), 3 * 286 + 6 * 13);
+  // 3 Minions x 1 of 4 Outsiders x 5 of 13 Townsfolk, or the Baron with 3 of
+  // 4 Outsiders x 3 of 13 Townsfolk.
+  EXPECT_EQ(catalog.Setups(8).size(), 3 * 4 * 1287 + 4 * 286);
+}
+
+TEST(SetupCatalog, SetupsHaveTheRoleCounts) {
+  const SetupCatalog& catalog = SetupCatalog::Get(TROUBLE_BREWING);
+  for (int num_players = 5; num_players <= 15; ++num_players) {
+    const int index = num_players - 5;
+    for (RoleSet setup : catalog.Setups(num_players)) {
+      ASSERT_EQ(NumRoles(setup), num_players);
+      ASSERT_EQ(CountRoles(setup, DemonRoles(TROUBLE_BREWING)), 1);
+      ASSERT_EQ(CountRoles(setup, MinionRoles(TROUBLE_BREWING)),
+                kNumMinions[index]);
+      const int baron = HasRole(setup, BARON) ? 2 : 0;
+      ASSERT_EQ(CountRoles(setup, OutsiderRoles(TROUBLE_BREWING)),
+                kNumOutsiders[index] + baron);
+      ASSERT_EQ(CountRoles(setup, TownsfolkRoles(TROUBLE_BREWING)),
+                kNumTownsfolk[index] - baron);
+    }
+  }
+}
+
+TEST(SetupCatalog, IndexesSetups) {
+  const SetupCatalog& catalog = SetupCatalog::Get(TROUBLE_BREWING);
+  const auto setups = catalog.Setups(7);
+  for (int i = 0; i < setups.size(); ++i) {
+    ASSERT_EQ(catalog.SetupIndex(7, setups[i]), i);
+  }
+  EXPECT_GE(catalog.SetupIndex(
+                5, MakeRoleSet({IMP, POISONER, CHEF, EMPATH, MAYOR})), 0);
+  // Two Minions, and a Drunk without a Baron.
+  EXPECT_EQ(catalog.SetupIndex(
+                5, MakeRoleSet({IMP, POISONER, SPY, EMPATH, MAYOR})), -1);
+  EXPECT_EQ(catalog.SetupIndex(
+                5, MakeRoleSet({IMP, POISONER, DRUNK, EMPATH, MAYOR})), -1);
+}
+
+TEST(SetupCatalog, FiltersSetups) {
+  const SetupCatalog& catalog = SetupCatalog::Get(TROUBLE_BREWING);
+  // With a Drunk in a 5 player game, the Baron is in play.
+  const vector<RoleSet> drunk = catalog.FilterSetups(5, RoleBit(DRUNK), 0);
+  EXPECT_EQ(drunk.size(), 3 * 13);
+  for (RoleSet setup : drunk) {
+    EXPECT_TRUE(HasRole(setup, BARON));
+  }
+  // Without the Baron, there are no Outsiders.
+  EXPECT_TRUE(catalog.FilterSetups(5, RoleBit(DRUNK), RoleBit(BARON)).empty());
+  EXPECT_EQ(catalog.FilterSetups(5, 0, RoleBit(BARON)).size(), 3 * 286);
+}
+
+}  // namespace
+}  // namespace botc
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
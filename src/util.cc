@@ -15,18 +15,24 @@
 #include <fcntl.h>
 #include <fstream>
 #include <iostream>
+#include <random>
+#include <system_error>
 
 #ifdef _WIN32
 #include <io.h>
 #endif
 
 #include "ortools/base/logging.h"
+#include "google/protobuf/io/coded_stream.h"
 #include "google/protobuf/io/zero_copy_stream_impl.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
 #include "google/protobuf/text_format.h"
 
 namespace botc {
+using google::protobuf::io::CodedOutputStream;
 using google::protobuf::io::FileInputStream;
 using google::protobuf::io::FileOutputStream;
+using google::protobuf::io::StringOutputStream;
 using google::protobuf::TextFormat;
 using std::ofstream;
 
@@ -47,4 +53,62 @@ void WriteProtoToFile(const Message& msg, const path& filename) {
   close(ff);
 }
 
+bool ReadBinaryProtoFromFile(const path& filename, Message* msg) {
+  int ff = open(filename.string().c_str(), O_RDONLY);
+  if (ff < 0) {
+    return false;
+  }
+  FileInputStream fstream(ff);
+  const bool ok = msg->ParseFromZeroCopyStream(&fstream);
+  close(ff);
+  return ok;
+}
+
+bool WriteBinaryProtoToFile(const Message& msg, const path& filename) {
+  // Unique per writer, so that concurrent writers of the same file do not
+  // interleave.
+  std::random_device random;
+  const path tmp_filename = filename.string() + ".tmp" +
+                            std::to_string(random()) + std::to_string(random());
+  int ff = open(tmp_filename.string().c_str(),
+                O_WRONLY | O_CREAT | O_EXCL, 0644);
+  if (ff < 0) {
+    return false;
+  }
+  bool ok;
+  {
+    FileOutputStream output(ff);
+    ok = msg.SerializeToZeroCopyStream(&output) && output.Flush();
+  }
+  ok = close(ff) == 0 && ok;
+  std::error_code error;
+  if (ok) {
+    std::filesystem::rename(tmp_filename, filename, error);
+  }
+  if (!ok || error) {
+    std::filesystem::remove(tmp_filename, error);
+    return false;
+  }
+  return true;
+}
+
+uint64_t Fingerprint(const string& data) {
+  uint64_t hash = 14695981039346656037ull;
+  for (unsigned char c : data) {
+    hash = (hash ^ c) * 1099511628211ull;
+  }
+  return hash;
+}
+
+string SerializeDeterministically(const Message& msg) {
+  string result;
+  {
+    StringOutputStream output(&result);
+    CodedOutputStream coded(&output);
+    coded.SetSerializationDeterministic(true);
+    msg.SerializeToCodedStream(&coded);
+  }
+  return result;
+}
+
 }  // namespace botc
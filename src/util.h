@@ -14,6 +14,7 @@
 #ifndef SRC_UTIL_H_
 #define SRC_UTIL_H_
 
+#include <cstdint>
 #include <filesystem>
 #include <iostream>
 #include <string>
@@ -27,6 +28,15 @@ using std::string;
 
 void ReadProtoFromFile(const path& filename, Message* msg);
 void WriteProtoToFile(const Message& msg, const path& filename);
+// Binary format. Reading returns false if the file is missing or corrupt.
+bool ReadBinaryProtoFromFile(const path& filename, Message* msg);
+// Writes to a temporary file renamed into place, so that readers never see a
+// partially written file. Returns false if the file could not be written.
+bool WriteBinaryProtoToFile(const Message& msg, const path& filename);
+// A stable (across processes and platforms) 64-bit FNV-1a hash.
+uint64_t Fingerprint(const string& data);
+// Serializes in a deterministic order, e.g. for fingerprinting.
+string SerializeDeterministically(const Message& msg);
 }  // namespace botc
 
 #endif  // SRC_UTIL_H_